@@ -97,3 +97,11 @@ __kernel void msa_threshold(read_only image2d_t srcImage, write_only image2d_t d
 	write_imagei(dstImage, coords, isgreaterequal(color, thresholdLevel));   
 }
 
+
+//--------------------------------------------------------------
+// same as msa_threshold, with the level read from a buffer (e.g. written by OpenCLHistogram::otsuThreshold)
+__kernel void msa_threshold_buffer(read_only image2d_t srcImage, write_only image2d_t dstImage, __global const float *thresholdLevel) {
+	int2 coords = (int2)(get_global_id(0), get_global_id(1));
+	float4 color	= read_imagef(srcImage, CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST, coords);
+	write_imagei(dstImage, coords, isgreaterequal(color, thresholdLevel[0]));
+}
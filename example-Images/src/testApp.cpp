@@ -11,19 +11,26 @@ float				captureFPS;				// video capture fps
 msa::OpenCL			openCL;
 msa::OpenCLImage	clImage[2];				// two OpenCL images
 int					activeImageIndex = 0;
-
-unsigned char		*pixels;				// temp buffer
+msa::OpenCLReduction	reduction;				// for the mean color of the output, read back asynchronously
+cl_float4			meanColor;				// last mean color which arrived
+bool				meanColorPending = false;	// a reduceAsync has been started
+msa::OpenCLHistogram	histogram;				// for the automatic threshold level
+msa::OpenCLBuffer	threshLevelBuffer;		// automatic threshold level, computed and used on the device
 
 
 // parameters
 bool				doBlur		= true;
 int					blurAmount	= 5;
+int					blurMode	= 0;		// 0: msa_boxblur passes, 1: OpenCLImage::boxBlur, 2: OpenCLImage::gaussianBlur
+bool				doTimeBlur	= false;	// time the blur (stalls the queue every frame, so only for comparing the blur modes)
+float				blurTime	= 0;		// microseconds spent blurring (smoothed)
 bool				doFlipX		= true;
 bool				doFlipY		= false;
 bool				doGreyscale	= true;
 bool				doInvert	= true;
 bool				doThreshold	= false;
 cl_float			threshLevel	= 0.5;
+bool				doAutoThresh	= false;
 
 
 
@@ -47,10 +54,6 @@ void testApp::setup(){
 	vidHeight	= videoGrabber.getHeight();
 	
 
-	// allocate temp buffer
-	pixels		= new unsigned char[vidWidth * vidHeight * 4];
-	
-
 	// init OpenCL from OpenGL context to enable GL-CL data sharing
 	openCL.setupFromOpenGL();
 	
@@ -71,6 +74,10 @@ void testApp::setup(){
 	openCL.loadKernel("msa_greyscale");
 	openCL.loadKernel("msa_invert");
 	openCL.loadKernel("msa_threshold");
+	openCL.loadKernel("msa_threshold_buffer");
+	
+	
+	threshLevelBuffer.initBuffer(sizeof(cl_float));
 }
 
 //--------------------------------------------------------------
@@ -82,35 +89,40 @@ void testApp::update(){
 	// if there is a new frame....
 	if(videoGrabber.isFrameNew()) {
 		
-		// RGB textures don't seem to work well. so need to copy the vidgrabber data into a RGBA texture
-		int pixelIndex = 0;
-		for(int i=0; i<vidWidth; i++) {
-			for(int j=0; j<vidHeight; j++) {
-				int indexRGB	= pixelIndex * 3;
-				int indexRGBA	= pixelIndex * 4;
-				
-				pixels[indexRGBA  ] = videoGrabber.getPixels()[indexRGB  ];
-				pixels[indexRGBA+1] = videoGrabber.getPixels()[indexRGB+1];
-				pixels[indexRGBA+2] = videoGrabber.getPixels()[indexRGB+2];
-				pixels[indexRGBA+3] = 255;
-				pixelIndex++;
-			}
-		}
-		
-
 		// write the new pixel data into the OpenCL Image (and thus the OpenGL texture)
-		clImage[activeImageIndex].write(pixels);
+		// RGB textures don't seem to work well, so the RGB pixels are uploaded as they are, and expanded to RGBA on the device
+		clImage[activeImageIndex].writeFromPixels(videoGrabber.getPixels(), msa::OPENCL_PIXELS_RGB);
 		
 		
 		if(doBlur) {
-			msa::OpenCLKernel *kernel = openCL.kernel("msa_boxblur");
-			for(int i=0; i<blurAmount; i++) {
-				cl_int offset = i * i / 2 + 1;
-				kernel->setArg(0, clImage[activeImageIndex].getCLMem());
-				kernel->setArg(1, clImage[1-activeImageIndex].getCLMem());
-				kernel->setArg(2, offset);
-				kernel->run2D(vidWidth, vidHeight);
+			// finish before and after to time only the blur (this stalls the queue, so only when asked for)
+			unsigned long long startTime = 0;
+			if(doTimeBlur) {
+				openCL.finish();
+				startTime = ofGetElapsedTimeMicros();
+			}
+			
+			if(blurMode == 0) {
+				msa::OpenCLKernel *kernel = openCL.kernel("msa_boxblur");
+				for(int i=0; i<blurAmount; i++) {
+					cl_int offset = i * i / 2 + 1;
+					kernel->setArg(0, clImage[activeImageIndex].getCLMem());
+					kernel->setArg(1, clImage[1-activeImageIndex].getCLMem());
+					kernel->setArg(2, offset);
+					kernel->run2D(vidWidth, vidHeight);
+					activeImageIndex = 1 - activeImageIndex;
+				}
+			} else if(blurMode == 1) {
+				clImage[activeImageIndex].boxBlur(clImage[1-activeImageIndex], blurAmount * 2);
 				activeImageIndex = 1 - activeImageIndex;
+			} else {
+				clImage[activeImageIndex].gaussianBlur(clImage[1-activeImageIndex], blurAmount);
+				activeImageIndex = 1 - activeImageIndex;
+			}
+			
+			if(doTimeBlur) {
+				openCL.finish();
+				blurTime = 0.9f * blurTime + 0.1f * (ofGetElapsedTimeMicros() - startTime);
 			}
 		}
 		
@@ -148,15 +160,36 @@ void testApp::update(){
 		}
 	
 		if(doThreshold) {
-			msa::OpenCLKernel *kernel = openCL.kernel("msa_threshold");
-			kernel->setArg(0, clImage[activeImageIndex].getCLMem());
-			kernel->setArg(1, clImage[1-activeImageIndex].getCLMem());
-			kernel->setArg(2, threshLevel);
-			kernel->run2D(vidWidth, vidHeight);
+			if(doAutoThresh) {
+				// Otsu's threshold of the red channel (all channels are the same if doGreyscale is on)
+				histogram.compute(clImage[activeImageIndex]);
+				histogram.otsuThreshold(threshLevelBuffer);
+				
+				msa::OpenCLKernel *kernel = openCL.kernel("msa_threshold_buffer");
+				kernel->setArg(0, clImage[activeImageIndex].getCLMem());
+				kernel->setArg(1, clImage[1-activeImageIndex].getCLMem());
+				kernel->setArg(2, threshLevelBuffer.getCLMem());
+				kernel->run2D(vidWidth, vidHeight);
+			} else {
+				msa::OpenCLKernel *kernel = openCL.kernel("msa_threshold");
+				kernel->setArg(0, clImage[activeImageIndex].getCLMem());
+				kernel->setArg(1, clImage[1-activeImageIndex].getCLMem());
+				kernel->setArg(2, threshLevel);
+				kernel->run2D(vidWidth, vidHeight);
+			}
 			activeImageIndex = 1 - activeImageIndex;
 		}
 		
 		
+		// once the last mean color has arrived, keep it and start reading back the next one
+		// (until then keep displaying the old one, rather than waiting for it)
+		if(reduction.isResultReady()) {
+			if(meanColorPending) meanColor = reduction.getValue<cl_float4>();
+			reduction.reduceAsync(clImage[activeImageIndex], msa::OPENCL_REDUCE_MEAN);
+			meanColorPending = true;
+		}
+		
+		
 		// calculate capture fps
 		static float lastTime = 0;
 		float nowTime = ofGetElapsedTimef();
@@ -179,15 +212,19 @@ void testApp::draw(){
 	
 	ofDrawBitmapString(    " app FPS            : " + ofToString(ofGetFrameRate(), 2)
 					   + "\n capture FPS        : " + ofToString(captureFPS, 2)
+					   + "\n mean color         : " + ofToString(meanColor.s[0], 2) + ", " + ofToString(meanColor.s[1], 2) + ", " + ofToString(meanColor.s[2], 2)
 					   + "\n"
 					   + "\n doBlur (b)         : " + (doBlur ? "X" : "")
 					   + "\n   blurAmount (1-9) : " + ofToString(blurAmount)
+					   + "\n   blurMode (m)     : " + (blurMode == 0 ? "msa_boxblur" : blurMode == 1 ? "boxBlur" : "gaussianBlur")
+					   + "\n   blurTime (p)     : " + (doTimeBlur ? ofToString(blurTime, 0) + " us" : "")
 					   + "\n doFlipX (x)        : " + (doFlipX ? "X" : "")
 					   + "\n doFlipY (y)        : " + (doFlipY ? "X" : "")
 					   + "\n doGreyscale (g)    : " + (doGreyscale ? "X" : "")
 					   + "\n doInvert (i)       : " + (doInvert ? "X" : "")
 					   + "\n doThreshold (t)    : " + (doThreshold ? "X" : "")
 					   + "\n   threshLevel ([]) : " + ofToString(threshLevel, 2)
+					   + "\n   doAutoThresh (o) : " + (doAutoThresh ? "X" : "")
 					   , 30, 30);
 }
 
@@ -203,6 +240,14 @@ void testApp::keyPressed(int key){
 			doBlur ^= true;
 			break;
 		
+		case 'm':
+			blurMode = (blurMode + 1) % 3;
+			break;
+		
+		case 'p':
+			doTimeBlur ^= true;
+			break;
+		
 		case 'x':
 			doFlipX ^= true;
 			break;
@@ -223,6 +268,10 @@ void testApp::keyPressed(int key){
 			doThreshold ^= true;
 			break;
 		
+		case 'o':
+			doAutoThresh ^= true;
+			break;
+		
 		case 's':
 			videoGrabber.videoSettings();
 			break;
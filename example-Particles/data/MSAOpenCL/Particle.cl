@@ -1,31 +1,19 @@
-#define DAMP			0.95f
-#define CENTER_FORCE	0.007f
-#define MOUSE_FORCE		300.0f
-#define MIN_SPEED		0.1f
+// forces are in pixels per second squared
+#define CENTER_FORCE	25.0f
+#define MOUSE_FORCE		1000000.0f
 
 
-typedef struct{
-	float2 vel;
-	float mass;
-	float dummy;		// need this to make sure the float2 vel is aligned to a 16 byte boundary
-} Particle;
-
-
-
-__kernel void updateParticle(__global Particle* particles, __global float2* posBuffer, const float2 mousePos, const float2 dimensions){
+// force kernel for OpenCLParticleSystem (see MSAOpenCLParticleSystem.h for the arguments before mousePos)
+// pulls particles towards the center of the screen, and pushes them away from the mouse (heavier particles more)
+__kernel void mouseForce(__global const float4 *pos, __global float4 *vel, __global const float *mass, __global const float *lifetime, const int numParticles, const float dt, const float2 mousePos, const float2 dimensions){
 	int id = get_global_id(0);
-	__global Particle *p = &particles[id];
+	if(id >= numParticles || lifetime[id] <= 0) return;
 	
-	float2 diff = mousePos - posBuffer[id];
-	float invDistSQ = 1.0f / dot(diff, diff);
+	float2 p = pos[id].xy;
+	float2 diff = mousePos - p;
+	float invDistSQ = 1.0f / max(dot(diff, diff), 1.0f);
 	diff *= MOUSE_FORCE * invDistSQ;
-
-	p->vel += (dimensions*0.5f - posBuffer[id]) * CENTER_FORCE - diff* p->mass;
 	
-	float speed2 = dot(p->vel, p->vel);
-	if(speed2<MIN_SPEED) posBuffer[id] = mousePos + diff * (1.0f + p->mass);
-
-	posBuffer[id] += p->vel;
-	p->vel *= DAMP;
+	float2 acc = (dimensions*0.5f - p) * CENTER_FORCE - diff * mass[id];
+	vel[id].xy += acc * dt;
 }
-
@@ -1,8 +1,12 @@
 /******
  
  This example updates 1M particles on the GPU using OpenCL
- The OpenCL kernel writes position data directly to a VBO stored in the OpenGL device memory
+ The particles are an OpenCLParticleSystem, with a force kernel (in Particle.cl) pushing them around.
+ Positions and colors are stored directly in VBOs in the OpenGL device memory
  so now data transfer between host and device during runtime
+ Drag the mouse to emit short lived particles
+ Press 'e' to give every particle a random kick (random velocities generated on the device with OpenCLBuffer::fillRandom)
+ Press 'f' to toggle fullscreen
  
  Based on Rui's ofxOpenCL particle example opencl particles 001b.zip 
  at http://code.google.com/p/ruisource/ 
@@ -19,29 +23,22 @@
 #define NUM_PARTICLES (1000*1000)
 
 
-
-typedef struct{
-	float2 vel;
-	float mass;
-	float dummy;		// need this to make sure the float2 vel is aligned to a 16 byte boundary
-} Particle;
-
-
 float2				mousePos;
 float2				dimensions;
+bool				isMouseDown = false;
 
 msa::OpenCL			opencl;
-msa::OpenCLKernel	*kernelUpdate;
-
-
-Particle			particles[NUM_PARTICLES];
-msa::OpenCLBuffer	clMemParticles;		// stores above data
+msa::OpenCLKernel	*kernelForce;
 
+msa::OpenCLParticleSystem	particles;
+msa::OpenCLParticleEmitter	mouseEmitter;
 
-float2				particlesPos[NUM_PARTICLES];
-msa::OpenCLBuffer	clMemPosVBO;		// stores above data
+GLuint				vbo[2];				// positions and colors (float4s)
 
-GLuint				vbo[1];
+#ifndef USE_OPENGL_CONTEXT
+float4				particlesPos[NUM_PARTICLES];
+float4				particlesColor[NUM_PARTICLES];
+#endif
 
 
 //--------------------------------------------------------------
@@ -56,34 +53,50 @@ void testApp::setup(){
 	opencl.setup(CL_DEVICE_TYPE_CPU, 2);
 #endif	
 	
-	for(int i=0; i<NUM_PARTICLES; i++) {
-		Particle &p = particles[i];
-		p.vel.set(0, 0);
-		p.mass = ofRandom(0.5, 1);		
-		particlesPos[i].set(ofRandomWidth(), ofRandomHeight());
+	glGenBuffersARB(2, vbo);
+	for(int i=0; i<2; i++) {
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, vbo[i]);
+		glBufferDataARB(GL_ARRAY_BUFFER_ARB, sizeof(float4) * NUM_PARTICLES, NULL, GL_DYNAMIC_COPY_ARB);
 	}
-	
-	glGenBuffersARB(1, vbo);
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vbo[0]);
-	glBufferDataARB(GL_ARRAY_BUFFER_ARB, sizeof(float2) * NUM_PARTICLES, particlesPos, GL_DYNAMIC_COPY_ARB);
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
 	
 	
 	opencl.loadProgramFromFile("MSAOpenCL/Particle.cl");
-	kernelUpdate = opencl.loadKernel("updateParticle");
+	kernelForce = opencl.loadKernel("mouseForce");
 	
 	
-	clMemParticles.initBuffer(sizeof(Particle) * NUM_PARTICLES, CL_MEM_READ_WRITE, particles);
 #ifdef USE_OPENGL_CONTEXT
-	clMemPosVBO.initFromGLObject(vbo[0]);
+	particles.initParticleSystem(NUM_PARTICLES, vbo[0], vbo[1]);
 #else
-	clMemPosVBO.initBuffer(sizeof(Vec2) * NUM_PARTICLES, CL_MEM_READ_WRITE, particlesPos);
-#endif	
-	
-	kernelUpdate->setArg(0, clMemParticles.getCLMem());
-	kernelUpdate->setArg(1, clMemPosVBO.getCLMem());
-	kernelUpdate->setArg(2, mousePos);
-	kernelUpdate->setArg(3, dimensions);
+	particles.initParticleSystem(NUM_PARTICLES);
+#endif
+	particles.setDamping(0.95f);
+	particles.addForce(kernelForce);
+	
+	
+	// fill most of the screen with particles which never die
+	msa::OpenCLParticleEmitter screenEmitter;
+	screenEmitter.position.s[0]			= ofGetWidth() * 0.5f;
+	screenEmitter.position.s[1]			= ofGetHeight() * 0.5f;
+	screenEmitter.positionSpread.s[0]	= ofGetWidth() * 0.5f;
+	screenEmitter.positionSpread.s[1]	= ofGetHeight() * 0.5f;
+	screenEmitter.massMin				= 0.5f;
+	screenEmitter.massMax				= 1.0f;
+	screenEmitter.lifetimeMin			= screenEmitter.lifetimeMax = FLT_MAX;
+	particles.emit(screenEmitter, NUM_PARTICLES * 3 / 4);
+	
+	
+	// the rest is for short lived particles emitted at the mouse
+	mouseEmitter.velocitySpread.s[0]	= 300;
+	mouseEmitter.velocitySpread.s[1]	= 300;
+	mouseEmitter.color.s[0]				= 1.0f;
+	mouseEmitter.color.s[1]				= 0.5f;
+	mouseEmitter.color.s[2]				= 0.1f;
+	mouseEmitter.massMin				= 0.1f;
+	mouseEmitter.massMax				= 0.5f;
+	mouseEmitter.lifetimeMin			= 1;
+	mouseEmitter.lifetimeMax			= 3;
+	particles.addEmitter(&mouseEmitter);
 	
 	glPointSize(1);
 }
@@ -96,29 +109,48 @@ void testApp::update(){
 	dimensions.x = ofGetWidth();
 	dimensions.y = ofGetHeight();
 	
-	kernelUpdate->setArg(2, mousePos);
-	kernelUpdate->setArg(3, dimensions);
-	kernelUpdate->run1D(NUM_PARTICLES);
+	mouseEmitter.position.s[0]	= mousePos.x;
+	mouseEmitter.position.s[1]	= mousePos.y;
+	mouseEmitter.rate			= isMouseDown ? 100000 : 0;
+	
+	// the particle system sets the first arguments of the force kernel, the rest are ours
+	kernelForce->setArg(6, mousePos);
+	kernelForce->setArg(7, dimensions);
+	particles.update(ofGetLastFrameTime());
 }
 
 //--------------------------------------------------------------
 void testApp::draw(){
-	glColor3f(1.0f, 1.0f, 1.0f);
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vbo[0]);
+	int numActive = particles.getNumActive();
+	
 #ifdef USE_OPENGL_CONTEXT
 	opencl.finish();
 #else	
-	opencl.readBuffer(sizeof(Vec2) * NUM_PARTICLES, clMemPosVBO, particlesPos);
-	glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, 0, sizeof(Vec2) * NUM_PARTICLES, particlesPos);
+	particles.getPosBuffer().read(particlesPos, 0, sizeof(float4) * numActive);
+	particles.getColorBuffer().read(particlesColor, 0, sizeof(float4) * numActive);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vbo[0]);
+	glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, 0, sizeof(float4) * numActive, particlesPos);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vbo[1]);
+	glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, 0, sizeof(float4) * numActive, particlesColor);
 #endif	
+	
+	// dead particles have 0 alpha
+	ofEnableAlphaBlending();
 	glEnableClientState(GL_VERTEX_ARRAY);
-	glVertexPointer(2, GL_FLOAT, 0, 0);
-	glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vbo[0]);
+	glVertexPointer(2, GL_FLOAT, sizeof(float4), 0);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vbo[1]);
+	glColorPointer(4, GL_FLOAT, 0, 0);
+	glDrawArrays(GL_POINTS, 0, numActive);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	ofDisableAlphaBlending();
 	
 	
 	glColor3f(1, 1, 1);
-	string info = "fps: " + ofToString(ofGetFrameRate()) + "\nnumber of particles: " + ofToString(NUM_PARTICLES);
+	string info = "fps: " + ofToString(ofGetFrameRate()) + "\nmax number of particles: " + ofToString(NUM_PARTICLES) + "\nactive particles: " + ofToString(numActive) + "\n'e' random kick, 'f' fullscreen";
 	ofDrawBitmapString(info, 20, 20);
 }
 
@@ -128,7 +160,15 @@ void testApp::exit() {
 
 //--------------------------------------------------------------
 void testApp::keyPressed(int key){
-	ofToggleFullscreen();
+	switch(key) {
+		case 'e':
+			// normally distributed velocities (standard deviation 300 pixels per second) for the active particles
+			particles.getVelBuffer().fillRandom(msa::OPENCL_RANDOM_NORMAL, ofGetFrameNum(), 0, 300, 0, sizeof(float4) * particles.getNumActive());
+			break;
+		case 'f':
+			ofToggleFullscreen();
+			break;
+	}
 }
 
 //--------------------------------------------------------------
@@ -148,12 +188,12 @@ void testApp::mouseDragged(int x, int y, int button){
 
 //--------------------------------------------------------------
 void testApp::mousePressed(int x, int y, int button){
-	
+	isMouseDown = true;
 }
 
 //--------------------------------------------------------------
 void testApp::mouseReleased(int x, int y, int button){
-	
+	isMouseDown = false;
 }
 
 //--------------------------------------------------------------
@@ -0,0 +1,17 @@
+//--------------------------------------------------------------
+// predicate for OpenCLScan::compact: keep positive numbers
+__kernel void isPositive(__global const float *src, __global int *flags) {
+	int i = get_global_id(0);
+	flags[i] = src[i] > 0;
+}
+
+
+//--------------------------------------------------------------
+// Sample is declared in testApp.cpp with MSA_OPENCL_STRUCT, and its definition added to this program's source from there
+// tightly packed: 13 bytes of fields in 16
+__kernel void weighSamples(__global Sample *samples, const float scale) {
+	int i = get_global_id(0);
+	float w = samples[i].weight * scale;
+	samples[i].weight	= w;
+	samples[i].flags	= w > 1;
+}
@@ -0,0 +1,317 @@
+#include "testApp.h"
+
+#include "MSAOpenCL.h"
+#include "MSATimer.h"
+
+#define SIZE	(1024*1024*4)
+#define REPS	20
+
+
+// shared with Primitives.cl
+#define SAMPLE_FIELDS(FIELD)	\
+	FIELD(float2, pos)			\
+	FIELD(float, weight)		\
+	FIELD(uchar, flags)
+
+MSA_OPENCL_STRUCT(Sample, SAMPLE_FIELDS)
+
+
+msa::OpenCL			openCL;
+msa::OpenCLScan		scan;
+msa::OpenCLRadixSort	sorter;
+msa::OpenCLNBody	nbody;
+msa::Timer			timer;
+
+msa::OpenCLBuffer	clBuf[2];
+vector<cl_int>		ints[2];
+vector<cl_uint>		uints[2];
+vector<cl_float>	floats[2];
+
+
+// prints the device time per run, and throughput in millions of elements per second
+void printTime(string name, double seconds, int reps) {
+	printf("%-28s %8.3f ms  %8.1f M elements/s\n", name.c_str(), seconds * 1000 / reps, (double)SIZE * reps / seconds / 1e6);
+}
+
+void printResult(string name, bool ok) {
+	printf("%-28s %s\n", name.c_str(), ok ? "OK" : "FAILED");
+}
+
+
+//--------------------------------------------------------------
+void testScan(bool inclusive) {
+	string name = inclusive ? "inclusive scan" : "exclusive scan";
+
+	for(int i=0; i<SIZE; i++) ints[0][i] = rand() % 100;
+	clBuf[0].write(&ints[0][0], 0, SIZE * sizeof(cl_int), CL_TRUE);
+
+	scan.scan(clBuf[0], clBuf[1], SIZE, msa::OPENCL_SCAN_INT, inclusive);		// build the kernels before timing
+	openCL.finish();
+	
+	timer.start();
+	for(int r=0; r<REPS; r++) scan.scan(clBuf[0], clBuf[1], SIZE, msa::OPENCL_SCAN_INT, inclusive);
+	openCL.finish();
+	timer.stop();
+	printTime(name + " (GPU)", timer.getSeconds(), REPS);
+
+	timer.start();
+	cl_int sum = 0;
+	for(int i=0; i<SIZE; i++) {
+		if(inclusive) sum += ints[0][i];
+		ints[1][i] = sum;
+		if(!inclusive) sum += ints[0][i];
+	}
+	timer.stop();
+	printTime(name + " (CPU)", timer.getSeconds(), 1);
+
+	vector<cl_int> result(SIZE);
+	clBuf[1].read(&result[0], 0, SIZE * sizeof(cl_int));
+	printResult(name, result == ints[1]);
+}
+
+
+//--------------------------------------------------------------
+void testCompact() {
+	for(int i=0; i<SIZE; i++) floats[0][i] = ofRandom(-1, 1);
+	clBuf[0].write(&floats[0][0], 0, SIZE * sizeof(cl_float), CL_TRUE);
+
+	msa::OpenCLKernel *kernel = openCL.kernel("isPositive");
+	int count = scan.compact(clBuf[0], clBuf[1], SIZE, sizeof(cl_float), kernel);
+	
+	timer.start();
+	for(int r=0; r<REPS; r++) count = scan.compact(clBuf[0], clBuf[1], SIZE, sizeof(cl_float), kernel, r == REPS-1);
+	timer.stop();
+	printTime("compact (GPU)", timer.getSeconds(), REPS);
+
+	timer.start();
+	floats[1].clear();
+	for(int i=0; i<SIZE; i++) if(floats[0][i] > 0) floats[1].push_back(floats[0][i]);
+	timer.stop();
+	printTime("compact (CPU)", timer.getSeconds(), 1);
+
+	vector<cl_float> result(max(count, 1));
+	if(count > 0) clBuf[1].read(&result[0], 0, count * sizeof(cl_float));
+	result.resize(count);
+	printResult("compact", count == floats[1].size() && result == floats[1]);
+}
+
+
+//--------------------------------------------------------------
+bool compareKeys(const pair<cl_uint, cl_uint> &a, const pair<cl_uint, cl_uint> &b) {
+	return a.first < b.first;
+}
+
+void testSort() {
+	// few distinct high bits, so there are plenty of equal keys to check the sort is stable
+	vector<pair<cl_uint, cl_uint> > pairs(SIZE);
+	for(int i=0; i<SIZE; i++) {
+		uints[0][i] = ((rand() % 64) << 24) | (rand() & 0xffff);
+		pairs[i] = make_pair(uints[0][i], (cl_uint)i);
+	}
+
+	vector<cl_uint> indices(SIZE);
+	for(int i=0; i<SIZE; i++) indices[i] = i;
+
+	// build the kernels before timing
+	sorter.sort(clBuf[0], &clBuf[1], SIZE);
+	openCL.finish();
+	
+	// each run includes uploading the unsorted keys and values
+	timer.start();
+	for(int r=0; r<REPS; r++) {
+		clBuf[0].write(&uints[0][0], 0, SIZE * sizeof(cl_uint));
+		clBuf[1].write(&indices[0], 0, SIZE * sizeof(cl_uint));
+		sorter.sort(clBuf[0], &clBuf[1], SIZE);
+	}
+	openCL.finish();
+	timer.stop();
+	printTime("key/value sort (GPU)", timer.getSeconds(), REPS);
+
+	timer.start();
+	stable_sort(pairs.begin(), pairs.end(), compareKeys);
+	timer.stop();
+	printTime("key/value sort (CPU)", timer.getSeconds(), 1);
+
+	clBuf[0].read(&uints[1][0], 0, SIZE * sizeof(cl_uint));
+	clBuf[1].read(&indices[0], 0, SIZE * sizeof(cl_uint));
+	bool ok = true;
+	for(int i=0; i<SIZE; i++) ok &= uints[1][i] == pairs[i].first && indices[i] == pairs[i].second;
+	printResult("key/value sort", ok);
+
+
+	// floats, including negative numbers
+	for(int i=0; i<SIZE; i++) floats[0][i] = ofRandom(-1000, 1000);
+	clBuf[0].write(&floats[0][0], 0, SIZE * sizeof(cl_float));
+	sorter.sort(clBuf[0], NULL, SIZE, msa::OPENCL_SORT_FLOAT);
+	clBuf[0].read(&floats[1][0], 0, SIZE * sizeof(cl_float));
+	sort(floats[0].begin(), floats[0].end());
+	printResult("float sort", floats[0] == floats[1]);
+}
+
+
+//--------------------------------------------------------------
+// the host and device agree on Sample's layout, and a kernel can change it in place
+void testStruct() {
+	printResult("struct layout", Sample::verifyLayout());
+
+	const int numSamples = 1024;
+	vector<Sample> samples(numSamples);
+	for(int i=0; i<numSamples; i++) {
+		samples[i].pos.set(i, -i);
+		samples[i].weight	= ofRandom(0, 1);
+		samples[i].flags	= 0;
+	}
+
+	msa::OpenCLBuffer buf;
+	buf.initBuffer(numSamples * sizeof(Sample), CL_MEM_READ_WRITE, &samples[0], CL_TRUE);
+	float scale = 2;
+	msa::OpenCLKernel *kernel = openCL.kernel("weighSamples");
+	kernel->setArg(0, buf, CL_MEM_READ_WRITE);
+	kernel->setArg(1, scale);
+	kernel->run1D(numSamples);
+
+	vector<Sample> result(numSamples);
+	buf.read(&result[0], 0, numSamples * sizeof(Sample));
+	bool ok = true;
+	for(int i=0; i<numSamples; i++) {
+		float w = samples[i].weight * scale;
+		ok &= result[i].pos == samples[i].pos && result[i].weight == w && result[i].flags == (w > 1);
+	}
+	printResult("struct kernel", ok);
+}
+
+
+//--------------------------------------------------------------
+// random numbers generated on the device, checked by their mean and variance
+void testRandom(msa::OpenCLRandomDistribution distribution, string name, double mean, double variance) {
+	clBuf[0].fillRandom(distribution, 1234);		// build the kernel before timing
+	openCL.finish();
+
+	timer.start();
+	for(int r=0; r<REPS; r++) clBuf[0].fillRandom(distribution, r);
+	openCL.finish();
+	timer.stop();
+	printTime(name + " (GPU)", timer.getSeconds(), REPS);
+
+	clBuf[0].read(&floats[0][0], 0, SIZE * sizeof(cl_float));
+	double sum = 0, sum2 = 0;
+	for(int i=0; i<SIZE; i++) {
+		sum += floats[0][i];
+		sum2 += floats[0][i] * floats[0][i];
+	}
+	double m = sum / SIZE;
+	double v = sum2 / SIZE - m * m;
+	printResult(name, fabs(m - mean) < 0.01 && fabs(v - variance) < 0.01);
+}
+
+
+//--------------------------------------------------------------
+// accelerations of bodies in a 1024 x 1024 square, reported as body-body interactions per second
+// (for the grid approximation, the interactions it stands in for)
+void timeNBody(string name, msa::OpenCLBuffer &pos, msa::OpenCLBuffer &mass, int numBodies, int reps) {
+	nbody.computeAccelerations(pos, mass, numBodies);		// build the kernels before timing
+	openCL.finish();
+
+	timer.start();
+	for(int r=0; r<reps; r++) nbody.computeAccelerations(pos, mass, numBodies);
+	openCL.finish();
+	timer.stop();
+	printf("%-28s %8.3f ms  %8.2f G interactions/s\n", name.c_str(), timer.getSeconds() * 1000 / reps, (double)numBodies * numBodies * reps / timer.getSeconds() / 1e9);
+}
+
+void testNBody() {
+	const int numBodies = 65536;
+	const float softening = 2;
+
+	vector<cl_float4> bodies(numBodies);
+	vector<cl_float> masses(numBodies);
+	for(int i=0; i<numBodies; i++) {
+		bodies[i].s[0] = ofRandom(0, 1024);
+		bodies[i].s[1] = ofRandom(0, 1024);
+		bodies[i].s[2] = bodies[i].s[3] = 0;
+		masses[i] = ofRandom(0.5, 2);
+	}
+
+	msa::OpenCLBuffer pos, mass;
+	pos.initBuffer(numBodies * sizeof(cl_float4), CL_MEM_READ_ONLY, &bodies[0]);
+	mass.initBuffer(numBodies * sizeof(cl_float), CL_MEM_READ_ONLY, &masses[0]);
+
+	nbody.setSoftening(softening);
+	timeNBody("n-body tiled (GPU)", pos, mass, numBodies, 5);
+
+	// check the first few bodies against the CPU
+	const int numChecked = 64;
+	vector<cl_float4> exact(numBodies);
+	nbody.getAccelBuffer().read(&exact[0], 0, numBodies * sizeof(cl_float4));
+	bool ok = true;
+	timer.start();
+	for(int i=0; i<numChecked; i++) {
+		double a[2] = { 0, 0 };
+		for(int j=0; j<numBodies; j++) {
+			double dx = bodies[j].s[0] - bodies[i].s[0];
+			double dy = bodies[j].s[1] - bodies[i].s[1];
+			double inv = 1 / sqrt(dx * dx + dy * dy + softening * softening);
+			a[0] += dx * masses[j] * inv * inv * inv;
+			a[1] += dy * masses[j] * inv * inv * inv;
+		}
+		double len = sqrt(a[0] * a[0] + a[1] * a[1]);
+		ok &= fabs(exact[i].s[0] - a[0]) < 1e-3 * len + 1e-6 && fabs(exact[i].s[1] - a[1]) < 1e-3 * len + 1e-6;
+	}
+	timer.stop();
+	printf("%-28s %8.3f ms  %8.2f G interactions/s\n", "n-body (CPU)", timer.getSeconds() * 1000 * numBodies / numChecked, (double)numBodies * numChecked / timer.getSeconds() / 1e9);
+	printResult("n-body tiled", ok);
+
+	// 64 x 64 cells of 16 x 16
+	nbody.setGridApproximation(16, 64, 64);
+	timeNBody("n-body grid (GPU)", pos, mass, numBodies, 5);
+
+	vector<cl_float4> approx(numBodies);
+	nbody.getAccelBuffer().read(&approx[0], 0, numBodies * sizeof(cl_float4));
+	double maxError = 0;
+	for(int i=0; i<numChecked; i++) {
+		double dx = approx[i].s[0] - exact[i].s[0];
+		double dy = approx[i].s[1] - exact[i].s[1];
+		double len = sqrt(exact[i].s[0] * exact[i].s[0] + exact[i].s[1] * exact[i].s[1]);
+		maxError = max(maxError, sqrt(dx * dx + dy * dy) / max(len, 1e-6));
+	}
+	printf("%-28s %8.2f %% max error\n", "n-body grid", maxError * 100);
+	nbody.disableGridApproximation();
+}
+
+
+//--------------------------------------------------------------
+void testApp::setup(){
+
+	// dump everything to console
+	ofSetLogLevel(OF_LOG_VERBOSE);
+
+	srand(0);
+	for(int i=0; i<2; i++) {
+		ints[i].resize(SIZE);
+		uints[i].resize(SIZE);
+		floats[i].resize(SIZE);
+	}
+
+	// setup openCL and load the predicate kernel for compact, and the kernel using Sample
+	openCL.setup(CL_DEVICE_TYPE_GPU);
+	openCL.addProgramHeader(Sample::getCLSource());
+	openCL.loadProgramFromFile("MSAOpenCL/Primitives.cl");
+	openCL.loadKernel("isPositive");
+	openCL.loadKernel("weighSamples");
+
+	clBuf[0].initBuffer(SIZE * 4);
+	clBuf[1].initBuffer(SIZE * 4);
+
+
+	printf("\n%d elements, GPU times averaged over %d runs\n\n", SIZE, REPS);
+	testScan(false);
+	testScan(true);
+	testCompact();
+	testSort();
+	testRandom(msa::OPENCL_RANDOM_UNIFORM, "random uniform", 0.5, 1.0 / 12);
+	testRandom(msa::OPENCL_RANDOM_NORMAL, "random normal", 0, 1);
+	testNBody();
+	testStruct();
+
+	std::exit(0);
+}
@@ -0,0 +1,13 @@
+#ifndef _TEST_APP
+#define _TEST_APP
+
+
+#include "ofMain.h"
+
+class testApp : public ofBaseApp {
+	
+public:
+	void setup();
+};
+
+#endif
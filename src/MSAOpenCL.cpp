@@ -14,6 +14,11 @@ namespace msa {
 		clContext	= NULL;
 		clDevice	= NULL;
 		clQueue		= NULL;
+		memoryBudget	= 0;
+		residentBytes	= 0;
+		useTick			= 0;
+		highWaterBytes	= 0;
+		recordCallSites	= true;
 	}
 	
 	OpenCL::~OpenCL() {
@@ -22,8 +27,14 @@ namespace msa {
 		clFinish(clQueue);
 		
 		for(int i=0; i<memObjects.size(); i++) delete memObjects[i];	// FIX
+		
+		// memory objects not created by us may outlive us, make sure they don't call back
+		for(set<OpenCLMemoryObject*>::iterator it = allMemObjects.begin(); it != allMemObjects.end(); ++it) (*it)->pOpenCL = NULL;
 		for(map<string, OpenCLKernel*>::iterator it = kernels.begin(); it !=kernels.end(); ++it) delete (OpenCLKernel*)it->second;
+		for(int i=0; i<replacedKernels.size(); i++) delete replacedKernels[i];
+		for(map<string, OpenCLKernel*>::iterator it = builtinKernels.begin(); it !=builtinKernels.end(); ++it) delete (OpenCLKernel*)it->second;
 		for(int i=0; i<programs.size(); i++) delete programs[i];
+		for(map<string, OpenCLProgram*>::iterator it = builtinPrograms.begin(); it !=builtinPrograms.end(); ++it) delete (OpenCLProgram*)it->second;
 		clReleaseCommandQueue(clQueue);
 		clReleaseContext(clContext);
 	}
@@ -114,7 +125,7 @@ namespace msa {
 	OpenCLProgram* OpenCL::loadProgramFromFile(string filename, bool isBinary) { 
 		ofLog(OF_LOG_VERBOSE, "OpenCL::loadProgramFromFile");
 		OpenCLProgram *p = new OpenCLProgram();
-		p->loadFromFile(filename, isBinary);
+		p->loadFromFile(filename, isBinary, programHeader);
 		programs.push_back(p);
 		return p;
 	}
@@ -123,22 +134,55 @@ namespace msa {
 	OpenCLProgram* OpenCL::loadProgramFromSource(string source) {
 		ofLog(OF_LOG_VERBOSE, "OpenCL::loadProgramFromSource");
 		OpenCLProgram *p = new OpenCLProgram();
-		p->loadFromSource(source);
+		p->loadFromSource(programHeader + source);
 		programs.push_back(p);
 		return p;
 	} 
 	
 	
+	void OpenCL::addProgramHeader(string source) {
+		programHeader += source + "\n";
+	}
+	
+	
 	OpenCLKernel* OpenCL::loadKernel(string kernelName, OpenCLProgram *program) {
 		ofLog(OF_LOG_VERBOSE, "OpenCL::loadKernel " + kernelName + ", " + ofToString((int)program));
 		if(program == NULL) program = programs[programs.size() - 1];
 		OpenCLKernel *k = program->loadKernel(kernelName);
-		kernels[kernelName] = k;
+		
+		// replacing a kernel with the same name (e.g. after reloading a program)
+		// the old one may still be cached by the caller, so it's kept until we're destroyed
+		OpenCLKernel *&slot = kernels[kernelName];
+		if(slot) {
+			ofLog(OF_LOG_VERBOSE, "... replacing existing kernel " + kernelName);
+			replacedKernels.push_back(slot);
+		}
+		slot = k;
+		return k;
+	}
+	
+	
+	OpenCLKernel* OpenCL::loadBuiltinKernel(string kernelName, string programName, const string &programSource) {
+		string key = programName + "::" + kernelName;
+		map<string, OpenCLKernel*>::iterator kit = builtinKernels.find(key);
+		if(kit != builtinKernels.end()) return kit->second;
+		
+		ofLog(OF_LOG_VERBOSE, "OpenCL::loadBuiltinKernel " + key);
+		
+		OpenCLProgram *program = builtinPrograms[programName];
+		if(program == NULL) {
+			program = new OpenCLProgram();
+			program->loadFromSource(programSource);
+			builtinPrograms[programName] = program;
+		}
+		
+		OpenCLKernel *k = program->loadKernel(kernelName);
+		builtinKernels[key] = k;
 		return k;
 	}
 	
 	
-	OpenCLBuffer* OpenCL::createBuffer(int numberOfBytes, cl_mem_flags memFlags, void *dataPtr, bool blockingWrite) {
+	OpenCLBuffer* OpenCL::createBuffer(size_t numberOfBytes, cl_mem_flags memFlags, void *dataPtr, bool blockingWrite) {
 		OpenCLBuffer *clBuffer = new OpenCLBuffer();
 		clBuffer->initBuffer(numberOfBytes, memFlags, dataPtr, blockingWrite);
 		memObjects.push_back(clBuffer);
@@ -146,6 +190,25 @@ namespace msa {
 	}
 	
 	
+	OpenCLBuffer* OpenCL::createBufferFromFile(string filename, size_t offset, long long length, cl_mem_flags memFlags) {
+		OpenCLBuffer *clBuffer = new OpenCLBuffer();
+		if(!clBuffer->initFromFile(filename, offset, length, memFlags)) {
+			delete clBuffer;
+			return NULL;
+		}
+		memObjects.push_back(clBuffer);
+		return clBuffer;
+	}
+	
+	
+	OpenCLBuffer* OpenCL::createHalfBuffer(int numberOfElements, cl_mem_flags memFlags, const float *dataPtr, bool blockingWrite) {
+		OpenCLBuffer *clBuffer = new OpenCLBuffer();
+		clBuffer->initHalfBuffer(numberOfElements, memFlags, dataPtr, blockingWrite);
+		memObjects.push_back(clBuffer);
+		return clBuffer;
+	}
+	
+	
 	OpenCLBuffer* OpenCL::createBufferFromGLObject(GLuint glBufferObject, cl_mem_flags memFlags) {
 		OpenCLBuffer *clBuffer = new OpenCLBuffer();
 		clBuffer->initFromGLObject(glBufferObject, memFlags);
@@ -154,8 +217,8 @@ namespace msa {
 	}
 	
 	
-	OpenCLImage* OpenCL::createImage2D(int width, int height, cl_channel_order imageChannelOrder, cl_channel_type imageChannelDataType, cl_mem_flags memFlags, void *dataPtr, bool blockingWrite) {
-		return createImage3D(width, height, 1, imageChannelOrder, imageChannelDataType, memFlags, dataPtr, blockingWrite);
+	OpenCLImage* OpenCL::createImage2D(int width, int height, cl_channel_order imageChannelOrder, cl_channel_type imageChannelDataType, cl_mem_flags memFlags, void *dataPtr, bool blockingWrite, size_t rowPitch) {
+		return createImage3D(width, height, 1, imageChannelOrder, imageChannelDataType, memFlags, dataPtr, blockingWrite, rowPitch, 0);
 	}
 	
 	
@@ -174,15 +237,148 @@ namespace msa {
 	}
 	
 	
-	OpenCLImage* OpenCL::createImage3D(int width, int height, int depth, cl_channel_order imageChannelOrder, cl_channel_type imageChannelDataType, cl_mem_flags memFlags, void *dataPtr, bool blockingWrite) {
+	OpenCLImage* OpenCL::createImage3D(int width, int height, int depth, cl_channel_order imageChannelOrder, cl_channel_type imageChannelDataType, cl_mem_flags memFlags, void *dataPtr, bool blockingWrite, size_t rowPitch, size_t slicePitch) {
 		OpenCLImage *clImage = new OpenCLImage();
-		clImage->initWithoutTexture(width, height, depth, imageChannelOrder, imageChannelDataType, memFlags, dataPtr, blockingWrite);
+		clImage->initWithoutTexture(width, height, depth, imageChannelOrder, imageChannelDataType, memFlags, dataPtr, blockingWrite, rowPitch, slicePitch);
 		memObjects.push_back(clImage);
 		return clImage;
 	}
 	
 	
 	
+	void OpenCL::setMemoryBudget(cl_ulong numBytes) {
+		ofLog(OF_LOG_VERBOSE, "OpenCL::setMemoryBudget " + ofToString(numBytes/1024.0f/1024.0f, 3) + " MB");
+		memoryBudget = numBytes;
+		enforceMemoryBudget();
+	}
+	
+	
+	cl_ulong OpenCL::getMemoryBudget() {
+		return memoryBudget;
+	}
+	
+	
+	cl_ulong OpenCL::getResidentBytes() {
+		return residentBytes;
+	}
+	
+	
+	void OpenCL::enforceMemoryBudget(cl_ulong extraBytes) {
+		if(memoryBudget == 0) return;
+		
+		while(residentBytes + extraBytes > memoryBudget) {
+			// find least recently used object which can be evicted
+			OpenCLMemoryObject *lru = NULL;
+			for(set<OpenCLMemoryObject*>::iterator it = allMemObjects.begin(); it != allMemObjects.end(); ++it) {
+				OpenCLMemoryObject *m = *it;
+				if(!m->isEvictable()) continue;
+				if(lru == NULL || m->lastUsed < lru->lastUsed) lru = m;
+			}
+			
+			if(lru == NULL) {
+				ofLog(OF_LOG_WARNING, "OpenCL::enforceMemoryBudget - nothing left to evict, " + ofToString((residentBytes + extraBytes)/1024.0f/1024.0f, 3) + " MB needed, budget is " + ofToString(memoryBudget/1024.0f/1024.0f, 3) + " MB");
+				return;
+			}
+			
+			lru->evict();
+			lru->isEvicted = true;
+			lru->updateResidentSize();
+		}
+	}
+	
+	
+	cl_ulong OpenCL::getAllocatedBytes() {
+		return getResidentBytes();
+	}
+	
+	
+	cl_ulong OpenCL::getAllocatedBytes(OpenCLMemoryTag memoryTag) {
+		cl_ulong numBytes = 0;
+		for(set<OpenCLMemoryObject*>::iterator it = allMemObjects.begin(); it != allMemObjects.end(); ++it) {
+			OpenCLMemoryObject *m = *it;
+			if(m->clMemObject && !m->isEvicted && m->memoryTag == memoryTag) numBytes += m->getSizeInBytes();
+		}
+		return numBytes;
+	}
+	
+	
+	cl_ulong OpenCL::getHighWaterBytes() {
+		return highWaterBytes;
+	}
+	
+	
+	void OpenCL::resetHighWaterMark() {
+		highWaterBytes = getResidentBytes();
+	}
+	
+	
+	void OpenCL::setRecordCallSites(bool b) {
+		recordCallSites = b;
+	}
+	
+	
+	bool OpenCL::getRecordCallSites() {
+		return recordCallSites;
+	}
+	
+	
+	void OpenCL::trackAllocation(size_t numBytes) {
+		if(info.maxMemAllocSize > 0) {
+			if(numBytes > info.maxMemAllocSize) {
+				ofLog(OF_LOG_ERROR, "OpenCL::trackAllocation - " + ofToString(numBytes/1024.0f/1024.0f, 3) + " MB is more than maxMemAllocSize (" + ofToString(info.maxMemAllocSize/1024.0f/1024.0f, 3) + " MB)");
+			} else if(numBytes > info.maxMemAllocSize * 0.9) {
+				ofLog(OF_LOG_WARNING, "OpenCL::trackAllocation - " + ofToString(numBytes/1024.0f/1024.0f, 3) + " MB is close to maxMemAllocSize (" + ofToString(info.maxMemAllocSize/1024.0f/1024.0f, 3) + " MB)");
+			}
+		}
+		
+		highWaterBytes = max(highWaterBytes, getResidentBytes() + numBytes);
+	}
+	
+	
+	string OpenCL::getMemoryReport(bool includeCallSites) {
+		static const char *tagNames[] = { "buffer", "image", "GL shared" };
+		
+		cl_ulong evictedBytes = 0;
+		for(set<OpenCLMemoryObject*>::iterator it = allMemObjects.begin(); it != allMemObjects.end(); ++it) {
+			if((*it)->isEvicted) evictedBytes += (*it)->getSizeInBytes();
+		}
+		
+		string s = "\n\n*********\nOpenCL Memory report:" 
+		"\n allocated..................." + ofToString(getAllocatedBytes()/1024.0f/1024.0f, 3) + " MB" +
+		"\n  buffers...................." + ofToString(getAllocatedBytes(OPENCL_MEMORY_BUFFER)/1024.0f/1024.0f, 3) + " MB" +
+		"\n  images....................." + ofToString(getAllocatedBytes(OPENCL_MEMORY_IMAGE)/1024.0f/1024.0f, 3) + " MB" +
+		"\n  GL shared.................." + ofToString(getAllocatedBytes(OPENCL_MEMORY_GL_SHARED)/1024.0f/1024.0f, 3) + " MB" +
+		"\n evicted to host............." + ofToString(evictedBytes/1024.0f/1024.0f, 3) + " MB" +
+		"\n high water mark............." + ofToString(highWaterBytes/1024.0f/1024.0f, 3) + " MB" +
+		"\n budget......................" + (memoryBudget ? ofToString(memoryBudget/1024.0f/1024.0f, 3) + " MB" : string("none")) +
+		"\n globalMemSize..............." + ofToString(info.globalMemSize/1024.0f/1024.0f, 3) + " MB" +
+		"\n live objects................" + ofToString(allMemObjects.size());
+		
+		for(set<OpenCLMemoryObject*>::iterator it = allMemObjects.begin(); it != allMemObjects.end(); ++it) {
+			OpenCLMemoryObject *m = *it;
+			s += "\n  " + string(tagNames[m->memoryTag]) + " " + ofToString(m->getSizeInBytes()/1024.0f, 3) + " KB";
+			if(!m->label.empty()) s += " '" + m->label + "'";
+			if(m->isEvicted) s += " (evicted)";
+			if(includeCallSites) {
+				string callSite = m->getCallSite();
+				if(!callSite.empty()) s += "\n" + callSite;
+			}
+		}
+		
+		return s + "\n*********\n\n";
+	}
+	
+	
+	void OpenCL::registerMemoryObject(OpenCLMemoryObject *memObject) {
+		allMemObjects.insert(memObject);
+	}
+	
+	
+	void OpenCL::unregisterMemoryObject(OpenCLMemoryObject *memObject) {
+		allMemObjects.erase(memObject);
+	}
+	
+	
 	OpenCLKernel* OpenCL::kernel(string kernelName) {
 		return kernels[kernelName];
 	}
@@ -318,6 +514,26 @@ namespace msa {
 	}
 	
 	
+	bool OpenCL::isDeviceVersionAtLeast(int major, int minor) {
+		// deviceVersion is "OpenCL <major>.<minor> <vendor specific>"
+		int deviceMajor = 0, deviceMinor = 0;
+		if(sscanf((char*)info.deviceVersion, "OpenCL %d.%d", &deviceMajor, &deviceMinor) != 2) return false;
+		return deviceMajor > major || (deviceMajor == major && deviceMinor >= minor);
+	}
+	
+	
+	bool OpenCL::hasExtension(string extension) {
+		// info.extensions may be truncated, so ask the device
+		size_t size = 0;
+		if(clGetDeviceInfo(clDevice, CL_DEVICE_EXTENSIONS, 0, NULL, &size) != CL_SUCCESS || size == 0) return false;
+		vector<char> extensions(size + 1, 0);
+		clGetDeviceInfo(clDevice, CL_DEVICE_EXTENSIONS, size, &extensions[0], NULL);
+		
+		string padded = " " + string(&extensions[0]) + " ";
+		return padded.find(" " + extension + " ") != string::npos;
+	}
+	
+	
 	void OpenCL::createQueue() {
 		clQueue = clCreateCommandQueue(clContext, clDevice, 0, NULL);
 		if(clQueue == NULL) {
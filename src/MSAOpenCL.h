@@ -8,6 +8,17 @@
 #include "MSAOpenCLTypes.h"
 #include "MSAOpenCLImage.h"
 #include "MSAOpenCLImagePingPong.h"
+#include "MSAOpenCLWriteBatch.h"
+#include "MSAOpenCLTiledImage.h"
+#include "MSAOpenCLReduction.h"
+#include "MSAOpenCLScan.h"
+#include "MSAOpenCLRadixSort.h"
+#include "MSAOpenCLHistogram.h"
+#include "MSAOpenCLParticleSystem.h"
+#include "MSAOpenCLSpatialGrid.h"
+#include "MSAOpenCLNBody.h"
+#include "MSAOpenCLRandom.h"
+#include "MSAOpenCLStruct.h"
 
 namespace msa {
 	
@@ -40,10 +51,18 @@ namespace msa {
 		OpenCLProgram*	loadProgramFromFile(string filename, bool isBinary = false);
 		OpenCLProgram*	loadProgramFromSource(string programSource);
 		
+		// source prepended to every program loaded after this with loadProgramFromFile / loadProgramFromSource
+		// (e.g. struct definitions shared with the host, see MSAOpenCLStruct.h). Doesn't affect built in kernels
+		void			addProgramHeader(string source);
+		const string&	getProgramHeader() {
+			return programHeader;
+		}
+		
 		
 		// specify a kernel to load from the specified program
 		// if you leave the program parameter blank it will use the last loaded program
 		// returns pointer to the kernel should you need it (for most operations you won't need this)
+		// loading a kernel with the same name again replaces it in kernel(name), but pointers to the old one stay valid
 		OpenCLKernel*	loadKernel(string kernelName, OpenCLProgram *program = NULL);
 		
 		
@@ -51,11 +70,27 @@ namespace msa {
 		// create OpenCL buffer memory objects
 		// if dataPtr parameter is passed in, data is uploaded immediately
 		// parameters with default values can be omited
-		OpenCLBuffer*	createBuffer(int numberOfBytes,
+		OpenCLBuffer*	createBuffer(size_t numberOfBytes,
 									 cl_mem_flags memFlags = CL_MEM_READ_WRITE,
 									 void *dataPtr = NULL,
 									 bool blockingWrite = CL_FALSE);
 		
+		// create a buffer with the contents of a (memory mapped) file
+		// see OpenCLBuffer::initFromFile
+		// returns NULL if the file can't be opened or mapped
+		OpenCLBuffer*	createBufferFromFile(string filename,
+											 size_t offset = 0,
+											 long long length = -1,
+											 cl_mem_flags memFlags = CL_MEM_READ_ONLY);
+		
+		// create a buffer of numberOfElements half precision floats
+		// if dataPtr parameter is passed in, it's converted and uploaded immediately
+		// see OpenCLBuffer::initHalfBuffer
+		OpenCLBuffer*	createHalfBuffer(int numberOfElements,
+										 cl_mem_flags memFlags = CL_MEM_READ_WRITE,
+										 const float *dataPtr = NULL,
+										 bool blockingWrite = CL_FALSE);
+		
 		// create buffer from the GL Object - e.g. VBO (they share memory space on device)
 		// parameters with default values can be omited
 		OpenCLBuffer*	createBufferFromGLObject(GLuint glBufferObject,
@@ -68,6 +103,8 @@ namespace msa {
 		
 		// create a 2D Image with given properties
 		// Image is not linked to an OpenGL texture
+		// use CL_HALF_FLOAT for half precision storage (see OpenCLImage::writeFloats / readFloats)
+		// rowPitch is the layout of dataPtr (see OpenCLImage::initWithoutTexture)
 		// parameters with default values can be omited
 		OpenCLImage*		createImage2D(int width,
 										  int height,
@@ -75,7 +112,8 @@ namespace msa {
 										  cl_channel_type imageChannelDataType = CL_FLOAT,
 										  cl_mem_flags memFlags = CL_MEM_READ_WRITE,
 										  void *dataPtr = NULL,
-										  bool blockingWrite = CL_FALSE);
+										  bool blockingWrite = CL_FALSE,
+										  size_t rowPitch = 0);
 		
 		// create a 2D Image from the ofTexture passed in (they share memory space on device)
 		// parameters with default values can be omited
@@ -101,13 +139,61 @@ namespace msa {
 										  cl_channel_type imageChannelDataType = CL_FLOAT,
 										  cl_mem_flags memFlags = CL_MEM_READ_WRITE,
 										  void *dataPtr = NULL,
-										  bool blockingWrite = CL_FALSE);
+										  bool blockingWrite = CL_FALSE,
+										  size_t rowPitch = 0,
+										  size_t slicePitch = 0);
 		
 		
 		// retrieve kernel so you can run it or setup params etc.
 		OpenCLKernel*	kernel(string kernelName);
 		
 		
+		// load a kernel from one of the programs built into the library (e.g. OpenCLWriteBatch's scatter kernel)
+		// programName identifies programSource, which is only compiled the first time it's used
+		// the kernel is owned by OpenCL and shared, so set all of its arguments before each run
+		// built in kernels are not added to the kernels map (so they never clash with yours)
+		OpenCLKernel*	loadBuiltinKernel(string kernelName, string programName, const string &programSource);
+		
+		
+		// device memory budget (in bytes, 0 for no budget, which is the default)
+		// when buffers and images would use more than this, the least recently used ones are evicted to host memory
+		// they're restored automatically the next time they're used (by a kernel, read, write, copy etc.)
+		// objects shared with OpenGL or using CL_MEM_USE_HOST_PTR are never evicted, and neither are objects whose
+		// cl_mem has been taken with getCLMem() (e.g. setArg(0, obj.getCLMem())), so bind with setArg(0, obj, access) instead
+		// (see OpenCLMemoryObject)
+		// e.g. openCL.setMemoryBudget(openCL.info.globalMemSize * 0.8);
+		void			setMemoryBudget(cl_ulong numBytes);
+		cl_ulong		getMemoryBudget();
+		
+		// number of bytes used by buffers and images which are currently on the device
+		cl_ulong		getResidentBytes();
+		
+		// evict least recently used objects until extraBytes more would fit in the budget
+		// (this is done automatically, you shouldn't need to call it)
+		void			enforceMemoryBudget(cl_ulong extraBytes = 0);
+		
+		
+		// memory accounting
+		// bytes currently allocated on the device by buffers and images (not counting evicted ones)
+		// GL shared objects are counted (under OPENCL_MEMORY_GL_SHARED) even though OpenGL allocated them
+		cl_ulong		getAllocatedBytes();
+		cl_ulong		getAllocatedBytes(OpenCLMemoryTag memoryTag);
+		
+		// most bytes ever allocated at once (since the last resetHighWaterMark)
+		cl_ulong		getHighWaterBytes();
+		void			resetHighWaterMark();
+		
+		// totals, high water mark, and a list of all live buffers and images
+		// with their size, label (see OpenCLMemoryObject::setLabel) and, if recorded, where they were created
+		// e.g. ofLog(OF_LOG_NOTICE, openCL.getMemoryReport());
+		string			getMemoryReport(bool includeCallSites = true);
+		
+		// record a stack trace whenever a memory object is initialized, for getMemoryReport (default true)
+		// only supported on OSX and Linux
+		void			setRecordCallSites(bool b);
+		bool			getRecordCallSites();
+		
+		
 		vector<OpenCLProgram*>	getPrograms() {
 			return programs;
 		}
@@ -118,6 +204,12 @@ namespace msa {
 		
 		string getInfoAsString();
 		
+		// e.g. isDeviceVersionAtLeast(1, 2) for features which need an OpenCL 1.2 device
+		bool isDeviceVersionAtLeast(int major, int minor);
+		
+		// e.g. hasExtension("cl_khr_fp64")
+		bool hasExtension(string extension);
+		
 		struct {
 			cl_char		vendorName[1024];
 			cl_char		deviceName[1024];
@@ -160,11 +252,36 @@ namespace msa {
 		
 		vector<OpenCLProgram*>		programs;	
 		map<string, OpenCLKernel*>	kernels;
+		vector<OpenCLKernel*>		replacedKernels;	// kernels replaced in the map by loadKernel, which callers may still be using
+		map<string, OpenCLProgram*>	builtinPrograms;
+		map<string, OpenCLKernel*>	builtinKernels;
+		string						programHeader;
 		vector<OpenCLMemoryObject*>	memObjects;
 		bool							isSetup;
 		
+		friend class OpenCLMemoryObject;
+		set<OpenCLMemoryObject*>	allMemObjects;		// every initialized memory object (not only those created here)
+		cl_ulong					memoryBudget;
+		cl_ulong					residentBytes;		// running total of OpenCLMemoryObject::residentSize
+		unsigned long				useTick;
+		cl_ulong					highWaterBytes;
+		bool						recordCallSites;
+		
+		// called when numBytes are about to be allocated, updates the high water mark and warns if numBytes is close to the device limit
+		void trackAllocation(size_t numBytes);
+		
+		void registerMemoryObject(OpenCLMemoryObject *memObject);
+		void unregisterMemoryObject(OpenCLMemoryObject *memObject);
+		unsigned long nextUseTick() {
+			return ++useTick;
+		}
+		
 		int createDevice(int clDeviceType, int numDevices);
 		void createQueue();
 	};
 	
-}
\ No newline at end of file
+}
+
+// needs the full OpenCL class
+#include "MSAOpenCLMirroredBuffer.h"
+#include "MSAOpenCLPingPong.h"
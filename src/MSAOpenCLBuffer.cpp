@@ -1,13 +1,27 @@
 #include "MSAOpenCL.h"
 #include "MSAOpenCLBuffer.h"
+#include "MSAOpenCLImage.h"
+#include "MSAOpenCLMappedFile.h"
 
 namespace msa {
 	
 	OpenCLBuffer::OpenCLBuffer() {
 		ofLog(OF_LOG_VERBOSE, "OpenCLBuffer::OpenCLBuffer");
+		numberOfBytes	= 0;
+		capacity		= 0;
+		memFlags		= CL_MEM_READ_WRITE;
+		isResizable		= true;
+		halfStagingEvent	= NULL;
+		mappedFile		= NULL;
 	}
 	
-	void OpenCLBuffer::initBuffer(int numberOfBytes,
+	OpenCLBuffer::~OpenCLBuffer() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLBuffer::~OpenCLBuffer");
+		waitForHalfStaging();		// halfStaging is about to be freed
+		releaseMappedFile();
+	}
+	
+	void OpenCLBuffer::initBuffer(size_t numberOfBytes,
 								  cl_mem_flags memFlags,
 								  void *dataPtr,
 								  bool blockingWrite)
@@ -17,12 +31,70 @@ namespace msa {
 		
 		init();
 		
+		releaseMappedFile();
+		if(clMemObject) clReleaseMemObject(clMemObject);
+		clMemObject = NULL;
+		memoryTag = OPENCL_MEMORY_BUFFER;
+		
+		willAllocate(numberOfBytes);
+		
 		cl_int err;
-		clMemObject = clCreateBuffer(pOpenCL->getContext(), memFlags, numberOfBytes, memFlags & CL_MEM_USE_HOST_PTR ? dataPtr : NULL, &err);
+		bool usesHostPtr = memFlags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR);
+		clMemObject = clCreateBuffer(pOpenCL->getContext(), memFlags, numberOfBytes, usesHostPtr ? dataPtr : NULL, &err);
 		assert(err == CL_SUCCESS);
 		assert(clMemObject);
 		
-		if(dataPtr) write(dataPtr, 0, numberOfBytes, blockingWrite);
+		this->numberOfBytes	= numberOfBytes;
+		this->capacity		= numberOfBytes;
+		this->memFlags		= memFlags;
+		this->isResizable	= !(memFlags & CL_MEM_USE_HOST_PTR);
+		
+		if(dataPtr && !usesHostPtr) write(dataPtr, 0, numberOfBytes, blockingWrite);
+	}
+	
+	
+	bool OpenCLBuffer::initFromFile(string filename, size_t offset, long long length, cl_mem_flags memFlags) {
+		ofLog(OF_LOG_VERBOSE, "OpenCLBuffer::initFromFile " + filename);
+		
+		OpenCLMappedFile *file = new OpenCLMappedFile();
+		if(!file->map(ofToDataPath(filename), offset, length)) {
+			delete file;
+			return false;
+		}
+		
+		if(memFlags & CL_MEM_USE_HOST_PTR) {
+			initBuffer(file->getSize(), memFlags, file->getData());
+			mappedFile = file;		// keep it mapped until the buffer is released
+			
+		} else {
+			initBuffer(file->getSize(), memFlags);
+			
+			// stream in chunks, so the file is paged in while earlier chunks are being transferred
+			const size_t chunkSize = 64 * 1024 * 1024;
+			for(size_t chunkOffset = 0; chunkOffset < file->getSize(); chunkOffset += chunkSize) {
+				size_t numBytes = min(chunkSize, file->getSize() - chunkOffset);
+				bool isLast = chunkOffset + numBytes == file->getSize();
+				write((char*)file->getData() + chunkOffset, chunkOffset, numBytes, isLast);	// the queue is in order, so blocking on the last one waits for all
+			}
+			delete file;
+		}
+		
+		return true;
+	}
+	
+	
+	void OpenCLBuffer::releaseMappedFile() {
+		if(mappedFile == NULL) return;
+		
+		// the buffer is using the mapping, so release it first
+		// (if the OpenCL object has gone, so has its queue, and nothing can still be using the mapping)
+		if(clMemObject) {
+			if(pOpenCL) clFinish(pOpenCL->getQueue());
+			clReleaseMemObject(clMemObject);
+			clMemObject = NULL;
+		}
+		delete mappedFile;
+		mappedFile = NULL;
 	}
 	
 	
@@ -33,6 +105,9 @@ namespace msa {
 		
 		init();
 		
+		releaseMappedFile();
+		if(clMemObject) clReleaseMemObject(clMemObject);
+		
 		cl_int err;
 		clMemObject= clCreateFromGLBuffer(pOpenCL->getContext(), memFlags, glBufferObject, &err);
 		assert(err != CL_INVALID_CONTEXT);
@@ -41,22 +116,212 @@ namespace msa {
 		assert(err != CL_OUT_OF_HOST_MEMORY);
 		assert(err == CL_SUCCESS);
 		assert(clMemObject);	
+		
+		size_t size = 0;
+		clGetMemObjectInfo(clMemObject, CL_MEM_SIZE, sizeof(size), &size, NULL);
+		this->numberOfBytes	= size;
+		this->capacity		= size;
+		this->memFlags		= memFlags;
+		this->isResizable	= false;
+		
+		memoryTag = OPENCL_MEMORY_GL_SHARED;
+		didAllocate();
 	}
 	
 	
-	void OpenCLBuffer::read(void *dataPtr, int startOffsetBytes, int numberOfBytes, bool blockingRead) {
-		cl_int err = clEnqueueReadBuffer(pOpenCL->getQueue(), clMemObject, blockingRead, startOffsetBytes, numberOfBytes, dataPtr, 0, NULL, NULL);
+	void OpenCLBuffer::read(void *dataPtr, size_t startOffsetBytes, size_t numberOfBytes, bool blockingRead) {
+		cl_int err = clEnqueueReadBuffer(pOpenCL->getQueue(), getResidentCLMem(), blockingRead, startOffsetBytes, numberOfBytes, dataPtr, 0, NULL, NULL);
 		assert(err == CL_SUCCESS);
 	}
 	
 	
-	void OpenCLBuffer::write(void *dataPtr, int startOffsetBytes, int numberOfBytes, bool blockingWrite) {
-		cl_int err = clEnqueueWriteBuffer(pOpenCL->getQueue(), clMemObject, blockingWrite, startOffsetBytes, numberOfBytes, dataPtr, 0, NULL, NULL);
+	void OpenCLBuffer::write(void *dataPtr, size_t startOffsetBytes, size_t numberOfBytes, bool blockingWrite) {
+		cl_int err = clEnqueueWriteBuffer(pOpenCL->getQueue(), getResidentCLMem(), blockingWrite, startOffsetBytes, numberOfBytes, dataPtr, 0, NULL, NULL);
 		assert(err == CL_SUCCESS);
 	}
 	
-	void OpenCLBuffer::copyFrom(OpenCLBuffer &srcBuffer, int srcOffsetBytes, int dstOffsetBytes, int numberOfBytes) {
-		cl_int err = clEnqueueCopyBuffer(pOpenCL->getQueue(), srcBuffer.getCLMem(), clMemObject, srcOffsetBytes, dstOffsetBytes, numberOfBytes, 0, NULL, NULL);
+	void OpenCLBuffer::copyFrom(OpenCLImage &srcImage, size_t dstOffsetBytes, size_t *pSrcOrigin, size_t *pRegion) {
+		size_t zeroOrigin[3] = { 0, 0, 0 };
+		size_t fullRegion[3] = { (size_t)srcImage.getWidth(), (size_t)srcImage.getHeight(), (size_t)srcImage.getDepth() };
+		if(pSrcOrigin == NULL) pSrcOrigin = zeroOrigin;
+		if(pRegion == NULL) pRegion = fullRegion;
+		
+		cl_mem dst = getResidentCLMem();
+		pinCount++;		// so that restoring srcImage can't evict this
+		cl_mem src = srcImage.getResidentCLMem();
+		pinCount--;
+		
+		cl_int err = clEnqueueCopyImageToBuffer(pOpenCL->getQueue(), src, dst, pSrcOrigin, pRegion, dstOffsetBytes, 0, NULL, NULL);
+		assert(err == CL_SUCCESS);
+		deviceWasWritten(dstOffsetBytes, pRegion[0] * pRegion[1] * pRegion[2] * srcImage.getBytesPerPixel());
+	}
+	
+	
+	void OpenCLBuffer::copyFrom(OpenCLBuffer &srcBuffer, size_t srcOffsetBytes, size_t dstOffsetBytes, size_t numberOfBytes) {
+		cl_mem dst = getResidentCLMem();
+		pinCount++;		// so that restoring srcBuffer can't evict this
+		cl_mem src = srcBuffer.getResidentCLMem();
+		pinCount--;
+		
+		cl_int err = clEnqueueCopyBuffer(pOpenCL->getQueue(), src, dst, srcOffsetBytes, dstOffsetBytes, numberOfBytes, 0, NULL, NULL);
+		assert(err == CL_SUCCESS);
+		deviceWasWritten(dstOffsetBytes, numberOfBytes);
+	}
+	
+	
+	void OpenCLBuffer::readRect(void *dataPtr, size_t *pRegion, bool blockingRead, size_t *pBufferOrigin, size_t *pHostOrigin, size_t bufferRowPitch, size_t bufferSlicePitch, size_t hostRowPitch, size_t hostSlicePitch) {
+		size_t zeroOrigin[3] = { 0, 0, 0 };
+		if(pBufferOrigin == NULL) pBufferOrigin = zeroOrigin;
+		if(pHostOrigin == NULL) pHostOrigin = zeroOrigin;
+		
+		cl_int err = clEnqueueReadBufferRect(pOpenCL->getQueue(), getResidentCLMem(), blockingRead, pBufferOrigin, pHostOrigin, pRegion, bufferRowPitch, bufferSlicePitch, hostRowPitch, hostSlicePitch, dataPtr, 0, NULL, NULL);
+		assert(err != CL_INVALID_VALUE);
+		assert(err == CL_SUCCESS);
+	}
+	
+	
+	void OpenCLBuffer::writeRect(void *dataPtr, size_t *pRegion, bool blockingWrite, size_t *pBufferOrigin, size_t *pHostOrigin, size_t bufferRowPitch, size_t bufferSlicePitch, size_t hostRowPitch, size_t hostSlicePitch) {
+		size_t zeroOrigin[3] = { 0, 0, 0 };
+		if(pBufferOrigin == NULL) pBufferOrigin = zeroOrigin;
+		if(pHostOrigin == NULL) pHostOrigin = zeroOrigin;
+		
+		cl_int err = clEnqueueWriteBufferRect(pOpenCL->getQueue(), getResidentCLMem(), blockingWrite, pBufferOrigin, pHostOrigin, pRegion, bufferRowPitch, bufferSlicePitch, hostRowPitch, hostSlicePitch, dataPtr, 0, NULL, NULL);
+		assert(err != CL_INVALID_VALUE);
+		assert(err == CL_SUCCESS);
+	}
+	
+	
+	void OpenCLBuffer::copyRectFrom(OpenCLBuffer &srcBuffer, size_t *pRegion, size_t *pSrcOrigin, size_t *pDstOrigin, size_t srcRowPitch, size_t srcSlicePitch, size_t dstRowPitch, size_t dstSlicePitch) {
+		size_t zeroOrigin[3] = { 0, 0, 0 };
+		if(pSrcOrigin == NULL) pSrcOrigin = zeroOrigin;
+		if(pDstOrigin == NULL) pDstOrigin = zeroOrigin;
+		
+		cl_mem dst = getResidentCLMem();
+		pinCount++;		// so that restoring srcBuffer can't evict this
+		cl_mem src = srcBuffer.getResidentCLMem();
+		pinCount--;
+		
+		cl_int err = clEnqueueCopyBufferRect(pOpenCL->getQueue(), src, dst, pSrcOrigin, pDstOrigin, pRegion, srcRowPitch, srcSlicePitch, dstRowPitch, dstSlicePitch, 0, NULL, NULL);
+		assert(err != CL_INVALID_VALUE);
+		assert(err == CL_SUCCESS);
+	}
+	
+	
+	void OpenCLBuffer::initHalfBuffer(int numberOfElements, cl_mem_flags memFlags, const float *dataPtr, bool blockingWrite) {
+		ofLog(OF_LOG_VERBOSE, "OpenCLBuffer::initHalfBuffer");
+		
+		initBuffer(numberOfElements * sizeof(cl_half), memFlags & ~(CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR));
+		
+		if(dataPtr) writeHalf(dataPtr, 0, numberOfElements, blockingWrite);
+	}
+	
+	
+	void OpenCLBuffer::writeHalf(const float *dataPtr, int startOffsetElements, int numberOfElements, bool blockingWrite) {
+		waitForHalfStaging();
+		
+		if(halfStaging.size() < numberOfElements) halfStaging.resize(numberOfElements);
+		floatToHalf(dataPtr, &halfStaging[0], numberOfElements);
+		
+		cl_int err = clEnqueueWriteBuffer(pOpenCL->getQueue(), getResidentCLMem(), blockingWrite, startOffsetElements * sizeof(cl_half), numberOfElements * sizeof(cl_half), &halfStaging[0], 0, NULL, blockingWrite ? NULL : &halfStagingEvent);
+		assert(err == CL_SUCCESS);
+	}
+	
+	
+	void OpenCLBuffer::readHalf(float *dataPtr, int startOffsetElements, int numberOfElements) {
+		waitForHalfStaging();
+		
+		if(halfStaging.size() < numberOfElements) halfStaging.resize(numberOfElements);
+		read(&halfStaging[0], startOffsetElements * sizeof(cl_half), numberOfElements * sizeof(cl_half), CL_TRUE);
+		
+		halfToFloat(&halfStaging[0], dataPtr, numberOfElements);
+	}
+	
+	
+	void OpenCLBuffer::waitForHalfStaging() {
+		if(halfStagingEvent == NULL) return;
+		clWaitForEvents(1, &halfStagingEvent);
+		clReleaseEvent(halfStagingEvent);
+		halfStagingEvent = NULL;
+	}
+	
+	
+	void OpenCLBuffer::resize(size_t newNumberOfBytes) {
+		if(newNumberOfBytes > capacity) reserve(max(newNumberOfBytes, capacity * 2));
+		numberOfBytes = newNumberOfBytes;
+	}
+	
+	
+	void OpenCLBuffer::reserve(size_t newCapacity) {
+		if(newCapacity > capacity) reallocate(newCapacity);
+	}
+	
+	
+	void OpenCLBuffer::shrinkToFit() {
+		if(numberOfBytes < capacity) reallocate(numberOfBytes);
+	}
+	
+	
+	void OpenCLBuffer::reallocate(size_t newCapacity) {
+		ofLog(OF_LOG_VERBOSE, "OpenCLBuffer::reallocate " + ofToString(capacity) + " -> " + ofToString(newCapacity));
+		
+		if(!isResizable) {
+			ofLog(OF_LOG_ERROR, "OpenCLBuffer::reallocate - buffers created from GL objects or with CL_MEM_USE_HOST_PTR can't be resized");
+			assert(false);
+			return;
+		}
+		
+		if(pOpenCL == NULL) init();		// resizing a buffer which was never initialized
+		
+		makeResident();
+		willAllocate(newCapacity);
+		
+		cl_int err;
+		cl_mem newMemObject = clCreateBuffer(pOpenCL->getContext(), memFlags & ~CL_MEM_COPY_HOST_PTR, max(newCapacity, (size_t)1), NULL, &err);
+		assert(err != CL_INVALID_BUFFER_SIZE);
+		assert(err != CL_MEM_OBJECT_ALLOCATION_FAILURE);
+		assert(err == CL_SUCCESS);
+		assert(newMemObject);
+		
+		size_t numBytesToCopy = min(numberOfBytes, newCapacity);
+		if(clMemObject && numBytesToCopy > 0) {
+			err = clEnqueueCopyBuffer(pOpenCL->getQueue(), clMemObject, newMemObject, 0, 0, numBytesToCopy, 0, NULL, NULL);
+			assert(err == CL_SUCCESS);
+		}
+		
+		// the queue is in-order, so it's safe to release the old object after enqueuing the copy
+		if(clMemObject) clReleaseMemObject(clMemObject);
+		clMemObject		= newMemObject;
+		capacity		= newCapacity;
+		numberOfBytes	= numBytesToCopy;
+	}
+	
+	
+	bool OpenCLBuffer::canEvict() {
+		return isResizable && clMemObject && capacity > 0;
+	}
+	
+	
+	void OpenCLBuffer::evict() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLBuffer::evict " + ofToString(capacity) + " bytes");
+		
+		evictedData.resize(capacity);
+		cl_int err = clEnqueueReadBuffer(pOpenCL->getQueue(), clMemObject, CL_TRUE, 0, capacity, &evictedData[0], 0, NULL, NULL);
+		assert(err == CL_SUCCESS);
+		
+		clReleaseMemObject(clMemObject);
+		clMemObject = NULL;
+	}
+	
+	
+	void OpenCLBuffer::restore() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLBuffer::restore " + ofToString(capacity) + " bytes");
+		
+		cl_int err;
+		clMemObject = clCreateBuffer(pOpenCL->getContext(), memFlags & ~CL_MEM_COPY_HOST_PTR, capacity, NULL, &err);
+		assert(err == CL_SUCCESS);
+		assert(clMemObject);
+		
+		err = clEnqueueWriteBuffer(pOpenCL->getQueue(), clMemObject, CL_TRUE, 0, capacity, &evictedData[0], 0, NULL, NULL);
 		assert(err == CL_SUCCESS);
 	}
 	
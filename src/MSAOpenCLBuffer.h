@@ -16,22 +16,47 @@
 #include "ofMain.h"
 #include <OpenCL/Opencl.h>
 #include "MSAOpenCLMemoryObject.h"
+#include "MSAOpenCLHalf.h"
 
 namespace msa {
- 	
+	
+	class OpenCLMappedFile;
+	class OpenCLImage;
+	
+	// for fillRandom
+	enum OpenCLRandomDistribution {
+		OPENCL_RANDOM_UNIFORM,			// in [a, b)
+		OPENCL_RANDOM_NORMAL			// mean a, standard deviation b
+	};
+	
 	class OpenCLBuffer : public OpenCLMemoryObject {
 	public:
 		
 		OpenCLBuffer();
+		~OpenCLBuffer();
 		
 		// if dataPtr parameter is passed in, data is uploaded immediately
 		// parameters with default values can be omited
-		void initBuffer(	int numberOfBytes,
+		void initBuffer(	size_t numberOfBytes,
 						cl_mem_flags memFlags = CL_MEM_READ_WRITE,
 						void *dataPtr = NULL,
 						bool blockingWrite = CL_FALSE);
 		
 		
+		// create a buffer with the contents of a file (or part of it) without reading it into a host array first
+		// the file is memory mapped, then:
+		// - with CL_MEM_USE_HOST_PTR in memFlags the mapping itself is used as the buffer's storage
+		//   (zero copy on CPU and unified memory devices). The file stays mapped for the lifetime of the buffer,
+		//   and the pages are private, so kernels writing to the buffer don't change the file
+		// - otherwise it's streamed to the device in chunks and unmapped straight away
+		// length < 0 means to the end of the file
+		// returns false if the file can't be opened or mapped
+		bool initFromFile(string filename,
+						  size_t offset = 0,
+						  long long length = -1,
+						  cl_mem_flags memFlags = CL_MEM_READ_ONLY);
+		
+		
 		// create buffer from the GL Object - e.g. VBO (they share memory space on device)
 		// parameters with default values can be omited
 		void initFromGLObject(	GLuint glBufferObject,
@@ -40,26 +65,157 @@ namespace msa {
 		
 		// read from device memory, into main memoy (into dataPtr)
 		void read(void *dataPtr,
-				  int startOffsetBytes,
-				  int numberOfBytes,
+				  size_t startOffsetBytes,
+				  size_t numberOfBytes,
 				  bool blockingRead = CL_TRUE);
 		
 		// write from main memory (dataPtr), into device memory
+		// (for lots of small writes every frame, OpenCLWriteBatch combines them into a single transfer)
 		void write(void *dataPtr,
-				   int startOffsetBytes,
-				   int numberOfBytes,
+				   size_t startOffsetBytes,
+				   size_t numberOfBytes,
 				   bool blockingWrite = CL_FALSE);
 		
 		
 		// copy data from another object on device memory
 		void copyFrom(OpenCLBuffer &srcBuffer,
-					  int srcOffsetBytes,
-					  int dstOffsetBytes,
-					  int numberOfBytes);
+					  size_t srcOffsetBytes,
+					  size_t dstOffsetBytes,
+					  size_t numberOfBytes);
+		
+		// copy pixels from an image in device memory (tightly packed, in the image's format)
+		// if origin and/or region is NULL, entire image is copied
+		void copyFrom(OpenCLImage &srcImage,
+					  size_t dstOffsetBytes = 0,
+					  size_t *pSrcOrigin = NULL,
+					  size_t *pRegion = NULL);
+		
+		
+		// rectangular (strided) transfers, e.g. a sub-rectangle of a 2D grid or one field of an array of structs
+		// origins are (x in bytes, y in rows, z in slices), region is (width in bytes, height in rows, depth in slices)
+		// if origin is NULL, (0, 0, 0) is used
+		// pitches of 0 mean tightly packed (rowPitch = region[0], slicePitch = region[1] * rowPitch)
+		
+		// read from device memory, into main memoy (into dataPtr)
+		void readRect(void *dataPtr,
+					  size_t *pRegion,
+					  bool blockingRead = CL_TRUE,
+					  size_t *pBufferOrigin = NULL,
+					  size_t *pHostOrigin = NULL,
+					  size_t bufferRowPitch = 0,
+					  size_t bufferSlicePitch = 0,
+					  size_t hostRowPitch = 0,
+					  size_t hostSlicePitch = 0);
+		
+		// write from main memory (dataPtr), into device memory
+		void writeRect(void *dataPtr,
+					   size_t *pRegion,
+					   bool blockingWrite = CL_FALSE,
+					   size_t *pBufferOrigin = NULL,
+					   size_t *pHostOrigin = NULL,
+					   size_t bufferRowPitch = 0,
+					   size_t bufferSlicePitch = 0,
+					   size_t hostRowPitch = 0,
+					   size_t hostSlicePitch = 0);
+		
+		// copy a rectangular region from another buffer in device memory
+		void copyRectFrom(OpenCLBuffer &srcBuffer,
+						  size_t *pRegion,
+						  size_t *pSrcOrigin = NULL,
+						  size_t *pDstOrigin = NULL,
+						  size_t srcRowPitch = 0,
+						  size_t srcSlicePitch = 0,
+						  size_t dstRowPitch = 0,
+						  size_t dstSlicePitch = 0);
+		
+		
+		// fill with random floats generated on the device (nothing goes through main memory)
+		// with a counter based generator (see MSAOpenCLRandom.h), so the same seed always gives the same numbers
+		// numberOfBytes == (size_t)-1 means to the end of the buffer
+		// parameters with default values can be omited
+		void fillRandom(OpenCLRandomDistribution distribution = OPENCL_RANDOM_UNIFORM,
+						cl_uint seed = 0,
+						float a = 0,
+						float b = 1,
+						size_t startOffsetBytes = 0,
+						size_t numberOfBytes = (size_t)-1);
+		
+		
+		// half precision storage: the buffer holds cl_half elements, but the host reads and writes floats
+		// (converted with SIMD on the host, see MSAOpenCLHalf.h). This halves the bytes transferred and stored.
+		// in kernels use vload_half / vstore_half, e.g. for a buffer of half2 positions:
+		// float2 pos = vload_half2(i, posBuffer); ... vstore_half2(pos, i, posBuffer);
+		// if dataPtr parameter is passed in, data is uploaded immediately
+		void initHalfBuffer(int numberOfElements,
+							cl_mem_flags memFlags = CL_MEM_READ_WRITE,
+							const float *dataPtr = NULL,
+							bool blockingWrite = CL_FALSE);
+		
+		// convert floats from main memory (dataPtr) to half, and write into device memory
+		// offsets and sizes are in elements
+		void writeHalf(const float *dataPtr,
+					   int startOffsetElements,
+					   int numberOfElements,
+					   bool blockingWrite = CL_FALSE);
+		
+		// read halfs from device memory and convert into floats in main memory (into dataPtr)
+		// this is always blocking
+		void readHalf(float *dataPtr,
+					  int startOffsetElements,
+					  int numberOfElements);
+		
+		
+		// change the size of the buffer, preserving existing contents (up to the new size)
+		// when growing beyond the capacity, the capacity at least doubles (so repeatedly growing is cheap)
+		// and existing contents are copied to the new allocation on the device
+		// kernels which had this buffer set with setArg(argNumber, buffer) are re-bound automatically when they next run
+		// (if you passed buffer.getCLMem() to setArg instead, you need to call setArg again after a resize)
+		// not available for buffers created from GL objects or with CL_MEM_USE_HOST_PTR
+		// (it's fine to call this on a buffer which hasn't been initialized yet)
+		// virtual so subclasses keeping per element state (e.g. OpenCLMirroredBuffer) can follow the new size
+		virtual void resize(size_t numberOfBytes);
+		
+		// make sure the capacity is at least numberOfBytes, without changing the size
+		void reserve(size_t numberOfBytes);
+		
+		// reduce the capacity to the current size (without changing the size)
+		void shrinkToFit();
+		
+		// current size in bytes
+		size_t getSize() const {
+			return numberOfBytes;
+		}
+		
+		// number of bytes allocated on the device
+		size_t getCapacity() const {
+			return capacity;
+		}
+		
+		size_t getSizeInBytes() {
+			return capacity;
+		}
 		
 	protected:
-		//	int numberOfBytes;		//dont know how big it is if we pass in globject ?
+		size_t			numberOfBytes;
+		size_t			capacity;
+		cl_mem_flags	memFlags;
+		bool			isResizable;
+		
+		vector<cl_half>	halfStaging;			// converted data for writeHalf / readHalf
+		cl_event		halfStagingEvent;		// pending non-blocking write from halfStaging
+		
+		OpenCLMappedFile	*mappedFile;		// backing storage for buffers from initFromFile with CL_MEM_USE_HOST_PTR
 		
 		void init();
+		void releaseMappedFile();
+		void reallocate(size_t newCapacity);
+		void waitForHalfStaging();
+		
+		// called after bytes in this buffer were changed on the device by a copy (e.g. so OpenCLMirroredBuffer knows its host copy is out of date)
+		virtual void deviceWasWritten(size_t startOffsetBytes, size_t numberOfBytes) {}
+		
+		bool canEvict();
+		void evict();
+		void restore();
 	};
 }
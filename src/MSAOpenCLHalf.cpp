@@ -0,0 +1,165 @@
+#include "MSAOpenCLHalf.h"
+#include <string.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#define MSA_OPENCL_HALF_F16C
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MSA_OPENCL_HALF_NEON
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MSA_OPENCL_HALF_SSE2
+#endif
+
+namespace msa {
+
+	// scalar versions, see http://fgiesen.wordpress.com/2012/03/28/half-to-float-done-quic/
+	static inline unsigned int floatAsUInt(float f) {
+		unsigned int u;
+		memcpy(&u, &f, sizeof(u));
+		return u;
+	}
+
+	static inline float uintAsFloat(unsigned int u) {
+		float f;
+		memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	cl_half floatToHalf(float f) {
+		const unsigned int denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;	// 0.5f
+
+		unsigned int x		= floatAsUInt(f);
+		unsigned int sign	= x & 0x80000000u;
+		x ^= sign;
+
+		unsigned int o;
+		if(x >= 0x47800000u) {					// too large for a half (or inf / nan)
+			o = (x > 0x7f800000u) ? 0x7e00 : 0x7c00;
+		} else if(x < 0x38800000u) {			// becomes a half denormal (or zero), let the FPU do the rounding
+			o = floatAsUInt(uintAsFloat(x) + uintAsFloat(denormMagic)) - denormMagic;
+		} else {								// normal, round to nearest even
+			unsigned int mantissaOdd = (x >> 13) & 1;
+			x += ((unsigned int)(15 - 127) << 23) + 0xfff;
+			x += mantissaOdd;
+			o = x >> 13;
+		}
+		return (cl_half)(o | (sign >> 16));
+	}
+
+
+	float halfToFloat(cl_half h) {
+		const unsigned int shiftedExp	= 0x7c00 << 13;
+		const float magic				= uintAsFloat(113 << 23);
+
+		unsigned int o		= (h & 0x7fff) << 13;
+		unsigned int exp	= shiftedExp & o;
+		o += (127 - 15) << 23;
+
+		if(exp == shiftedExp) {					// inf / nan
+			o += (128 - 16) << 23;
+		} else if(exp == 0) {					// zero / denormal
+			o += 1 << 23;
+			o = floatAsUInt(uintAsFloat(o) - magic);
+		}
+
+		o |= (h & 0x8000) << 16;
+		return uintAsFloat(o);
+	}
+
+
+
+#if defined(MSA_OPENCL_HALF_SSE2)
+	// same as the scalar versions above, four at a time
+	static inline __m128i floatToHalf4(__m128 f) {
+		__m128i x			= _mm_castps_si128(f);
+		__m128i sign		= _mm_and_si128(x, _mm_set1_epi32(0x80000000u));
+		x = _mm_xor_si128(x, sign);
+
+		__m128i isInfNan	= _mm_cmpgt_epi32(x, _mm_set1_epi32(0x477fffff));
+		__m128i isNan		= _mm_cmpgt_epi32(x, _mm_set1_epi32(0x7f800000));
+		__m128i infNan		= _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(isNan, _mm_set1_epi32(0x0200)));
+
+		__m128i denormMagic	= _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		__m128i isDenorm	= _mm_cmpgt_epi32(_mm_set1_epi32(0x38800000), x);
+		__m128i denorm		= _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(x), _mm_castsi128_ps(denormMagic))), denormMagic);
+
+		__m128i mantissaOdd	= _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(1));
+		__m128i normal		= _mm_add_epi32(x, _mm_set1_epi32(((unsigned int)(15 - 127) << 23) + 0xfff));
+		normal = _mm_srli_epi32(_mm_add_epi32(normal, mantissaOdd), 13);
+
+		__m128i o = _mm_or_si128(_mm_and_si128(isDenorm, denorm), _mm_andnot_si128(isDenorm, normal));
+		o = _mm_or_si128(_mm_and_si128(isInfNan, infNan), _mm_andnot_si128(isInfNan, o));
+		o = _mm_or_si128(o, _mm_srli_epi32(sign, 16));
+
+		// pack to 16 bit without signed saturation getting in the way
+		o = _mm_srai_epi32(_mm_slli_epi32(o, 16), 16);
+		return _mm_packs_epi32(o, o);
+	}
+
+
+	static inline __m128 halfToFloat4(__m128i h) {
+		__m128i shiftedExp	= _mm_set1_epi32(0x7c00 << 13);
+		__m128i magic		= _mm_set1_epi32(113 << 23);
+
+		h = _mm_unpacklo_epi16(h, _mm_setzero_si128());
+		__m128i o			= _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+		__m128i exp			= _mm_and_si128(o, shiftedExp);
+		o = _mm_add_epi32(o, _mm_set1_epi32((127 - 15) << 23));
+
+		__m128i isInfNan	= _mm_cmpeq_epi32(exp, shiftedExp);
+		o = _mm_add_epi32(o, _mm_and_si128(isInfNan, _mm_set1_epi32((128 - 16) << 23)));
+
+		__m128i isDenorm	= _mm_cmpeq_epi32(exp, _mm_setzero_si128());
+		__m128i denorm		= _mm_castps_si128(_mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(o, _mm_set1_epi32(1 << 23))), _mm_castsi128_ps(magic)));
+		o = _mm_or_si128(_mm_and_si128(isDenorm, denorm), _mm_andnot_si128(isDenorm, o));
+
+		o = _mm_or_si128(o, _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16));
+		return _mm_castsi128_ps(o);
+	}
+#endif
+
+
+
+	void floatToHalf(const float *src, cl_half *dst, int numElements) {
+		int i = 0;
+
+#if defined(MSA_OPENCL_HALF_F16C)
+		for(; i + 4 <= numElements; i += 4) {
+			_mm_storel_epi64((__m128i*)(dst + i), _mm_cvtps_ph(_mm_loadu_ps(src + i), 0));	// 0 = round to nearest even
+		}
+#elif defined(MSA_OPENCL_HALF_NEON)
+		for(; i + 4 <= numElements; i += 4) {
+			vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+		}
+#elif defined(MSA_OPENCL_HALF_SSE2)
+		for(; i + 4 <= numElements; i += 4) {
+			_mm_storel_epi64((__m128i*)(dst + i), floatToHalf4(_mm_loadu_ps(src + i)));
+		}
+#endif
+
+		for(; i < numElements; i++) dst[i] = floatToHalf(src[i]);
+	}
+
+
+	void halfToFloat(const cl_half *src, float *dst, int numElements) {
+		int i = 0;
+
+#if defined(MSA_OPENCL_HALF_F16C)
+		for(; i + 4 <= numElements; i += 4) {
+			_mm_storeu_ps(dst + i, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(src + i))));
+		}
+#elif defined(MSA_OPENCL_HALF_NEON)
+		for(; i + 4 <= numElements; i += 4) {
+			vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+		}
+#elif defined(MSA_OPENCL_HALF_SSE2)
+		for(; i + 4 <= numElements; i += 4) {
+			_mm_storeu_ps(dst + i, halfToFloat4(_mm_loadl_epi64((const __m128i*)(src + i))));
+		}
+#endif
+
+		for(; i < numElements; i++) dst[i] = halfToFloat(src[i]);
+	}
+}
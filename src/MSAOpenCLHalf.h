@@ -0,0 +1,28 @@
+/***********************************************************************
+
+ Half precision (IEEE 754 binary16) conversion for host side data
+ Used by OpenCLBuffer::writeHalf/readHalf and OpenCLImage::writeFloats/readFloats
+ to store data as cl_half on the device while the host keeps working with floats
+
+ Uses F16C or NEON conversion instructions when compiled for them (e.g. -mf16c), SSE2 otherwise, and plain C as a last resort
+ float to half rounds to nearest even (same as vstore_half_rte and the GPU's write_imagef to a CL_HALF_FLOAT image)
+
+ ************************************************************************/
+
+#pragma once
+
+#include <OpenCL/Opencl.h>
+
+namespace msa {
+
+	// convert numElements floats (from src) into halfs (into dst)
+	void floatToHalf(const float *src, cl_half *dst, int numElements);
+
+	// convert numElements halfs (from src) into floats (into dst)
+	void halfToFloat(const cl_half *src, float *dst, int numElements);
+
+
+	// single value versions
+	cl_half	floatToHalf(float f);
+	float	halfToFloat(cl_half h);
+}
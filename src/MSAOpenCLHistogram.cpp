@@ -0,0 +1,200 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLHistogram.h"
+
+namespace msa {
+
+	// histograms are 4 channels of numBins each
+	static const string histogramSource = MSA_OPENCL_SOURCE(
+		__constant sampler_t msaHistogramSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+		// each work-group strides over the region, counting into its own histogram in partials
+		__kernel void msa_histogram(__read_only image2d_t src, __global uint *partials, const int4 roi, const int numBins, const float minValue, const float binScale, __local uint *lHistogram) {
+			int lid				= get_local_id(0);
+			int localSize		= get_local_size(0);
+			int histogramSize	= 4 * numBins;
+
+			for(int i = lid; i < histogramSize; i += localSize) lHistogram[i] = 0;
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			int n = roi.z * roi.w;
+			for(int k = get_global_id(0); k < n; k += get_global_size(0)) {
+				float4 c = read_imagef(src, msaHistogramSampler, roi.xy + (int2)(k % roi.z, k / roi.z));
+				int4 bin = clamp(convert_int4_sat_rtn((c - minValue) * binScale), 0, numBins - 1);
+				atomic_inc(&lHistogram[bin.x]);
+				atomic_inc(&lHistogram[numBins + bin.y]);
+				atomic_inc(&lHistogram[2 * numBins + bin.z]);
+				atomic_inc(&lHistogram[3 * numBins + bin.w]);
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			__global uint *dst = partials + get_group_id(0) * histogramSize;
+			for(int i = lid; i < histogramSize; i += localSize) dst[i] = lHistogram[i];
+		}
+
+		// one work-item per bin
+		__kernel void msa_histogram_merge(__global const uint *partials, __global uint *histogram, const int histogramSize, const int numPartials) {
+			int i = get_global_id(0);
+			if(i >= histogramSize) return;
+			uint sum = 0;
+			for(int p = 0; p < numPartials; p++) sum += partials[p * histogramSize + i];
+			histogram[i] = sum;
+		}
+
+		// a single work-item, the histogram is small
+		// maximizes the between class variance w0 * w1 * (mu0 - mu1)^2
+		__kernel void msa_otsu(__global const uint *histogram, const int numBins, const int channel, const float minValue, const float binScale, __global float *level, const int levelIndex) {
+			__global const uint *h = histogram + channel * numBins;
+
+			float total = 0;
+			float sumAll = 0;
+			for(int i = 0; i < numBins; i++) {
+				total	+= h[i];
+				sumAll	+= i * (float)h[i];
+			}
+
+			float w0 = 0;
+			float sum0 = 0;
+			float bestVariance = -1;
+			int best = 0;
+			for(int t = 0; t < numBins - 1; t++) {
+				w0		+= h[t];
+				sum0	+= t * (float)h[t];
+				float w1 = total - w0;
+				if(w0 == 0 || w1 == 0) continue;
+				float d = sum0 / w0 - (sumAll - sum0) / w1;
+				float variance = w0 * w1 * d * d;
+				if(variance > bestVariance) {
+					bestVariance	= variance;
+					best			= t;
+				}
+			}
+
+			// the lower edge of the first bin of the upper class
+			level[levelIndex] = minValue + (best + 1) / binScale;
+		}
+	);
+
+
+	OpenCLHistogram::OpenCLHistogram() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLHistogram::OpenCLHistogram");
+		setup();
+	}
+
+
+	void OpenCLHistogram::setup(int numBins, float minValue, float maxValue) {
+		ofLog(OF_LOG_VERBOSE, "OpenCLHistogram::setup " + ofToString(numBins) + ", " + ofToString(minValue) + ", " + ofToString(maxValue));
+		this->numBins	= numBins;
+		this->minValue	= minValue;
+		this->maxValue	= maxValue;
+	}
+
+
+	void OpenCLHistogram::compute(OpenCLImage &image, size_t *pOrigin, size_t *pRegion) {
+		switch(image.getChannelDataType()) {
+			case CL_SIGNED_INT8:
+			case CL_SIGNED_INT16:
+			case CL_SIGNED_INT32:
+			case CL_UNSIGNED_INT8:
+			case CL_UNSIGNED_INT16:
+			case CL_UNSIGNED_INT32:
+				ofLog(OF_LOG_ERROR, "OpenCLHistogram::compute - only for float and normalized images");
+				assert(false);
+				return;
+		}
+
+		OpenCL *pOpenCL = OpenCL::currentOpenCL;
+		int histogramSize = 4 * numBins;
+		if(pOpenCL->info.localMemSize && histogramSize * sizeof(cl_uint) > pOpenCL->info.localMemSize) {
+			ofLog(OF_LOG_ERROR, "OpenCLHistogram::compute - " + ofToString(numBins) + " bins don't fit in local memory");
+			assert(false);
+			return;
+		}
+
+		cl_int4 roi;
+		roi.s[0] = pOrigin ? pOrigin[0] : 0;
+		roi.s[1] = pOrigin ? pOrigin[1] : 0;
+		roi.s[2] = pRegion ? pRegion[0] : image.getWidth() - roi.s[0];
+		roi.s[3] = pRegion ? pRegion[1] : image.getHeight() - roi.s[1];
+		if(roi.s[0] < 0 || roi.s[1] < 0 || roi.s[0] + roi.s[2] > image.getWidth() || roi.s[1] + roi.s[3] > image.getHeight()) {
+			ofLog(OF_LOG_ERROR, "OpenCLHistogram::compute - region must be within the image");
+			assert(false);
+			return;
+		}
+		int numPixels = roi.s[2] * roi.s[3];
+		if(numPixels <= 0) return;
+
+		OpenCLKernel *kernel = loadHistogramKernel("msa_histogram");
+		size_t localSize = min((size_t)256, kernel->getWorkGroupSize());
+
+		// enough work-groups to fill the device, each counting many pixels (fewer partial histograms to merge)
+		cl_int numGroups = min((size_t)pOpenCL->info.maxComputeUnits * 4, (numPixels + localSize - 1) / localSize);
+		numGroups = max(numGroups, 1);
+
+		if(partials.getCapacity() < numGroups * histogramSize * 4) partials.initBuffer(numGroups * histogramSize * 4, CL_MEM_READ_WRITE);
+		if(histogram.getCapacity() < histogramSize * 4) histogram.initBuffer(histogramSize * 4, CL_MEM_READ_WRITE);
+
+		cl_int bins			= numBins;
+		cl_float minV		= minValue;
+		cl_float binScale	= numBins / (maxValue - minValue);
+		kernel->setArg(0, image, CL_MEM_READ_ONLY);
+		kernel->setArg(1, partials, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, roi);
+		kernel->setArg(3, bins);
+		kernel->setArg(4, minV);
+		kernel->setArg(5, binScale);
+		kernel->setLocalArg(6, histogramSize * sizeof(cl_uint));
+		kernel->run1D(numGroups * localSize, localSize);
+
+		cl_int size = histogramSize;
+		kernel = loadHistogramKernel("msa_histogram_merge");
+		kernel->setArg(0, partials, CL_MEM_READ_ONLY);
+		kernel->setArg(1, histogram, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, size);
+		kernel->setArg(3, numGroups);
+		kernel->run1D(histogramSize);
+	}
+
+
+	void OpenCLHistogram::read(cl_uint *dataPtr) {
+		histogram.read(dataPtr, 0, 4 * numBins * sizeof(cl_uint), CL_TRUE);
+	}
+
+
+	void OpenCLHistogram::otsuThreshold(OpenCLBuffer &levelBuffer, int channel, int levelOffsetBytes) {
+		if(levelOffsetBytes % 4 || levelOffsetBytes + 4 > levelBuffer.getSize()) {
+			ofLog(OF_LOG_ERROR, "OpenCLHistogram::otsuThreshold - level doesn't fit in levelBuffer, or its offset isn't a multiple of 4");
+			assert(false);
+			return;
+		}
+
+		cl_int bins			= numBins;
+		cl_int c			= channel;
+		cl_float minV		= minValue;
+		cl_float binScale	= numBins / (maxValue - minValue);
+		cl_int levelIndex	= levelOffsetBytes / 4;
+		OpenCLKernel *kernel = loadHistogramKernel("msa_otsu");
+		kernel->setArg(0, histogram, CL_MEM_READ_ONLY);
+		kernel->setArg(1, bins);
+		kernel->setArg(2, c);
+		kernel->setArg(3, minV);
+		kernel->setArg(4, binScale);
+		kernel->setArg(5, levelBuffer, CL_MEM_WRITE_ONLY);
+		kernel->setArg(6, levelIndex);
+		kernel->run1D(1);
+	}
+
+
+	float OpenCLHistogram::readOtsuThreshold(int channel) {
+		if(otsuLevel.getCapacity() < 4) otsuLevel.initBuffer(4, CL_MEM_READ_WRITE);
+		otsuThreshold(otsuLevel, channel);
+
+		cl_float level;
+		otsuLevel.read(&level, 0, sizeof(level), CL_TRUE);
+		return level;
+	}
+
+
+	OpenCLKernel *OpenCLHistogram::loadHistogramKernel(string kernelName) {
+		return OpenCL::currentOpenCL->loadBuiltinKernel(kernelName, "MSAOpenCLHistogram", histogramSource);
+	}
+}
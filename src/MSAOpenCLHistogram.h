@@ -0,0 +1,89 @@
+/***********************************************************************
+
+ OpenCL Histogram
+ Histograms of each channel of an image (or a region of it), computed on the device.
+ Every work-group counts its pixels into its own histogram in local memory (with local atomics),
+ then the work-group histograms are summed into the result, so there's no contention on global memory.
+ Otsu's threshold can be computed from the result on the device too, e.g. for a threshold kernel to read
+ its level from a buffer, without anything being read back.
+
+ e.g.:
+ OpenCLHistogram histogram;
+ histogram.setup(256);
+ histogram.compute(image);
+ histogram.otsuThreshold(levelBuffer);		// levelBuffer now holds the threshold of the red channel, as a float
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCLBuffer.h"
+
+namespace msa {
+
+	class OpenCLImage;
+	class OpenCLKernel;
+
+	class OpenCLHistogram {
+	public:
+
+		OpenCLHistogram();
+
+		// values in [minValue, maxValue) are counted in numBins equal bins
+		// (values outside of the range are counted in the first or last bin)
+		// parameters with default values can be omited
+		void setup(int numBins = 256,
+				   float minValue = 0,
+				   float maxValue = 1);
+
+		// histogram of each channel of a 2D float or normalized image
+		// if origin and/or region is NULL, the entire image is used
+		void compute(OpenCLImage &image,
+					 size_t *pOrigin = NULL,
+					 size_t *pRegion = NULL);
+
+		// result of the last compute in device memory: 4 * numBins uints, all bins of the first channel, then the second...
+		OpenCLBuffer &getBuffer() {
+			return histogram;
+		}
+
+		// read the result of the last compute into main memory (4 * numBins uints into dataPtr)
+		void read(cl_uint *dataPtr);
+
+
+		// Otsu's threshold for a channel of the last compute, written as a float into levelBuffer at levelOffsetBytes
+		// pixels greater or equal to it are in the upper class
+		void otsuThreshold(OpenCLBuffer &levelBuffer,
+						   int channel = 0,
+						   int levelOffsetBytes = 0);
+
+		// same as above, but read back (blocking)
+		float readOtsuThreshold(int channel = 0);
+
+
+		int getNumBins() {
+			return numBins;
+		}
+
+		float getMinValue() {
+			return minValue;
+		}
+
+		float getMaxValue() {
+			return maxValue;
+		}
+
+
+	protected:
+		int				numBins;
+		float			minValue;
+		float			maxValue;
+		OpenCLBuffer	partials;		// one histogram per work-group
+		OpenCLBuffer	histogram;
+		OpenCLBuffer	otsuLevel;		// for readOtsuThreshold
+
+		OpenCLKernel *loadHistogramKernel(string kernelName);
+	};
+}
@@ -3,9 +3,137 @@
 
 namespace msa {
 	
+	// conversion between packed 8 bit pixels (in a buffer) and images, for writeFromPixels / readToPixels
+	// format is an OpenCLPixelFormat, MSA_INTEGER_IMAGE is defined before compiling
+	static const string pixelsSourceHeader =
+	"#if MSA_INTEGER_IMAGE\n"
+	"#define MSA_WRITE_PIXEL(img, pos, c)	write_imageui(img, pos, convert_uint4_sat_rte(c))\n"
+	"#define MSA_READ_PIXEL(img, pos)		convert_float4(read_imageui(img, msaPixelSampler, pos))\n"
+	"#else\n"
+	"#define MSA_WRITE_PIXEL(img, pos, c)	write_imagef(img, pos, (c) * (1.0f / 255.0f))\n"
+	"#define MSA_READ_PIXEL(img, pos)		(read_imagef(img, msaPixelSampler, pos) * 255.0f)\n"
+	"#endif\n";
+	
+	static const string pixelsSource = MSA_OPENCL_SOURCE(
+		__constant sampler_t msaPixelSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+		
+		__kernel void msa_pixels_to_image(__global const uchar *src, __write_only image2d_t dst, const int format, const int srcRowPitch) {
+			int2 pos = (int2)(get_global_id(0), get_global_id(1));
+			__global const uchar *row = src + pos.y * srcRowPitch;
+			float4 c;
+			if(format == 0) {
+				float v = row[pos.x];
+				c = (float4)(v, v, v, 255.0f);
+			}
+			else if(format == 1) c = (float4)(convert_float3(vload3(pos.x, row)), 255.0f);
+			else if(format == 2) c = (float4)(convert_float3(vload3(pos.x, row)).zyx, 255.0f);
+			else if(format == 3) c = convert_float4(vload4(pos.x, row));
+			else c = convert_float4(vload4(pos.x, row)).zyxw;
+			MSA_WRITE_PIXEL(dst, pos, c);
+		}
+		
+		__kernel void msa_image_to_pixels(__read_only image2d_t src, __global uchar *dst, const int format, const int dstRowPitch, const int isSingleChannel) {
+			int2 pos = (int2)(get_global_id(0), get_global_id(1));
+			__global uchar *row = dst + pos.y * dstRowPitch;
+			float4 c = MSA_READ_PIXEL(src, pos);
+			if(format == 0) row[pos.x] = convert_uchar_sat_rte(isSingleChannel ? c.x : 0.3f * c.x + 0.59f * c.y + 0.11f * c.z);
+			else if(format == 1) vstore3(convert_uchar3_sat_rte(c.xyz), pos.x, row);
+			else if(format == 2) vstore3(convert_uchar3_sat_rte(c.zyx), pos.x, row);
+			else if(format == 3) vstore4(convert_uchar4_sat_rte(c), pos.x, row);
+			else vstore4(convert_uchar4_sat_rte(c.zyxw), pos.x, row);
+		}
+		
+		// format is an OpenCLYUVFormat, offsets and pitches are in bytes
+		// coeffs = (V to R, U to G, V to G, U to B), range = (Y offset, Y scale, UV scale, unused)
+		__kernel void msa_yuv_to_image(__global const uchar *src, __write_only image2d_t dst, const int format,
+									   const int yPitch, const int uvPitch, const int uOffset, const int vOffset,
+									   const float4 coeffs, const float4 range) {
+			int2 pos = (int2)(get_global_id(0), get_global_id(1));
+			float y, u, v;
+			if(format == 2) {
+				__global const uchar *yuyv = src + pos.y * yPitch + (pos.x >> 1) * 4;
+				y = yuyv[(pos.x & 1) * 2];
+				u = yuyv[1];
+				v = yuyv[3];
+			} else {
+				y = src[pos.y * yPitch + pos.x];
+				int chroma = (pos.y >> 1) * uvPitch;
+				if(format == 0) {
+					u = src[uOffset + chroma + (pos.x >> 1) * 2];
+					v = src[uOffset + chroma + (pos.x >> 1) * 2 + 1];
+				} else {
+					u = src[uOffset + chroma + (pos.x >> 1)];
+					v = src[vOffset + chroma + (pos.x >> 1)];
+				}
+			}
+			y = (y - range.x) * range.y;
+			u = (u - 128.0f) * range.z;
+			v = (v - 128.0f) * range.z;
+			float3 rgb = clamp((float3)(y + coeffs.x * v, y - coeffs.y * u - coeffs.z * v, y + coeffs.w * u), 0.0f, 1.0f);
+			MSA_WRITE_PIXEL(dst, pos, (float4)(rgb, 1.0f) * 255.0f);
+		}
+	);
+	
+	
+	// 2x downsampling, using the linear sampler to average 2 pixels per fetch in each direction
+	static const string pyramidSource = MSA_OPENCL_SOURCE(
+		__constant sampler_t msaLinearSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_LINEAR;
+		
+		__kernel void msa_downsample_box(__read_only image2d_t src, __write_only image2d_t dst) {
+			int2 pos = (int2)(get_global_id(0), get_global_id(1));
+			write_imagef(dst, pos, read_imagef(src, msaLinearSampler, convert_float2(pos) * 2.0f + 1.0f));
+		}
+		
+		// 1 4 6 4 1 taps around pixel 2 * pos, as 3 linear fetches (5, 6, 5) at -1.2, 0, 1.2 in each direction
+		__kernel void msa_downsample_gaussian(__read_only image2d_t src, __write_only image2d_t dst) {
+			int2 pos = (int2)(get_global_id(0), get_global_id(1));
+			float2 center = convert_float2(pos) * 2.0f + 0.5f;
+			const float offsets[3] = { -1.2f, 0.0f, 1.2f };
+			const float weights[3] = { 5.0f / 16.0f, 6.0f / 16.0f, 5.0f / 16.0f };
+			float4 sum = (float4)(0.0f);
+			for(int j=0; j<3; j++) {
+				for(int i=0; i<3; i++) {
+					sum += weights[i] * weights[j] * read_imagef(src, msaLinearSampler, center + (float2)(offsets[i], offsets[j]));
+				}
+			}
+			write_imagef(dst, pos, sum);
+		}
+	);
+	
+	
+	static int getPixelFormatBytes(OpenCLPixelFormat pixelFormat) {
+		switch(pixelFormat) {
+			case OPENCL_PIXELS_GRAY:
+				return 1;
+			case OPENCL_PIXELS_RGB:
+			case OPENCL_PIXELS_BGR:
+				return 3;
+			default:
+				return 4;
+		}
+	}
+	
+	
 	OpenCLImage::OpenCLImage() {
 		ofLog(OF_LOG_VERBOSE, "OpenCLImage::OpenCLImage");
 		texture = NULL;
+		halfStagingEvent = NULL;
+		viewedBuffer = NULL;
+		filterTemp[0] = filterTemp[1] = NULL;
+		filterWeightsSigma = 0;
+		imageFormat.image_channel_order		= CL_RGBA;
+		imageFormat.image_channel_data_type	= CL_FLOAT;
+		memFlags = CL_MEM_READ_WRITE;
+	}
+	
+	
+	OpenCLImage::~OpenCLImage() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLImage::~OpenCLImage");
+		waitForHalfStaging();		// halfStaging is about to be freed
+		releaseView();
+		clearPyramid();
+		delete filterTemp[0];
+		delete filterTemp[1];
 	}
 	
 	
@@ -16,26 +144,106 @@ namespace msa {
 										 cl_channel_type imageChannelDataType,
 										 cl_mem_flags memFlags,
 										 void *dataPtr,
-										 bool blockingWrite)
+										 bool blockingWrite,
+										 size_t rowPitch,
+										 size_t slicePitch)
 	{
 		ofLog(OF_LOG_VERBOSE, "OpenCLImage::initWithoutTexture");
 		
 		init(w, h, d);
 		
-		cl_int err;
-		cl_image_format imageFormat;
 		imageFormat.image_channel_order		= imageChannelOrder;
 		imageFormat.image_channel_data_type	= imageChannelDataType;
-		
-		int image_row_pitch = 0;	// TODO
-		int image_slice_pitch = 0;
+		this->memFlags = memFlags;
 		
 		if(clMemObject) clReleaseMemObject(clMemObject);
+		clMemObject = NULL;
+		releaseView();
+		memoryTag = OPENCL_MEMORY_IMAGE;
+		
+		if(!validateSize(dataPtr, rowPitch, slicePitch)) return;
+		
+		willAllocate(getSizeInBytes());
+		createImage(dataPtr, rowPitch, slicePitch);
+		
+		// the host pointer flags have already used the data
+		if(dataPtr && !(memFlags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR))) {
+			write(dataPtr, blockingWrite, NULL, NULL, rowPitch, slicePitch);
+		}
 		
+		if(texture) delete texture;
+		texture = NULL;
+	}
+	
+	
+	bool OpenCLImage::validateSize(void *dataPtr, size_t &rowPitch, size_t &slicePitch) {
+		string error;
+		
+		// device limits (only known after OpenCL::setup)
+		if(pOpenCL->info.image2dMaxWidth > 0) {
+			if(!pOpenCL->info.imageSupport) error = "images are not supported on this device";
+			else if(depth == 1 && (width > pOpenCL->info.image2dMaxWidth || height > pOpenCL->info.image2dMaxHeight)) error = "2D image larger than " + ofToString(pOpenCL->info.image2dMaxWidth) + "x" + ofToString(pOpenCL->info.image2dMaxHeight);
+			else if(depth > 1 && (width > pOpenCL->info.image3dMaxWidth || height > pOpenCL->info.image3dMaxHeight || depth > pOpenCL->info.image3dMaxDepth)) error = "3D image larger than " + ofToString(pOpenCL->info.image3dMaxWidth) + "x" + ofToString(pOpenCL->info.image3dMaxHeight) + "x" + ofToString(pOpenCL->info.image3dMaxDepth);
+		}
+		if(width <= 0 || height <= 0) error = "image size must be at least 1x1";
+		
+		// pitches only describe host memory, so must be 0 without it
+		if(dataPtr == NULL && (rowPitch || slicePitch)) {
+			ofLog(OF_LOG_WARNING, "OpenCLImage::initWithoutTexture - ignoring pitch without dataPtr");
+			rowPitch	= 0;
+			slicePitch	= 0;
+		}
+		if(depth == 1 && slicePitch) error = "slicePitch must be 0 for 2D images";
+		
+		size_t fullRegion[3] = { (size_t)width, (size_t)height, (size_t)depth };
+		if(error.empty() && !validatePitch(fullRegion, rowPitch, slicePitch)) return false;
+		
+		if(!error.empty()) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::initWithoutTexture " + ofToString(width) + ", " + ofToString(height) + ", " + ofToString(depth) + " - " + error);
+			assert(false);
+			return false;
+		}
+		return true;
+	}
+	
+	
+	bool OpenCLImage::validatePitch(size_t *pRegion, size_t rowPitch, size_t slicePitch) {
+		size_t rowBytes = pRegion[0] * getBytesPerPixel();
+		size_t minSlicePitch = (rowPitch ? rowPitch : rowBytes) * pRegion[1];
+		
+		string error;
+		if(rowPitch && rowPitch < rowBytes) error = "rowPitch " + ofToString(rowPitch) + " is less than a row (" + ofToString(rowBytes) + " bytes)";
+		else if(slicePitch && slicePitch < minSlicePitch) error = "slicePitch " + ofToString(slicePitch) + " is less than a slice (" + ofToString(minSlicePitch) + " bytes)";
+		
+		if(!error.empty()) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage - " + error);
+			assert(false);
+			return false;
+		}
+		return true;
+	}
+	
+	
+	size_t OpenCLImage::getRowPitch() {
+		size_t pitch = 0;
+		if(clMemObject && (memFlags & CL_MEM_USE_HOST_PTR)) clGetImageInfo(clMemObject, CL_IMAGE_ROW_PITCH, sizeof(pitch), &pitch, NULL);
+		return pitch;
+	}
+	
+	
+	size_t OpenCLImage::getSlicePitch() {
+		size_t pitch = 0;
+		if(clMemObject && (memFlags & CL_MEM_USE_HOST_PTR) && depth > 1) clGetImageInfo(clMemObject, CL_IMAGE_SLICE_PITCH, sizeof(pitch), &pitch, NULL);
+		return pitch;
+	}
+	
+	
+	void OpenCLImage::createImage(void *dataPtr, size_t rowPitch, size_t slicePitch) {
+		cl_int err;
 		if(depth == 1) {
-			clMemObject = clCreateImage2D(pOpenCL->getContext(), memFlags, &imageFormat, width, height, image_row_pitch, memFlags & CL_MEM_USE_HOST_PTR ? dataPtr : NULL, &err);
+			clMemObject = clCreateImage2D(pOpenCL->getContext(), memFlags, &imageFormat, width, height, rowPitch, memFlags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR) ? dataPtr : NULL, &err);
 		} else {
-			clMemObject = clCreateImage3D(pOpenCL->getContext(), memFlags, &imageFormat, width, height, depth, image_row_pitch, image_slice_pitch, memFlags & CL_MEM_USE_HOST_PTR ? dataPtr : NULL, &err);
+			clMemObject = clCreateImage3D(pOpenCL->getContext(), memFlags, &imageFormat, width, height, depth, rowPitch, slicePitch, memFlags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR) ? dataPtr : NULL, &err);
 		}
 		assert(err != CL_INVALID_CONTEXT);
 		assert(err != CL_INVALID_VALUE);
@@ -49,12 +257,7 @@ namespace msa {
 		assert(err == CL_SUCCESS);
 		assert(clMemObject);
 		
-		if(dataPtr) {
-			write(dataPtr, blockingWrite);
-		}
-		
-		if(texture) delete texture;
-		texture = NULL;
+		updateImageFormat();
 	}
 	
 	
@@ -70,6 +273,9 @@ namespace msa {
 		
 		cl_int err;
 		if(clMemObject) clReleaseMemObject(clMemObject);
+		clMemObject = NULL;
+		releaseView();
+		this->memFlags = memFlags;
 		
 		clMemObject = clCreateFromGLTexture2D(pOpenCL->getContext(), memFlags, tex.getTextureData().textureTarget, mipLevel, tex.getTextureData().textureID, &err);
 		assert(err != CL_INVALID_CONTEXT);
@@ -81,10 +287,173 @@ namespace msa {
 		assert(err == CL_SUCCESS);
 		assert(clMemObject);
 		
+		updateImageFormat();
+		
+		// size of the mip level (and the actual texture size, if it's padded to a power of 2)
+		size_t w = 0, h = 0;
+		clGetImageInfo(clMemObject, CL_IMAGE_WIDTH, sizeof(w), &w, NULL);
+		clGetImageInfo(clMemObject, CL_IMAGE_HEIGHT, sizeof(h), &h, NULL);
+		if(w && h) {
+			width		= region[0] = w;
+			height		= region[1] = h;
+		}
+		
 		texture = &tex;
+		
+		memoryTag = OPENCL_MEMORY_GL_SHARED;
+		didAllocate();
+	}
+	
+	
+	
+	
+	void OpenCLImage::initFromBuffer(OpenCLBuffer &buffer,
+									 int w,
+									 int h,
+									 cl_channel_order imageChannelOrder,
+									 cl_channel_type imageChannelDataType,
+									 cl_mem_flags memFlags,
+									 size_t rowPitch)
+	{
+		ofLog(OF_LOG_VERBOSE, "OpenCLImage::initFromBuffer");
+		
+		init(w, h, 1);
+		
+		if(clMemObject) clReleaseMemObject(clMemObject);
+		clMemObject = NULL;
+		releaseView();
+		
+		imageFormat.image_channel_order		= imageChannelOrder;
+		imageFormat.image_channel_data_type	= imageChannelDataType;
+		this->memFlags = memFlags;
+		memoryTag = OPENCL_MEMORY_IMAGE;
+		
+#ifdef CL_VERSION_1_2
+		if(!pOpenCL->isDeviceVersionAtLeast(1, 2)) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::initFromBuffer - needs an OpenCL 1.2 device");
+			return;
+		}
+		
+		bool is2D = h > 1;
+		if(is2D && !pOpenCL->isDeviceVersionAtLeast(2, 0) && !pOpenCL->hasExtension("cl_khr_image2d_from_buffer")) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::initFromBuffer - 2D images from buffers need OpenCL 2.0 or cl_khr_image2d_from_buffer");
+			return;
+		}
+		
+		size_t numBytes = (is2D ? (rowPitch ? rowPitch : w * getBytesPerPixel()) * h : w * getBytesPerPixel());
+		if(numBytes > buffer.getSize()) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::initFromBuffer - buffer is too small (" + ofToString(buffer.getSize()) + " bytes, " + ofToString(numBytes) + " needed)");
+			assert(false);
+			return;
+		}
+		
+		cl_image_desc desc;
+		memset(&desc, 0, sizeof(desc));
+		desc.image_type			= is2D ? CL_MEM_OBJECT_IMAGE2D : CL_MEM_OBJECT_IMAGE1D_BUFFER;
+		desc.image_width		= w;
+		desc.image_height		= is2D ? h : 0;
+		desc.image_row_pitch	= is2D ? rowPitch : 0;
+		desc.buffer				= buffer.getResidentCLMem();		// pinned below, for as long as this views it
+		
+		cl_int err;
+		clMemObject = clCreateImage(pOpenCL->getContext(), memFlags, &imageFormat, &desc, NULL, &err);
+		if(err != CL_SUCCESS || clMemObject == NULL) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::initFromBuffer - error " + ofToString(err) + " creating image (row pitch may need to be a multiple of CL_DEVICE_IMAGE_PITCH_ALIGNMENT)");
+			assert(false);
+			clMemObject = NULL;
+			return;
+		}
+		
+		updateImageFormat();
+		
+		viewedBuffer = &buffer;
+		viewedBuffer->pin();
+#else
+		ofLog(OF_LOG_ERROR, "OpenCLImage::initFromBuffer - needs to be compiled with OpenCL 1.2 headers");
+#endif
+		updateResidentSize();		// nothing of its own (the buffer owns the memory)
+		
+		if(texture) delete texture;
+		texture = NULL;
 	}
 	
 	
+	int OpenCLImage::buildPyramid(int numLevels, OpenCLPyramidFilter filter) {
+		switch(imageFormat.image_channel_data_type) {
+			case CL_SIGNED_INT8:
+			case CL_SIGNED_INT16:
+			case CL_SIGNED_INT32:
+			case CL_UNSIGNED_INT8:
+			case CL_UNSIGNED_INT16:
+			case CL_UNSIGNED_INT32:
+				ofLog(OF_LOG_ERROR, "OpenCLImage::buildPyramid - only for float and normalized images");
+				assert(false);
+				return 0;
+		}
+		
+		if(depth != 1) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::buildPyramid - only for 2D images");
+			assert(false);
+			return 0;
+		}
+		
+		int maxLevels = 1;
+		while((width >> maxLevels) > 0 || (height >> maxLevels) > 0) maxLevels++;
+		if(numLevels <= 0 || numLevels > maxLevels) numLevels = maxLevels;
+		
+		if(pyramid.size() != numLevels - 1) {
+			clearPyramid();
+			
+			bool useMipLevels = texture && texture->getTextureData().textureTarget == GL_TEXTURE_2D;
+			if(texture && !useMipLevels) ofLog(OF_LOG_WARNING, "OpenCLImage::buildPyramid - rectangle textures can't have mip levels, using separate images");
+			
+			if(useMipLevels) {
+				// allocate the mip levels of the texture
+				ofTextureData &texData = texture->getTextureData();
+				glBindTexture(texData.textureTarget, texData.textureID);
+				for(int i=1; i<numLevels; i++) {
+					glTexImage2D(texData.textureTarget, i, texData.glTypeInternal, max(1, width >> i), max(1, height >> i), 0, texData.glType, texData.pixelType, NULL);
+				}
+				glTexParameteri(texData.textureTarget, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+				glTexParameteri(texData.textureTarget, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+				glBindTexture(texData.textureTarget, 0);
+			}
+			
+			for(int i=1; i<numLevels; i++) {
+				OpenCLImage *level = new OpenCLImage();
+				if(useMipLevels) level->initFromTexture(*texture, memFlags, i);
+				else level->initWithoutTexture(max(1, width >> i), max(1, height >> i), 1, imageFormat.image_channel_order, imageFormat.image_channel_data_type, CL_MEM_READ_WRITE);
+				level->setLabel(label + " pyramid level " + ofToString(i));
+				pyramid.push_back(level);
+			}
+		}
+		
+		OpenCLKernel *kernel = pOpenCL->loadBuiltinKernel(filter == OPENCL_PYRAMID_GAUSSIAN ? "msa_downsample_gaussian" : "msa_downsample_box", "MSAOpenCLImagePyramid", pyramidSource);
+		for(int i=1; i<numLevels; i++) {
+			OpenCLImage &src = getPyramidLevel(i - 1);
+			OpenCLImage &dst = getPyramidLevel(i);
+			kernel->setArg(0, src, CL_MEM_READ_ONLY);
+			kernel->setArg(1, dst, CL_MEM_WRITE_ONLY);
+			kernel->run2D(dst.getWidth(), dst.getHeight());
+		}
+		
+		return numLevels;
+	}
+	
+	
+	void OpenCLImage::clearPyramid() {
+		for(int i=0; i<pyramid.size(); i++) {
+			pyramid[i]->texture = NULL;		// mip levels share our texture
+			delete pyramid[i];
+		}
+		pyramid.clear();
+	}
+	
+	
+	void OpenCLImage::releaseView() {
+		if(viewedBuffer) viewedBuffer->unpin();
+		viewedBuffer = NULL;
+	}
 	
 	
 	void OpenCLImage::initWithTexture(int w,
@@ -112,6 +481,8 @@ namespace msa {
 		this->height		= h;
 		this->depth			= d;
 		
+		clearPyramid();
+		
 		origin[0] = 0; 
 		origin[1] = 0;
 		origin[2] = 0;
@@ -125,10 +496,57 @@ namespace msa {
 		memoryObjectInit();
 	}
 	
+	void OpenCLImage::updateImageFormat() {
+		cl_int err = clGetImageInfo(clMemObject, CL_IMAGE_FORMAT, sizeof(imageFormat), &imageFormat, NULL);
+		assert(err == CL_SUCCESS);
+	}
+	
+	
+	int OpenCLImage::getNumChannels() {
+		switch(imageFormat.image_channel_order) {
+			case CL_R:
+			case CL_A:
+			case CL_INTENSITY:
+			case CL_LUMINANCE:
+				return 1;
+			case CL_RG:
+			case CL_RA:
+				return 2;
+			case CL_RGB:
+				return 3;
+			default:
+				return 4;
+		}
+	}
+	
+	
+	int OpenCLImage::getBytesPerPixel() {
+		switch(imageFormat.image_channel_data_type) {
+			case CL_UNORM_SHORT_565:
+			case CL_UNORM_SHORT_555:
+				return 2;
+			case CL_UNORM_INT_101010:
+				return 4;
+			case CL_SNORM_INT8:
+			case CL_UNORM_INT8:
+			case CL_SIGNED_INT8:
+			case CL_UNSIGNED_INT8:
+				return getNumChannels();
+			case CL_SNORM_INT16:
+			case CL_UNORM_INT16:
+			case CL_SIGNED_INT16:
+			case CL_UNSIGNED_INT16:
+			case CL_HALF_FLOAT:
+				return getNumChannels() * 2;
+			default:
+				return getNumChannels() * 4;
+		}
+	}
+	
+	
 	void OpenCLImage::reset() {
 		ofLog(OF_LOG_VERBOSE, "OpenCLImage::reset()");
-		int numElements = width * height * 4; // TODO, make real
-		if(texture->getTextureData().pixelType == GL_FLOAT) numElements *= sizeof(cl_float);
+		int numElements = width * height * depth * getBytesPerPixel();
 		char *data = new char[numElements];
 		memset(data, 0, numElements);
 		write(data, true);
@@ -139,8 +557,9 @@ namespace msa {
 	void OpenCLImage::read(void *dataPtr, bool blockingRead, size_t *pOrigin, size_t *pRegion, size_t rowPitch, size_t slicePitch) {
 		if(pOrigin == NULL) pOrigin = origin;
 		if(pRegion == NULL) pRegion = region;
+		if((rowPitch || slicePitch) && !validatePitch(pRegion, rowPitch, slicePitch)) return;
 		
-		cl_int err = clEnqueueReadImage(pOpenCL->getQueue(), clMemObject, blockingRead, pOrigin, pRegion, rowPitch, slicePitch, dataPtr, 0, NULL, NULL);
+		cl_int err = clEnqueueReadImage(pOpenCL->getQueue(), getResidentCLMem(), blockingRead, pOrigin, pRegion, rowPitch, slicePitch, dataPtr, 0, NULL, NULL);
 		assert(err == CL_SUCCESS);
 	}
 	
@@ -148,21 +567,295 @@ namespace msa {
 	void OpenCLImage::write(void *dataPtr, bool blockingWrite, size_t *pOrigin, size_t *pRegion, size_t rowPitch, size_t slicePitch) {
 		if(pOrigin == NULL) pOrigin = origin;
 		if(pRegion == NULL) pRegion = region;
+		if((rowPitch || slicePitch) && !validatePitch(pRegion, rowPitch, slicePitch)) return;
 		
-		cl_int err = clEnqueueWriteImage(pOpenCL->getQueue(), clMemObject, blockingWrite, pOrigin, pRegion, rowPitch, slicePitch, dataPtr, 0, NULL, NULL);
+		cl_int err = clEnqueueWriteImage(pOpenCL->getQueue(), getResidentCLMem(), blockingWrite, pOrigin, pRegion, rowPitch, slicePitch, dataPtr, 0, NULL, NULL);
 		assert(err == CL_SUCCESS);
 	}
 	
+	void OpenCLImage::writeFloats(const float *dataPtr, bool blockingWrite, size_t *pOrigin, size_t *pRegion) {
+		if(imageFormat.image_channel_data_type == CL_FLOAT) {
+			write((void*)dataPtr, blockingWrite, pOrigin, pRegion);
+			return;
+		}
+		
+		if(imageFormat.image_channel_data_type != CL_HALF_FLOAT) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::writeFloats - only for CL_FLOAT and CL_HALF_FLOAT images");
+			assert(false);
+			return;
+		}
+		
+		if(pOrigin == NULL) pOrigin = origin;
+		if(pRegion == NULL) pRegion = region;
+		
+		waitForHalfStaging();
+		
+		int numElements = pRegion[0] * pRegion[1] * pRegion[2] * getNumChannels();
+		if(halfStaging.size() < numElements) halfStaging.resize(numElements);
+		floatToHalf(dataPtr, &halfStaging[0], numElements);
+		
+		cl_int err = clEnqueueWriteImage(pOpenCL->getQueue(), getResidentCLMem(), blockingWrite, pOrigin, pRegion, 0, 0, &halfStaging[0], 0, NULL, blockingWrite ? NULL : &halfStagingEvent);
+		assert(err == CL_SUCCESS);
+	}
+	
+	
+	void OpenCLImage::readFloats(float *dataPtr, size_t *pOrigin, size_t *pRegion) {
+		if(imageFormat.image_channel_data_type == CL_FLOAT) {
+			read(dataPtr, CL_TRUE, pOrigin, pRegion);
+			return;
+		}
+		
+		if(imageFormat.image_channel_data_type != CL_HALF_FLOAT) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::readFloats - only for CL_FLOAT and CL_HALF_FLOAT images");
+			assert(false);
+			return;
+		}
+		
+		if(pOrigin == NULL) pOrigin = origin;
+		if(pRegion == NULL) pRegion = region;
+		
+		waitForHalfStaging();
+		
+		int numElements = pRegion[0] * pRegion[1] * pRegion[2] * getNumChannels();
+		if(halfStaging.size() < numElements) halfStaging.resize(numElements);
+		read(&halfStaging[0], CL_TRUE, pOrigin, pRegion);
+		
+		halfToFloat(&halfStaging[0], dataPtr, numElements);
+	}
+	
+	
+	void OpenCLImage::waitForHalfStaging() {
+		if(halfStagingEvent == NULL) return;
+		clWaitForEvents(1, &halfStagingEvent);
+		clReleaseEvent(halfStagingEvent);
+		halfStagingEvent = NULL;
+	}
+	
+	
 	void OpenCLImage::copyFrom(OpenCLImage &srcImage, size_t *pSrcOrigin, size_t *pDstOrigin, size_t *pRegion) {
 		if(pSrcOrigin == NULL) pSrcOrigin = origin;
 		if(pDstOrigin == NULL) pDstOrigin = origin;
 		if(pRegion == NULL) pRegion = region;
 		
-		cl_int err = clEnqueueCopyImage(pOpenCL->getQueue(), srcImage.getCLMem(), clMemObject, pSrcOrigin, pDstOrigin, pRegion, 0, NULL, NULL);
+		cl_mem dst = getResidentCLMem();
+		pinCount++;		// so that restoring srcImage can't evict this
+		cl_mem src = srcImage.getResidentCLMem();
+		pinCount--;
+		
+		cl_int err = clEnqueueCopyImage(pOpenCL->getQueue(), src, dst, pSrcOrigin, pDstOrigin, pRegion, 0, NULL, NULL);
+		assert(err == CL_SUCCESS);
+	}
+	
+	
+	
+	void OpenCLImage::writeFromPixels(const unsigned char *pixels, OpenCLPixelFormat pixelFormat, bool blockingWrite, int rowPitch) {
+		int numBytes = preparePixelStaging(pixelFormat, rowPitch);
+		OpenCLKernel *kernel = loadPixelsKernel("msa_pixels_to_image");
+		if(numBytes == 0 || kernel == NULL) return;
+		
+		pixelStaging.write((void*)pixels, 0, numBytes, blockingWrite);
+		
+		cl_int format = pixelFormat;
+		cl_int pitch = rowPitch;
+		kernel->setArg(0, pixelStaging, CL_MEM_READ_ONLY);
+		kernel->setArg(1, *this, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, format);
+		kernel->setArg(3, pitch);
+		kernel->run2D(width, height);
+	}
+	
+	
+	void OpenCLImage::readToPixels(unsigned char *pixels, OpenCLPixelFormat pixelFormat, int rowPitch) {
+		int numBytes = preparePixelStaging(pixelFormat, rowPitch);
+		OpenCLKernel *kernel = loadPixelsKernel("msa_image_to_pixels");
+		if(numBytes == 0 || kernel == NULL) return;
+		
+		cl_int format = pixelFormat;
+		cl_int pitch = rowPitch;
+		cl_int isSingleChannel = getNumChannels() == 1;
+		kernel->setArg(0, *this, CL_MEM_READ_ONLY);
+		kernel->setArg(1, pixelStaging, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, format);
+		kernel->setArg(3, pitch);
+		kernel->setArg(4, isSingleChannel);
+		kernel->run2D(width, height);
+		
+		pixelStaging.read(pixels, 0, numBytes, CL_TRUE);
+	}
+	
+	
+	void OpenCLImage::writeFromYUV(const unsigned char *frame, OpenCLYUVFormat yuvFormat, OpenCLYUVColorSpace colorSpace, bool fullRange, bool blockingWrite, int rowPitch) {
+		// with a padded Y plane, chroma rows are padded the same way
+		int uvRowPitch = 0;
+		if(rowPitch) uvRowPitch = yuvFormat == OPENCL_YUV_NV12 ? rowPitch : rowPitch / 2;
+		getYUVPitches(yuvFormat, rowPitch, uvRowPitch);
+		
+		const unsigned char *uPlane = frame + rowPitch * height;
+		const unsigned char *vPlane = uPlane + uvRowPitch * ((height + 1) / 2);
+		writeFromYUVPlanes(frame, uPlane, vPlane, yuvFormat, colorSpace, fullRange, blockingWrite, rowPitch, uvRowPitch);
+	}
+	
+	
+	void OpenCLImage::writeFromYUVPlanes(const unsigned char *yPlane, const unsigned char *uPlane, const unsigned char *vPlane, OpenCLYUVFormat yuvFormat, OpenCLYUVColorSpace colorSpace, bool fullRange, bool blockingWrite, int yRowPitch, int uvRowPitch) {
+		getYUVPitches(yuvFormat, yRowPitch, uvRowPitch);
+		
+		int chromaWidth		= (width + 1) / 2;
+		int chromaHeight	= (height + 1) / 2;
+		int yRowBytes		= yuvFormat == OPENCL_YUV_YUYV ? chromaWidth * 4 : width;
+		int uvRowBytes		= yuvFormat == OPENCL_YUV_NV12 ? chromaWidth * 2 : chromaWidth;
+		
+		// planes are staged one after the other, keeping their pitch (the last row of each doesn't need its padding)
+		int yBytes		= yRowPitch * (height - 1) + yRowBytes;
+		int uvBytes		= uvRowPitch * (chromaHeight - 1) + uvRowBytes;
+		int uOffset		= yRowPitch * height;
+		int vOffset		= uOffset + uvRowPitch * chromaHeight;
+		
+		int numBytes = yBytes;
+		if(yuvFormat == OPENCL_YUV_NV12) numBytes = uOffset + uvBytes;
+		else if(yuvFormat == OPENCL_YUV_I420) numBytes = vOffset + uvBytes;
+		
+		OpenCLKernel *kernel = loadPixelsKernel("msa_yuv_to_image");
+		if(!reservePixelStaging(numBytes) || kernel == NULL) return;
+		
+		bool isPlanar = yuvFormat != OPENCL_YUV_YUYV;
+		pixelStaging.write((void*)yPlane, 0, yBytes, blockingWrite && !isPlanar);
+		if(isPlanar) pixelStaging.write((void*)uPlane, uOffset, uvBytes, blockingWrite && yuvFormat == OPENCL_YUV_NV12);
+		if(yuvFormat == OPENCL_YUV_I420) pixelStaging.write((void*)vPlane, vOffset, uvBytes, blockingWrite);
+		
+		// Kr and Kb for each color space
+		float kr = colorSpace == OPENCL_YUV_BT709 ? 0.2126f : 0.299f;
+		float kb = colorSpace == OPENCL_YUV_BT709 ? 0.0722f : 0.114f;
+		float kg = 1.0f - kr - kb;
+		
+		cl_float4 coeffs;
+		coeffs.s[0]	= 2.0f * (1.0f - kr);
+		coeffs.s[1]	= 2.0f * kb * (1.0f - kb) / kg;
+		coeffs.s[2]	= 2.0f * kr * (1.0f - kr) / kg;
+		coeffs.s[3]	= 2.0f * (1.0f - kb);
+		
+		cl_float4 range;
+		range.s[0]	= fullRange ? 0.0f : 16.0f;
+		range.s[1]	= fullRange ? 1.0f / 255.0f : 1.0f / 219.0f;
+		range.s[2]	= fullRange ? 1.0f / 255.0f : 1.0f / 224.0f;
+		range.s[3]	= 0.0f;
+		
+		cl_int format = yuvFormat;
+		kernel->setArg(0, pixelStaging, CL_MEM_READ_ONLY);
+		kernel->setArg(1, *this, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, format);
+		kernel->setArg(3, yRowPitch);
+		kernel->setArg(4, uvRowPitch);
+		kernel->setArg(5, uOffset);
+		kernel->setArg(6, vOffset);
+		kernel->setArg(7, coeffs);
+		kernel->setArg(8, range);
+		kernel->run2D(width, height);
+	}
+	
+	
+	void OpenCLImage::getYUVPitches(OpenCLYUVFormat yuvFormat, int &yRowPitch, int &uvRowPitch) {
+		int chromaWidth = (width + 1) / 2;
+		switch(yuvFormat) {
+			case OPENCL_YUV_NV12:
+				if(yRowPitch == 0) yRowPitch = width;
+				if(uvRowPitch == 0) uvRowPitch = chromaWidth * 2;
+				break;
+			case OPENCL_YUV_I420:
+				if(yRowPitch == 0) yRowPitch = width;
+				if(uvRowPitch == 0) uvRowPitch = chromaWidth;
+				break;
+			case OPENCL_YUV_YUYV:
+				if(yRowPitch == 0) yRowPitch = chromaWidth * 4;
+				break;
+		}
+	}
+	
+	
+	int OpenCLImage::preparePixelStaging(OpenCLPixelFormat pixelFormat, int &rowPitch) {
+		int rowBytes = width * getPixelFormatBytes(pixelFormat);
+		if(rowPitch == 0) rowPitch = rowBytes;
+		assert(rowPitch >= rowBytes);
+		
+		// the last row doesn't need its padding
+		int numBytes = rowPitch * (height - 1) + rowBytes;
+		return reservePixelStaging(numBytes) ? numBytes : 0;
+	}
+	
+	
+	bool OpenCLImage::reservePixelStaging(int numBytes) {
+		if(depth != 1) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::writeFromPixels / readToPixels / writeFromYUV - only for 2D images");
+			assert(false);
+			return false;
+		}
+		
+		if(pixelStaging.getCapacity() < numBytes) {
+			pixelStaging.initBuffer(numBytes, CL_MEM_READ_WRITE);
+			pixelStaging.setLabel("OpenCLImage pixel staging");
+		}
+		return true;
+	}
+	
+	
+	OpenCLKernel *OpenCLImage::loadPixelsKernel(string kernelName) {
+		switch(imageFormat.image_channel_data_type) {
+			case CL_UNSIGNED_INT8:
+			case CL_UNSIGNED_INT16:
+			case CL_UNSIGNED_INT32:
+				return pOpenCL->loadBuiltinKernel(kernelName, "MSAOpenCLImagePixelsInt", "#define MSA_INTEGER_IMAGE 1\n" + pixelsSourceHeader + pixelsSource);
+			case CL_SIGNED_INT8:
+			case CL_SIGNED_INT16:
+			case CL_SIGNED_INT32:
+				ofLog(OF_LOG_ERROR, "OpenCLImage::writeFromPixels / readToPixels - signed integer images are not supported");
+				assert(false);
+				return NULL;
+			default:
+				return pOpenCL->loadBuiltinKernel(kernelName, "MSAOpenCLImagePixels", "#define MSA_INTEGER_IMAGE 0\n" + pixelsSourceHeader + pixelsSource);
+		}
+	}
+	
+	
+	void OpenCLImage::copyFrom(OpenCLBuffer &srcBuffer, size_t srcOffsetBytes, size_t *pDstOrigin, size_t *pRegion) {
+		if(pDstOrigin == NULL) pDstOrigin = origin;
+		if(pRegion == NULL) pRegion = region;
+		
+		cl_mem dst = getResidentCLMem();
+		pinCount++;		// so that restoring srcBuffer can't evict this
+		cl_mem src = srcBuffer.getResidentCLMem();
+		pinCount--;
+		
+		cl_int err = clEnqueueCopyBufferToImage(pOpenCL->getQueue(), src, dst, srcOffsetBytes, pDstOrigin, pRegion, 0, NULL, NULL);
 		assert(err == CL_SUCCESS);
 	}
 	
 	
+	bool OpenCLImage::canEvict() {
+		return texture == NULL && viewedBuffer == NULL && clMemObject && !(memFlags & CL_MEM_USE_HOST_PTR);
+	}
+	
+	
+	void OpenCLImage::evict() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLImage::evict " + ofToString(getSizeInBytes()) + " bytes");
+		
+		evictedData.resize(getSizeInBytes());
+		cl_int err = clEnqueueReadImage(pOpenCL->getQueue(), clMemObject, CL_TRUE, origin, region, 0, 0, &evictedData[0], 0, NULL, NULL);
+		assert(err == CL_SUCCESS);
+		
+		clReleaseMemObject(clMemObject);
+		clMemObject = NULL;
+	}
+	
+	
+	void OpenCLImage::restore() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLImage::restore " + ofToString(getSizeInBytes()) + " bytes");
+		
+		memFlags &= ~CL_MEM_COPY_HOST_PTR;
+		createImage(NULL, 0, 0);
+		
+		cl_int err = clEnqueueWriteImage(pOpenCL->getQueue(), clMemObject, CL_TRUE, origin, region, 0, 0, &evictedData[0], 0, NULL, NULL);
+		assert(err == CL_SUCCESS);
+	}
+	
 	
 	ofTexture &OpenCLImage::getTexture() {
 		return *texture;
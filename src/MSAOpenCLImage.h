@@ -17,21 +17,55 @@
 #include "ofMain.h"
 #include <OpenCL/Opencl.h>
 #include "MSAOpenCLMemoryObject.h"
+#include "MSAOpenCLBuffer.h"
+#include "MSAOpenCLHalf.h"
 
 
 namespace msa { 
 	
+	// layout of 8 bit per channel pixels in main memory, for OpenCLImage::writeFromPixels / readToPixels
+	enum OpenCLPixelFormat {
+		OPENCL_PIXELS_GRAY,
+		OPENCL_PIXELS_RGB,
+		OPENCL_PIXELS_BGR,
+		OPENCL_PIXELS_RGBA,
+		OPENCL_PIXELS_BGRA
+	};
+	
+	// downsampling filter for OpenCLImage::buildPyramid
+	enum OpenCLPyramidFilter {
+		OPENCL_PYRAMID_BOX,			// average of 2x2 pixels
+		OPENCL_PYRAMID_GAUSSIAN		// 5x5 binomial (1 4 6 4 1), smoother
+	};
+	
+	// layout of YUV frames in main memory, for OpenCLImage::writeFromYUV
+	enum OpenCLYUVFormat {
+		OPENCL_YUV_NV12,		// 4:2:0, Y plane followed by interleaved UV plane
+		OPENCL_YUV_I420,		// 4:2:0, Y plane followed by U plane and V plane
+		OPENCL_YUV_YUYV			// 4:2:2, packed Y0 U Y1 V
+	};
+	
+	enum OpenCLYUVColorSpace {
+		OPENCL_YUV_BT601,		// SD
+		OPENCL_YUV_BT709		// HD
+	};
+	
 	class OpenCLImage : public OpenCLMemoryObject
 //	, public ofBaseDraws
 	{
 	public:
 		
 		OpenCLImage();
+		~OpenCLImage();
 		
 		
 		// create an Image with given properties
 		// Image is not linked to an OpenGL texture
 		// for 2D image, leave depth as 1
+		// use CL_HALF_FLOAT as imageChannelDataType for half precision storage (and see writeFloats / readFloats)
+		// rowPitch and slicePitch (in bytes) describe the layout of dataPtr, 0 for tightly packed
+		// with CL_MEM_USE_HOST_PTR the image uses dataPtr directly, so e.g. padded capture buffers can be wrapped without copying
+		// the size (and pitch) is checked against the device limits first
 		// parameters with default values can be omited
 		void initWithoutTexture(int width,
 								int height,
@@ -40,7 +74,23 @@ namespace msa {
 								cl_channel_type imageChannelDataType = CL_FLOAT,
 								cl_mem_flags memFlags = CL_MEM_READ_WRITE,
 								void *dataPtr = NULL,
-								bool blockingWrite = CL_FALSE);
+								bool blockingWrite = CL_FALSE,
+								size_t rowPitch = 0,
+								size_t slicePitch = 0);
+		
+		
+		// create an Image which views the memory of buffer (they share memory space on device, no copies)
+		// height 1 creates an image1d_buffer_t, otherwise an image2d_t (rows rowPitch bytes apart, 0 for tightly packed)
+		// needs OpenCL 1.2 (and for 2D, OpenCL 2.0 or the cl_khr_image2d_from_buffer extension)
+		// buffer must outlive the image, and mustn't be resized while viewed (it's pinned so it's never evicted)
+		// parameters with default values can be omited
+		void initFromBuffer(OpenCLBuffer &buffer,
+							int width,
+							int height = 1,
+							cl_channel_order imageChannelOrder = CL_RGBA,
+							cl_channel_type imageChannelDataType = CL_FLOAT,
+							cl_mem_flags memFlags = CL_MEM_READ_WRITE,
+							size_t rowPitch = 0);
 		
 		
 		// create a 2D Image from the ofTexture passed in (they share memory space on device)
@@ -63,6 +113,7 @@ namespace msa {
 		
 		// read from device memory, into main memoy (into dataPtr)
 		// if origin and/or region is NULL, entire image is read
+		// rowPitch and slicePitch (in bytes) describe the layout of dataPtr, 0 for tightly packed
 		void read(void *dataPtr,
 				  bool blockingRead = CL_TRUE,
 				  size_t *pOrigin = NULL,
@@ -72,6 +123,7 @@ namespace msa {
 		
 		// write from main memory (dataPtr), into device memory
 		// if origin and/or region is NULL, entire image is written
+		// rowPitch and slicePitch (in bytes) describe the layout of dataPtr, 0 for tightly packed (e.g. 64 byte aligned rows from a capture API can be written as they are)
 		void write(void *dataPtr,
 				   bool blockingWrite = CL_FALSE,
 				   size_t *pOrigin = NULL,
@@ -80,6 +132,77 @@ namespace msa {
 				   size_t slicePitch = 0);
 		
 		
+		// same as write, but always from floats
+		// if the image stores CL_HALF_FLOAT, the data is converted to half on the host first (see MSAOpenCLHalf.h)
+		// only for CL_FLOAT and CL_HALF_FLOAT images
+		void writeFloats(const float *dataPtr,
+						 bool blockingWrite = CL_FALSE,
+						 size_t *pOrigin = NULL,
+						 size_t *pRegion = NULL);
+		
+		// same as read, but always into floats (converted from half for CL_HALF_FLOAT images)
+		// this is always blocking
+		void readFloats(float *dataPtr,
+						size_t *pOrigin = NULL,
+						size_t *pRegion = NULL);
+		
+		
+		// write 8 bit pixels (e.g. from a camera) of any OpenCLPixelFormat, converted on the device
+		// packed pixels are uploaded as they are (so RGB is 25% less data than RGBA), and expanded by a built in kernel
+		// values are normalized (0...255 to 0...1) for float and normalized images, and written as they are for unsigned int images
+		// gray is written to all color channels, alpha is 255 when the pixels have none
+		// rowPitch is in bytes (0 for tightly packed rows)
+		// blockingWrite only affects the upload, the conversion is always queued
+		// only for 2D images
+		void writeFromPixels(const unsigned char *pixels,
+							 OpenCLPixelFormat pixelFormat,
+							 bool blockingWrite = CL_FALSE,
+							 int rowPitch = 0);
+		
+		// the reverse of writeFromPixels, values are clamped to 0...255
+		// gray is the luminance of the color channels (or the only channel of single channel images)
+		// this is always blocking
+		void readToPixels(unsigned char *pixels,
+						  OpenCLPixelFormat pixelFormat,
+						  int rowPitch = 0);
+		
+		
+		// write a YUV frame (e.g. from a capture card or video decoder), converted to RGB on the device
+		// frame is the whole frame with planes one after the other (as most APIs give them)
+		// fullRange is false for video levels (Y 16...235, UV 16...240) and true for 0...255 (e.g. JPEG)
+		// rowPitch is in bytes of the Y plane (or of the packed YUYV rows), 0 for tightly packed rows
+		// chroma planes have half the pitch of the Y plane for I420, and the same for NV12
+		// chroma is sampled from the nearest position, alpha is 1
+		// blockingWrite only affects the upload, the conversion is always queued
+		// only for 2D images
+		void writeFromYUV(const unsigned char *frame,
+						  OpenCLYUVFormat yuvFormat,
+						  OpenCLYUVColorSpace colorSpace = OPENCL_YUV_BT601,
+						  bool fullRange = false,
+						  bool blockingWrite = CL_FALSE,
+						  int rowPitch = 0);
+		
+		// same as above, with separate plane pointers and pitches (e.g. from a decoder)
+		// for NV12 uPlane is the interleaved UV plane and vPlane is ignored, for YUYV only yPlane is used
+		// uvRowPitch is in bytes, 0 for tightly packed rows
+		void writeFromYUVPlanes(const unsigned char *yPlane,
+								const unsigned char *uPlane,
+								const unsigned char *vPlane,
+								OpenCLYUVFormat yuvFormat,
+								OpenCLYUVColorSpace colorSpace = OPENCL_YUV_BT601,
+								bool fullRange = false,
+								bool blockingWrite = CL_FALSE,
+								int yRowPitch = 0,
+								int uvRowPitch = 0);
+		
+		
+		// copy data from a buffer in device memory (tightly packed pixels, in the image's format)
+		// if origin and/or region is NULL, entire image is written
+		void copyFrom(OpenCLBuffer &srcBuffer,
+					  size_t srcOffsetBytes = 0,
+					  size_t *pDstOrigin = NULL,
+					  size_t *pRegion = NULL);
+		
 		// copy data from another image in device memory
 		// if origin and/or region is NULL, entire image is written
 		void copyFrom(OpenCLImage &srcImage,
@@ -89,6 +212,46 @@ namespace msa {
 		
 		
 		
+		// build a chain of half resolution images from this one (on the device)
+		// numLevels includes this image (level 0), 0 for all levels down to 1x1
+		// if this image shares an OpenGL GL_TEXTURE_2D texture, its mip levels are allocated and filled (and mipmapping is enabled)
+		// otherwise (or for rectangle textures) levels are separate images
+		// level images are kept and reused while the number of levels stays the same, so it's cheap to call every frame
+		// only for float and normalized images (uses linear filtering)
+		// returns the number of levels
+		int buildPyramid(int numLevels = 0,
+						 OpenCLPyramidFilter filter = OPENCL_PYRAMID_BOX);
+		
+		int getNumPyramidLevels() {
+			return pyramid.size() + 1;
+		}
+		
+		// level 0 is this image
+		OpenCLImage &getPyramidLevel(int level) {
+			return level == 0 ? *this : *pyramid[level - 1];
+		}
+		
+		
+		// filters (see MSAOpenCLImageFilters.cpp), writing the filtered image into dst
+		// dst must be the same size as this image (and can be this image for gaussianBlur and boxBlur)
+		// temporary images are kept and reused, so they're cheap to call every frame
+		// only for 2D float and normalized images
+		
+		// separable gaussian blur, cost grows with sigma (radius is 3 * sigma)
+		void gaussianBlur(OpenCLImage &dst, float sigma);
+		
+		// box blur of (2 * radius + 1) x (2 * radius + 1) pixels, using running sums so cost doesn't depend on radius
+		void boxBlur(OpenCLImage &dst, int radius);
+		
+		// edge preserving blur, sigmaRange is in color units (0...1)
+		// cost grows with sigmaSpatial squared (radius is 2 * sigmaSpatial)
+		void bilateralFilter(OpenCLImage &dst, float sigmaSpatial, float sigmaRange);
+		
+		// sharpen by adding amount * (image - gaussianBlur(image, sigma))
+		// differences smaller than threshold are ignored (to avoid sharpening noise)
+		void unsharpMask(OpenCLImage &dst, float sigma, float amount = 1.0f, float threshold = 0.0f);
+		
+		
 		// return reference to related ofTexture
 		// this may be NULL if no ofTexture was setup
 		ofTexture &getTexture();
@@ -116,6 +279,31 @@ namespace msa {
 			return depth;
 		}
 		
+		cl_channel_order getChannelOrder() {
+			return imageFormat.image_channel_order;
+		}
+		
+		cl_channel_type getChannelDataType() {
+			return imageFormat.image_channel_data_type;
+		}
+		
+		int getNumChannels();
+		int getBytesPerPixel();
+		
+		// pitch of the image's host memory for CL_MEM_USE_HOST_PTR images (0 otherwise)
+		size_t getRowPitch();
+		size_t getSlicePitch();
+		
+		size_t getSizeInBytes() {
+			if(viewedBuffer) return 0;		// the buffer owns the memory
+			return (size_t)width * height * depth * getBytesPerPixel();
+		}
+		
+		// the buffer this image views (see initFromBuffer), or NULL
+		OpenCLBuffer *getViewedBuffer() {
+			return viewedBuffer;
+		}
+		
 		
 	protected:
 		int				width;
@@ -127,7 +315,39 @@ namespace msa {
 		
 		ofTexture		*texture;
 		
+		cl_image_format	imageFormat;
+		cl_mem_flags	memFlags;
+		
+		vector<cl_half>	halfStaging;			// converted data for writeFloats / readFloats
+		cl_event		halfStagingEvent;		// pending non-blocking write from halfStaging
+		
+		OpenCLBuffer	pixelStaging;			// packed pixels for writeFromPixels / readToPixels
+		OpenCLBuffer	*viewedBuffer;			// see initFromBuffer
+		vector<OpenCLImage*>	pyramid;		// levels 1 and up, see buildPyramid
+		
+		OpenCLImage		*filterTemp[2];			// intermediate images for filters
+		OpenCLBuffer	filterWeights;			// gaussian weights
+		float			filterWeightsSigma;		// sigma of the weights in filterWeights
+		
 		void init(int width, int height, int depth);
+		void releaseView();
+		void clearPyramid();
+		OpenCLImage &getFilterTemp(int i);
+		bool canFilter(OpenCLImage &dst);
+		int getFilterLocalMemSize();
+		void updateImageFormat();
+		void waitForHalfStaging();
+		void createImage(void *dataPtr, size_t rowPitch, size_t slicePitch);
+		bool validateSize(void *dataPtr, size_t &rowPitch, size_t &slicePitch);
+		bool validatePitch(size_t *pRegion, size_t rowPitch, size_t slicePitch);
+		OpenCLKernel *loadPixelsKernel(string kernelName);
+		int preparePixelStaging(OpenCLPixelFormat pixelFormat, int &rowPitch);
+		bool reservePixelStaging(int numBytes);
+		void getYUVPitches(OpenCLYUVFormat yuvFormat, int &yRowPitch, int &uvRowPitch);
+		
+		bool canEvict();
+		void evict();
+		void restore();
 		
 	};
 }
@@ -0,0 +1,350 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLImage.h"
+
+// OpenCLImage filters: gaussianBlur, boxBlur, bilateralFilter, unsharpMask
+
+namespace msa {
+
+	static const string filtersSource = MSA_OPENCL_SOURCE(
+		__constant sampler_t msaFilterSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+		// each work-group loads its rows plus radius pixels either side into local memory once
+		// tile is (get_local_size(0) + 2 * radius) x get_local_size(1) pixels
+		__kernel void msa_gaussian_h(__read_only image2d_t src, __write_only image2d_t dst, __constant float *weights, const int radius, __local float4 *tile) {
+			int lx			= get_local_id(0);
+			int groupWidth	= get_local_size(0);
+			int tileWidth	= groupWidth + 2 * radius;
+			int x0			= get_group_id(0) * groupWidth - radius;
+			int y			= get_global_id(1);
+			__local float4 *row = tile + get_local_id(1) * tileWidth;
+
+			for(int i = lx; i < tileWidth; i += groupWidth) row[i] = read_imagef(src, msaFilterSampler, (int2)(x0 + i, y));
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			float4 sum = (float4)(0.0f);
+			for(int k = 0; k <= 2 * radius; k++) sum += weights[k] * row[lx + k];
+
+			int2 pos = (int2)(get_global_id(0), y);
+			if(pos.x < get_image_width(dst) && pos.y < get_image_height(dst)) write_imagef(dst, pos, sum);
+		}
+
+		// same as above, vertically
+		// tile is get_local_size(0) x (get_local_size(1) + 2 * radius) pixels
+		__kernel void msa_gaussian_v(__read_only image2d_t src, __write_only image2d_t dst, __constant float *weights, const int radius, __local float4 *tile) {
+			int lx			= get_local_id(0);
+			int ly			= get_local_id(1);
+			int groupWidth	= get_local_size(0);
+			int groupHeight	= get_local_size(1);
+			int tileHeight	= groupHeight + 2 * radius;
+			int x			= get_global_id(0);
+			int y0			= get_group_id(1) * groupHeight - radius;
+
+			for(int i = ly; i < tileHeight; i += groupHeight) tile[i * groupWidth + lx] = read_imagef(src, msaFilterSampler, (int2)(x, y0 + i));
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			float4 sum = (float4)(0.0f);
+			for(int k = 0; k <= 2 * radius; k++) sum += weights[k] * tile[(ly + k) * groupWidth + lx];
+
+			int2 pos = (int2)(x, get_global_id(1));
+			if(pos.x < get_image_width(dst) && pos.y < get_image_height(dst)) write_imagef(dst, pos, sum);
+		}
+
+		// each work-item slides a running sum along segmentLength pixels of a row
+		// (work-items next to each other do the same segment of neighbouring rows)
+		__kernel void msa_boxblur_h(__read_only image2d_t src, __write_only image2d_t dst, const int radius, const int segmentLength) {
+			int y		= get_global_id(0);
+			int x0		= get_global_id(1) * segmentLength;
+			int width	= get_image_width(dst);
+			if(y >= get_image_height(dst) || x0 >= width) return;
+			int x1		= min(x0 + segmentLength, width);
+
+			float4 sum = (float4)(0.0f);
+			for(int k = -radius; k <= radius; k++) sum += read_imagef(src, msaFilterSampler, (int2)(x0 + k, y));
+
+			float scale = 1.0f / (2 * radius + 1);
+			for(int x = x0; x < x1; x++) {
+				write_imagef(dst, (int2)(x, y), sum * scale);
+				sum += read_imagef(src, msaFilterSampler, (int2)(x + radius + 1, y)) - read_imagef(src, msaFilterSampler, (int2)(x - radius, y));
+			}
+		}
+
+		// same as above, vertically
+		__kernel void msa_boxblur_v(__read_only image2d_t src, __write_only image2d_t dst, const int radius, const int segmentLength) {
+			int x		= get_global_id(0);
+			int y0		= get_global_id(1) * segmentLength;
+			int height	= get_image_height(dst);
+			if(x >= get_image_width(dst) || y0 >= height) return;
+			int y1		= min(y0 + segmentLength, height);
+
+			float4 sum = (float4)(0.0f);
+			for(int k = -radius; k <= radius; k++) sum += read_imagef(src, msaFilterSampler, (int2)(x, y0 + k));
+
+			float scale = 1.0f / (2 * radius + 1);
+			for(int y = y0; y < y1; y++) {
+				write_imagef(dst, (int2)(x, y), sum * scale);
+				sum += read_imagef(src, msaFilterSampler, (int2)(x, y + radius + 1)) - read_imagef(src, msaFilterSampler, (int2)(x, y - radius));
+			}
+		}
+
+		// tile is (get_local_size(0) + 2 * radius) x (get_local_size(1) + 2 * radius) pixels
+		// spatialScale = -1 / (2 * sigmaSpatial^2), rangeScale = -1 / (2 * sigmaRange^2)
+		__kernel void msa_bilateral(__read_only image2d_t src, __write_only image2d_t dst, const int radius, const float spatialScale, const float rangeScale, __local float4 *tile) {
+			int lx			= get_local_id(0);
+			int ly			= get_local_id(1);
+			int groupWidth	= get_local_size(0);
+			int groupHeight	= get_local_size(1);
+			int tileWidth	= groupWidth + 2 * radius;
+			int tileHeight	= groupHeight + 2 * radius;
+			int2 origin		= (int2)(get_group_id(0) * groupWidth - radius, get_group_id(1) * groupHeight - radius);
+
+			for(int j = ly; j < tileHeight; j += groupHeight) {
+				for(int i = lx; i < tileWidth; i += groupWidth) tile[j * tileWidth + i] = read_imagef(src, msaFilterSampler, origin + (int2)(i, j));
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			float4 center = tile[(ly + radius) * tileWidth + lx + radius];
+			float4 sum = (float4)(0.0f);
+			float weightSum = 0.0f;
+			for(int j = -radius; j <= radius; j++) {
+				for(int i = -radius; i <= radius; i++) {
+					float4 p = tile[(ly + radius + j) * tileWidth + lx + radius + i];
+					float3 d = p.xyz - center.xyz;
+					float w = exp((i * i + j * j) * spatialScale + dot(d, d) * rangeScale);
+					sum += w * p;
+					weightSum += w;
+				}
+			}
+
+			int2 pos = (int2)(get_global_id(0), get_global_id(1));
+			if(pos.x < get_image_width(dst) && pos.y < get_image_height(dst)) write_imagef(dst, pos, sum / weightSum);
+		}
+
+		__kernel void msa_unsharp(__read_only image2d_t src, __read_only image2d_t blurred, __write_only image2d_t dst, const float amount, const float threshold) {
+			int2 pos = (int2)(get_global_id(0), get_global_id(1));
+			float4 s = read_imagef(src, msaFilterSampler, pos);
+			float4 d = s - read_imagef(blurred, msaFilterSampler, pos);
+			d *= step(threshold, fabs(d));
+			float4 result = s + amount * d;
+			result.w = s.w;
+			write_imagef(dst, pos, result);
+		}
+	);
+
+
+	static OpenCLKernel *loadFilterKernel(OpenCL *pOpenCL, string kernelName) {
+		return pOpenCL->loadBuiltinKernel(kernelName, "MSAOpenCLImageFilters", filtersSource);
+	}
+
+	static size_t roundUp(size_t n, size_t multiple) {
+		return (n + multiple - 1) / multiple * multiple;
+	}
+
+	// largest power of two which is at most n (n >= 1)
+	static size_t floorPowerOfTwo(size_t n) {
+		while(n & (n - 1)) n &= n - 1;
+		return n;
+	}
+
+	// largest power of two work-group side, up to maxSide, which the kernels and the device allow in both dimensions
+	static size_t getGroupSide(OpenCL *pOpenCL, OpenCLKernel *kernel1, OpenCLKernel *kernel2, size_t maxSide) {
+		size_t side = min(maxSide, min(kernel1->getWorkGroupSize(), kernel2->getWorkGroupSize()));
+		side = min(side, min(pOpenCL->info.maxWorkItemSizes[0], pOpenCL->info.maxWorkItemSizes[1]));
+		return floorPowerOfTwo(max(side, (size_t)1));
+	}
+
+
+
+	void OpenCLImage::gaussianBlur(OpenCLImage &dst, float sigma) {
+		if(!canFilter(dst)) return;
+
+		OpenCLKernel *kernelH = loadFilterKernel(pOpenCL, "msa_gaussian_h");
+		OpenCLKernel *kernelV = loadFilterKernel(pOpenCL, "msa_gaussian_v");
+
+		// work-groups are up to 64 pixels along the blur (as the kernels and device allow) and up to 4 across, as long as the tile fits in local memory
+		size_t along		= getGroupSide(pOpenCL, kernelH, kernelV, 64);
+		int localMemSize	= getFilterLocalMemSize();
+		int radius			= ceil(sigma * 3.0f);
+		int maxRadius		= max(0, ((int)(localMemSize / sizeof(cl_float4)) - (int)along) / 2);
+		if(radius > maxRadius) {
+			ofLog(OF_LOG_WARNING, "OpenCLImage::gaussianBlur - sigma " + ofToString(sigma) + " is too large for local memory, clamping");
+			radius	= maxRadius;
+			sigma	= radius / 3.0f;
+		}
+
+		if(radius < 1) {
+			if(&dst != this) dst.copyFrom(*this);
+			return;
+		}
+
+		if(sigma != filterWeightsSigma) {
+			vector<float> weights(2 * radius + 1);
+			float sum = 0;
+			for(int i=0; i<weights.size(); i++) {
+				float x = i - radius;
+				weights[i] = exp(-x * x / (2 * sigma * sigma));
+				sum += weights[i];
+			}
+			for(int i=0; i<weights.size(); i++) weights[i] /= sum;
+
+			if(filterWeights.getCapacity() < weights.size() * sizeof(float)) filterWeights.initBuffer(weights.size() * sizeof(float), CL_MEM_READ_ONLY);
+			filterWeights.write(&weights[0], 0, weights.size() * sizeof(float), CL_TRUE);
+			filterWeightsSigma = sigma;
+		}
+
+		size_t maxGroupSize = min(kernelH->getWorkGroupSize(), kernelV->getWorkGroupSize());
+		size_t across = getGroupSide(pOpenCL, kernelH, kernelV, 4);
+		while(across > 1 && (along * across > maxGroupSize || (along + 2 * radius) * across * sizeof(cl_float4) > localMemSize)) across /= 2;
+		size_t tileBytes = (along + 2 * radius) * across * sizeof(cl_float4);
+
+		OpenCLImage &temp = getFilterTemp(0);
+
+		OpenCLKernel *kernel = kernelH;
+		kernel->setArg(0, *this, CL_MEM_READ_ONLY);
+		kernel->setArg(1, temp, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, filterWeights, CL_MEM_READ_ONLY);
+		kernel->setArg(3, radius);
+		kernel->setLocalArg(4, tileBytes);
+		kernel->run2D(roundUp(width, along), roundUp(height, across), along, across);
+
+		kernel = kernelV;
+		kernel->setArg(0, temp, CL_MEM_READ_ONLY);
+		kernel->setArg(1, dst, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, filterWeights, CL_MEM_READ_ONLY);
+		kernel->setArg(3, radius);
+		kernel->setLocalArg(4, tileBytes);
+		kernel->run2D(roundUp(width, across), roundUp(height, along), across, along);
+	}
+
+
+	void OpenCLImage::boxBlur(OpenCLImage &dst, int radius) {
+		if(!canFilter(dst)) return;
+
+		if(radius < 1) {
+			if(&dst != this) dst.copyFrom(*this);
+			return;
+		}
+
+		// long enough segments that summing the first window is a small part of the work
+		cl_int segmentLength = max(32, 2 * radius + 1);
+
+		OpenCLImage &temp = getFilterTemp(0);
+
+		OpenCLKernel *kernel = loadFilterKernel(pOpenCL, "msa_boxblur_h");
+		kernel->setArg(0, *this, CL_MEM_READ_ONLY);
+		kernel->setArg(1, temp, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, radius);
+		kernel->setArg(3, segmentLength);
+		kernel->run2D(height, (width + segmentLength - 1) / segmentLength);
+
+		kernel = loadFilterKernel(pOpenCL, "msa_boxblur_v");
+		kernel->setArg(0, temp, CL_MEM_READ_ONLY);
+		kernel->setArg(1, dst, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, radius);
+		kernel->setArg(3, segmentLength);
+		kernel->run2D(width, (height + segmentLength - 1) / segmentLength);
+	}
+
+
+	void OpenCLImage::bilateralFilter(OpenCLImage &dst, float sigmaSpatial, float sigmaRange) {
+		if(!canFilter(dst)) return;
+		if(&dst == this) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::bilateralFilter - dst must be a different image");
+			assert(false);
+			return;
+		}
+
+		OpenCLKernel *kernel = loadFilterKernel(pOpenCL, "msa_bilateral");
+
+		int localMemSize	= getFilterLocalMemSize();
+		int radius			= max(1.0f, ceil(sigmaSpatial * 2.0f));
+
+		// square work-groups of up to 16x16 (as the kernel and device allow), down to 8x8 if the tile doesn't fit,
+		// and clamp the radius if that doesn't either
+		size_t groupSize = getGroupSide(pOpenCL, kernel, kernel, 16);
+		while(groupSize * groupSize > kernel->getWorkGroupSize()) groupSize /= 2;
+		while(groupSize > 8 && (groupSize + 2 * radius) * (groupSize + 2 * radius) * sizeof(cl_float4) > localMemSize) groupSize /= 2;
+		int maxRadius = max(0, (int)(sqrt(localMemSize / (float)sizeof(cl_float4)) - groupSize) / 2);
+		if(radius > maxRadius) {
+			ofLog(OF_LOG_WARNING, "OpenCLImage::bilateralFilter - sigmaSpatial " + ofToString(sigmaSpatial) + " is too large for local memory, clamping");
+			radius = maxRadius;
+		}
+
+		cl_float spatialScale	= -1.0f / (2.0f * sigmaSpatial * sigmaSpatial);
+		cl_float rangeScale		= -1.0f / (2.0f * sigmaRange * sigmaRange);
+
+		kernel->setArg(0, *this, CL_MEM_READ_ONLY);
+		kernel->setArg(1, dst, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, radius);
+		kernel->setArg(3, spatialScale);
+		kernel->setArg(4, rangeScale);
+		kernel->setLocalArg(5, (groupSize + 2 * radius) * (groupSize + 2 * radius) * sizeof(cl_float4));
+		kernel->run2D(roundUp(width, groupSize), roundUp(height, groupSize), groupSize, groupSize);
+	}
+
+
+	void OpenCLImage::unsharpMask(OpenCLImage &dst, float sigma, float amount, float threshold) {
+		if(!canFilter(dst)) return;
+		if(&dst == this) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage::unsharpMask - dst must be a different image");
+			assert(false);
+			return;
+		}
+
+		// gaussianBlur uses the first temporary image, so blur into the second
+		OpenCLImage &blurred = getFilterTemp(1);
+		gaussianBlur(blurred, sigma);
+
+		cl_float a = amount;
+		cl_float t = threshold;
+		OpenCLKernel *kernel = loadFilterKernel(pOpenCL, "msa_unsharp");
+		kernel->setArg(0, *this, CL_MEM_READ_ONLY);
+		kernel->setArg(1, blurred, CL_MEM_READ_ONLY);
+		kernel->setArg(2, dst, CL_MEM_WRITE_ONLY);
+		kernel->setArg(3, a);
+		kernel->setArg(4, t);
+		kernel->run2D(width, height);
+	}
+
+
+	OpenCLImage &OpenCLImage::getFilterTemp(int i) {
+		OpenCLImage *&temp = filterTemp[i];
+		if(temp == NULL || temp->width != width || temp->height != height || temp->getChannelOrder() != getChannelOrder() || temp->getChannelDataType() != getChannelDataType()) {
+			delete temp;
+			temp = new OpenCLImage();
+			temp->initWithoutTexture(width, height, 1, getChannelOrder(), getChannelDataType(), CL_MEM_READ_WRITE);
+			temp->setLabel(label + " filter temp " + ofToString(i));
+		}
+		return *temp;
+	}
+
+
+	bool OpenCLImage::canFilter(OpenCLImage &dst) {
+		string error;
+		switch(imageFormat.image_channel_data_type) {
+			case CL_SIGNED_INT8:
+			case CL_SIGNED_INT16:
+			case CL_SIGNED_INT32:
+			case CL_UNSIGNED_INT8:
+			case CL_UNSIGNED_INT16:
+			case CL_UNSIGNED_INT32:
+				error = "only for float and normalized images";
+				break;
+		}
+		if(depth != 1) error = "only for 2D images";
+		if(dst.width != width || dst.height != height) error = "dst must be the same size";
+
+		if(!error.empty()) {
+			ofLog(OF_LOG_ERROR, "OpenCLImage filters - " + error);
+			assert(false);
+			return false;
+		}
+		return true;
+	}
+
+
+	int OpenCLImage::getFilterLocalMemSize() {
+		// leave some room for the kernel's own use
+		int localMemSize = pOpenCL->info.localMemSize ? pOpenCL->info.localMemSize : 16384;
+		return localMemSize - 1024;
+	}
+}
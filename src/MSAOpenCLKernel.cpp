@@ -13,9 +13,88 @@ namespace msa {
 	
 	OpenCLKernel::~OpenCLKernel() {
 		ofLog(OF_LOG_VERBOSE, "OpenCLKernel::~OpenCLKernel " + name);
+		while(!memObjectArgs.empty()) unbindArg(memObjectArgs.begin()->first);
 		clReleaseKernel(clKernel);
 	}
 	
+	
+	bool OpenCLKernel::setArg(int argNumber, OpenCLMemoryObject &memObject, cl_mem_flags access) {
+		assert(clKernel);
+		if(!clKernel) return false;
+		
+		unbindArg(argNumber);
+		
+		MemoryObjectArg &arg	= memObjectArgs[argNumber];
+		arg.memObject			= &memObject;
+		arg.access				= access;
+		arg.clMem				= memObject.getResidentCLMem();
+		memObject.boundKernels.insert(this);
+		
+		cl_int err = clSetKernelArg(clKernel, argNumber, sizeof(cl_mem), &arg.clMem);
+		assert(err != CL_INVALID_ARG_INDEX);
+		assert(err != CL_INVALID_MEM_OBJECT);
+		assert(err == CL_SUCCESS);
+		return (err==CL_SUCCESS);
+	}
+	
+	
+	bool OpenCLKernel::setLocalArg(int argNumber, size_t numBytes) {
+		return setArgInternal(argNumber, (const void*)NULL, numBytes);
+	}
+	
+	
+	bool OpenCLKernel::setArgInternal(int argNumber, OpenCLMemoryObject *memObject, size_t size) {
+		return setArg(argNumber, *memObject, CL_MEM_READ_WRITE);
+	}
+	
+	
+	bool OpenCLKernel::setArgInternal(int argNumber, const OpenCLMemoryObject *memObject, size_t size) {
+		return setArg(argNumber, *const_cast<OpenCLMemoryObject*>(memObject), CL_MEM_READ_WRITE);
+	}
+	
+	
+	bool OpenCLKernel::setArgInternal(int argNumber, const void *argPtr, size_t size) {
+		assert(clKernel);
+		if ( !clKernel )
+			return false;
+		
+		unbindArg(argNumber);
+		
+		cl_int err  = clSetKernelArg(clKernel, argNumber, size, argPtr);
+		assert(err != CL_INVALID_KERNEL);
+		assert(err != CL_INVALID_ARG_INDEX);
+		assert(err != CL_INVALID_ARG_VALUE);
+		assert(err != CL_INVALID_MEM_OBJECT);
+		assert(err != CL_INVALID_SAMPLER);
+		assert(err != CL_INVALID_ARG_SIZE);
+		assert(err == CL_SUCCESS);
+		return (err==CL_SUCCESS);
+	}
+	
+	
+	void OpenCLKernel::unbindArg(int argNumber) {
+		map<int, MemoryObjectArg>::iterator it = memObjectArgs.find(argNumber);
+		if(it == memObjectArgs.end()) return;
+		
+		OpenCLMemoryObject *memObject = it->second.memObject;
+		memObjectArgs.erase(it);
+		
+		// only forget about this kernel if the memory object isn't bound to any other argument
+		for(it = memObjectArgs.begin(); it != memObjectArgs.end(); ++it) {
+			if(it->second.memObject == memObject) return;
+		}
+		memObject->boundKernels.erase(this);
+	}
+	
+	
+	void OpenCLKernel::unbindMemoryObject(OpenCLMemoryObject *memObject) {
+		map<int, MemoryObjectArg>::iterator it = memObjectArgs.begin();
+		while(it != memObjectArgs.end()) {
+			if(it->second.memObject == memObject) memObjectArgs.erase(it++);
+			else ++it;
+		}
+	}
+	
 	/*
 	 void OpenCLKernel::setArg(int argNumber, cl_mem clMem) {
 	 ofLog(OF_LOG_VERBOSE, "OpenCLKernel::setArg " + name + ": " + ofToString(argNumber));	
@@ -33,8 +112,29 @@ namespace msa {
 		
 		//	size_t localSize = MIN(n, info.maxWorkGroupSize);
 		
+		// pin bound memory objects, so that making one resident can't evict another
+		for(map<int, MemoryObjectArg>::iterator it = memObjectArgs.begin(); it != memObjectArgs.end(); ++it) {
+			it->second.memObject->pinCount++;
+		}
+		
+		// give bound memory objects a chance to sync, and re-bind any whose cl_mem has changed
+		for(map<int, MemoryObjectArg>::iterator it = memObjectArgs.begin(); it != memObjectArgs.end(); ++it) {
+			MemoryObjectArg &arg = it->second;
+			arg.memObject->kernelWillRun(this, arg.access);
+			if(arg.clMem != arg.memObject->getResidentCLMem()) {
+				arg.clMem = arg.memObject->getResidentCLMem();
+				err = clSetKernelArg(clKernel, it->first, sizeof(cl_mem), &arg.clMem);
+				assert(err == CL_SUCCESS);
+			}
+		}
+		
 		err = clEnqueueNDRangeKernel(pOpenCL->getQueue(), clKernel, numDimensions, NULL, globalSize, localSize, 0, NULL, NULL);
 		assert(err == CL_SUCCESS);
+		
+		for(map<int, MemoryObjectArg>::iterator it = memObjectArgs.begin(); it != memObjectArgs.end(); ++it) {
+			it->second.memObject->kernelDidRun(this, it->second.access);
+			it->second.memObject->pinCount--;
+		}
 	}
 	
 	void OpenCLKernel::run1D(size_t globalSize, size_t localSize) {
@@ -87,4 +187,11 @@ namespace msa {
 	string OpenCLKernel::getName() {
 		return name;
 	}
+	
+	size_t OpenCLKernel::getWorkGroupSize() {
+		size_t workGroupSize = 1;
+		cl_int err = clGetKernelWorkGroupInfo(clKernel, pOpenCL->getDevice(), CL_KERNEL_WORK_GROUP_SIZE, sizeof(workGroupSize), &workGroupSize, NULL);
+		assert(err == CL_SUCCESS);
+		return workGroupSize;
+	}
 }
\ No newline at end of file
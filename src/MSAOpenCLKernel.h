@@ -29,24 +29,23 @@ namespace msa {
 		//	void setArg(int argNumber, float f);
 		//	void setArg(int argNumber, int i);
 		
+		// assign a value (or a raw cl_mem) to an argument
+		// if arg is an OpenCLBuffer or OpenCLImage (or anything else derived from OpenCLMemoryObject)...
+		// ...the kernel remembers it and re-binds it automatically should the underlying cl_mem change
 		template<class T>
 		bool setArg(int argNumber, T &arg){
 			//		ofLog(OF_LOG_VERBOSE, "OpenCLKernel::setArg " + name + ": " + ofToString(argNumber));	
-			assert(clKernel);
-			if ( !clKernel )
-				return false;
-			
-			cl_int err  = clSetKernelArg(clKernel, argNumber, sizeof(T), &arg);
-			assert(err != CL_INVALID_KERNEL);
-			assert(err != CL_INVALID_ARG_INDEX);
-			assert(err != CL_INVALID_ARG_VALUE);
-			assert(err != CL_INVALID_MEM_OBJECT);
-			assert(err != CL_INVALID_SAMPLER);
-			assert(err != CL_INVALID_ARG_SIZE);
-			assert(err == CL_SUCCESS);
-			return (err==CL_SUCCESS);
+			return setArgInternal(argNumber, &arg, sizeof(T));
 		}
 		
+		// assign a memory object to an argument, declaring how the kernel accesses it
+		// (CL_MEM_READ_ONLY, CL_MEM_WRITE_ONLY or CL_MEM_READ_WRITE)
+		// memory objects use this to keep themselves in sync, e.g. OpenCLMirroredBuffer
+		bool setArg(int argNumber, OpenCLMemoryObject &memObject, cl_mem_flags access);
+		
+		// allocate numBytes of local memory for a __local pointer argument (per work-group)
+		bool setLocalArg(int argNumber, size_t numBytes);
+		
 		// run the kernel
 		// globalSize and localSize should be int arrays with same number of dimensions as numDimensions
 		// leave localSize blank to let OpenCL determine optimum
@@ -60,11 +59,30 @@ namespace msa {
 		cl_kernel& getCLKernel();
 		string getName();
 		
+		// maximum work-group size this kernel can be run with on the device (CL_KERNEL_WORK_GROUP_SIZE)
+		size_t getWorkGroupSize();
+		
 	protected:
+		friend class OpenCLMemoryObject;
+		
+		struct MemoryObjectArg {
+			OpenCLMemoryObject	*memObject;
+			cl_mem_flags		access;
+			cl_mem				clMem;		// cl_mem last passed to clSetKernelArg
+		};
+		
 		string			name;
 		OpenCL*		pOpenCL;
 		cl_kernel		clKernel;
+		map<int, MemoryObjectArg>	memObjectArgs;
 		
 		OpenCLKernel(OpenCL *pOpenCL, cl_kernel clKernel, string name);
+		
+		bool setArgInternal(int argNumber, OpenCLMemoryObject *memObject, size_t size);
+		bool setArgInternal(int argNumber, const OpenCLMemoryObject *memObject, size_t size);
+		bool setArgInternal(int argNumber, const void *argPtr, size_t size);
+		
+		void unbindArg(int argNumber);
+		void unbindMemoryObject(OpenCLMemoryObject *memObject);	// called when memObject is deleted
 	};
 }
@@ -0,0 +1,125 @@
+#include "MSAOpenCLMappedFile.h"
+
+#ifdef TARGET_WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace msa {
+	
+	OpenCLMappedFile::OpenCLMappedFile() {
+		mapBase		= NULL;
+		mapSize		= 0;
+		data		= NULL;
+		size		= 0;
+#ifdef TARGET_WIN32
+		fileHandle		= NULL;
+		mappingHandle	= NULL;
+#endif
+	}
+	
+	
+	OpenCLMappedFile::~OpenCLMappedFile() {
+		unmap();
+	}
+	
+	
+	bool OpenCLMappedFile::map(string fullPath, size_t offset, long long length) {
+		ofLog(OF_LOG_VERBOSE, "OpenCLMappedFile::map " + fullPath + ", " + ofToString(offset) + ", " + ofToString(length));
+		
+		unmap();
+		
+#ifdef TARGET_WIN32
+		HANDLE hFile = CreateFileA(fullPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if(hFile == INVALID_HANDLE_VALUE) {
+			ofLog(OF_LOG_ERROR, "OpenCLMappedFile::map - error opening " + fullPath);
+			return false;
+		}
+		
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(hFile, &fileSize);
+		if(length < 0) length = fileSize.QuadPart - offset;
+		if(length <= 0 || offset + length > fileSize.QuadPart) {
+			ofLog(OF_LOG_ERROR, "OpenCLMappedFile::map - range is outside of " + fullPath);
+			CloseHandle(hFile);
+			return false;
+		}
+		
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		size_t alignedOffset = offset - offset % systemInfo.dwAllocationGranularity;
+		
+		HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if(hMapping) mapBase = MapViewOfFile(hMapping, FILE_MAP_COPY, (DWORD)((unsigned long long)alignedOffset >> 32), (DWORD)(alignedOffset & 0xFFFFFFFF), offset - alignedOffset + length);
+		if(mapBase == NULL) {
+			ofLog(OF_LOG_ERROR, "OpenCLMappedFile::map - error mapping " + fullPath);
+			if(hMapping) CloseHandle(hMapping);
+			CloseHandle(hFile);
+			return false;
+		}
+		
+		fileHandle		= hFile;
+		mappingHandle	= hMapping;
+#else
+		int fd = open(fullPath.c_str(), O_RDONLY);
+		if(fd < 0) {
+			ofLog(OF_LOG_ERROR, "OpenCLMappedFile::map - error opening " + fullPath);
+			return false;
+		}
+		
+		struct stat fileInfo;
+		fstat(fd, &fileInfo);
+		if(length < 0) length = fileInfo.st_size - (long long)offset;
+		if(length <= 0 || offset + length > fileInfo.st_size) {
+			ofLog(OF_LOG_ERROR, "OpenCLMappedFile::map - range is outside of " + fullPath);
+			close(fd);
+			return false;
+		}
+		
+		size_t pageSize = sysconf(_SC_PAGESIZE);
+		size_t alignedOffset = offset - offset % pageSize;
+		
+		void *p = mmap(NULL, offset - alignedOffset + length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, alignedOffset);
+		close(fd);		// the mapping keeps its own reference to the file
+		if(p == MAP_FAILED) {
+			ofLog(OF_LOG_ERROR, "OpenCLMappedFile::map - error mapping " + fullPath);
+			return false;
+		}
+		mapBase = p;
+		
+		// we're going to stream through it once
+		madvise(mapBase, offset - alignedOffset + length, MADV_SEQUENTIAL);
+#endif
+		
+		mapSize	= offset - alignedOffset + length;
+		data	= (char*)mapBase + (offset - alignedOffset);
+		size	= length;
+		return true;
+	}
+	
+	
+	void OpenCLMappedFile::unmap() {
+		if(mapBase == NULL) return;
+		
+		ofLog(OF_LOG_VERBOSE, "OpenCLMappedFile::unmap");
+		
+#ifdef TARGET_WIN32
+		UnmapViewOfFile(mapBase);
+		CloseHandle((HANDLE)mappingHandle);
+		CloseHandle((HANDLE)fileHandle);
+		fileHandle		= NULL;
+		mappingHandle	= NULL;
+#else
+		munmap(mapBase, mapSize);
+#endif
+		
+		mapBase		= NULL;
+		mapSize		= 0;
+		data		= NULL;
+		size		= 0;
+	}
+}
@@ -0,0 +1,49 @@
+/***********************************************************************
+ 
+ Read only memory mapping of (part of) a file
+ Used by OpenCLBuffer::initFromFile to get large files onto the device
+ without reading them into a host array first
+ 
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+
+namespace msa {
+	
+	class OpenCLMappedFile {
+	public:
+		OpenCLMappedFile();
+		~OpenCLMappedFile();
+		
+		// map length bytes of the file, starting at offset (length < 0 means to the end of the file)
+		// pages are private copy-on-write, so the data can be modified without changing the file
+		// returns false if the file can't be opened or mapped
+		bool map(string fullPath, size_t offset = 0, long long length = -1);
+		void unmap();
+		
+		bool isMapped() {
+			return data != NULL;
+		}
+		
+		void *getData() {
+			return data;
+		}
+		
+		size_t getSize() {
+			return size;
+		}
+		
+	protected:
+		void		*mapBase;		// start of the mapping (page aligned)
+		size_t		mapSize;
+		void		*data;			// requested offset within the mapping
+		size_t		size;
+		
+#ifdef TARGET_WIN32
+		void		*fileHandle;
+		void		*mappingHandle;
+#endif
+	};
+}
@@ -1,27 +1,131 @@
 #include "MSAOpenCL.h"
 #include "MSAOpenCLMemoryObject.h"
 
+#if defined(TARGET_OSX) || defined(TARGET_LINUX)
+#include <execinfo.h>
+#define MSA_OPENCL_HAS_EXECINFO
+#endif
+
 namespace msa { 
 	
 	OpenCLMemoryObject::OpenCLMemoryObject() {
 		ofLog(OF_LOG_VERBOSE, "OpenCLMemoryObject::OpenCLMemoryObject");
 		pOpenCL = NULL;
 		clMemObject = NULL;
+		isEvicted = false;
+		clMemShared = false;
+		pinCount = 0;
+		residentSize = 0;
+		lastUsed = 0;
+		memoryTag = OPENCL_MEMORY_BUFFER;
+		callStackDepth = 0;
 	}
 	
 	
 	OpenCLMemoryObject::~OpenCLMemoryObject() {
 		ofLog(OF_LOG_VERBOSE, "OpenCLMemoryObject::~OpenCLMemoryObject");
+		for(set<OpenCLKernel*>::iterator it = boundKernels.begin(); it != boundKernels.end(); ++it) (*it)->unbindMemoryObject(this);
+		if(pOpenCL) {
+			pOpenCL->residentBytes -= residentSize;
+			pOpenCL->unregisterMemoryObject(this);
+		}
 		if(clMemObject) clReleaseMemObject(clMemObject);
 	}
 	
 	
 	cl_mem &OpenCLMemoryObject::getCLMem() {
+		clMemShared = true;
+		
+		// the caller expects a valid cl_mem, but a plain accessor shouldn't evict other objects to make room
+		if(pOpenCL) makeResident(false);
+		return clMemObject;
+	}
+	
+	
+	cl_mem &OpenCLMemoryObject::getResidentCLMem() {
+		if(pOpenCL) {
+			makeResident();
+			lastUsed = pOpenCL->nextUseTick();
+		}
 		return clMemObject;
 	}
 	
+	
+	void OpenCLMemoryObject::updateResidentSize() {
+		if(pOpenCL == NULL) return;
+		size_t newSize = clMemObject && !isEvicted ? getSizeInBytes() : 0;
+		pOpenCL->residentBytes += newSize;
+		pOpenCL->residentBytes -= residentSize;
+		residentSize = newSize;
+	}
+	
+	
 	void OpenCLMemoryObject::memoryObjectInit() {
 		ofLog(OF_LOG_VERBOSE, "OpenCLMemoryObject::memoryObjectInit");
 		pOpenCL = OpenCL::currentOpenCL;
+		pOpenCL->registerMemoryObject(this);
+		isEvicted = false;
+		clMemShared = false;		// a new cl_mem (or about to be), nobody has this one yet
+		evictedData.clear();
+		updateResidentSize();
+		lastUsed = pOpenCL->nextUseTick();
+		
+		callStackDepth = 0;
+#ifdef MSA_OPENCL_HAS_EXECINFO
+		if(pOpenCL->getRecordCallSites()) callStackDepth = backtrace(callStack, sizeof(callStack) / sizeof(callStack[0]));
+#endif
+	}
+	
+	
+	string OpenCLMemoryObject::getCallSite() {
+		string s;
+#ifdef MSA_OPENCL_HAS_EXECINFO
+		// skip memoryObjectInit and the subclass init which called it
+		const int skip = 2;
+		if(callStackDepth <= skip) return s;
+		
+		char **symbols = backtrace_symbols(callStack + skip, callStackDepth - skip);
+		if(symbols == NULL) return s;
+		for(int i=0; i<callStackDepth - skip; i++) s += string(symbols[i]) + "\n";
+		free(symbols);
+#endif
+		return s;
+	}
+	
+	
+	void OpenCLMemoryObject::willAllocate(size_t numBytes) {
+		updateResidentSize();		// e.g. the old cl_mem has just been released
+		pinCount++;
+		pOpenCL->enforceMemoryBudget(numBytes);
+		pinCount--;
+		pOpenCL->trackAllocation(numBytes);
+		
+		// count the new allocation now, it replaces whatever this object had
+		pOpenCL->residentBytes += numBytes;
+		pOpenCL->residentBytes -= residentSize;
+		residentSize = numBytes;
+	}
+	
+	
+	void OpenCLMemoryObject::didAllocate() {
+		updateResidentSize();
+		pOpenCL->trackAllocation(0);
+	}
+	
+	
+	void OpenCLMemoryObject::makeResident(bool makeRoom) {
+		if(!isEvicted) return;
+		
+		ofLog(OF_LOG_VERBOSE, "OpenCLMemoryObject::makeResident " + ofToString(getSizeInBytes()) + " bytes");
+		
+		if(makeRoom) {
+			willAllocate(getSizeInBytes());
+		} else {
+			pOpenCL->trackAllocation(getSizeInBytes());
+		}
+		restore();
+		isEvicted = false;
+		updateResidentSize();
+		vector<unsigned char>().swap(evictedData);		// actually free the memory
 	}
 }
\ No newline at end of file
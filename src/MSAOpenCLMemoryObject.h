@@ -12,12 +12,28 @@
 
 namespace msa { 
 	class OpenCL;
+	class OpenCLKernel;
+	class OpenCLBuffer;
+	class OpenCLImage;
+	class OpenCLWriteBatch;
+	class OpenCLReduction;
+	template<class T> class OpenCLPingPongSlot;
+	
+	// what kind of memory an object uses, for memory accounting (see OpenCL::getAllocatedBytes)
+	enum OpenCLMemoryTag {
+		OPENCL_MEMORY_BUFFER,
+		OPENCL_MEMORY_IMAGE,
+		OPENCL_MEMORY_GL_SHARED,		// buffer or image created from an OpenGL object
+		OPENCL_MEMORY_NUM_TAGS
+	};
 	
 	class OpenCLMemoryObject {
 		
 	public:
 		virtual ~OpenCLMemoryObject();
 		
+		// the raw cl_mem, e.g. for setArg(argNumber, obj.getCLMem()) or your own clEnqueue calls
+		// this can be kept anywhere, so from then on the object is never evicted (see below)
 		cl_mem	&getCLMem();
 		
 		operator cl_mem&() {
@@ -25,12 +41,122 @@ namespace msa {
 		}
 		
 		
+		// device memory management (see OpenCL::setMemoryBudget)
+		// only objects used exclusively through this library (reads, writes, copies, and kernels which have them set
+		// with OpenCLKernel::setArg(argNumber, obj, access)) can be evicted: those are restored, and kernels re-bound, when next used.
+		// once getCLMem() (or the cast to cl_mem) has handed out the raw cl_mem, the object is never evicted,
+		// since a kernel or anything else holding that cl_mem couldn't be told it had changed
+		
+		// number of bytes allocated on the device
+		virtual size_t getSizeInBytes() {
+			return 0;
+		}
+		
+		// false if the object has been evicted to host memory to stay within the memory budget
+		bool isResident() {
+			return !isEvicted;
+		}
+		
+		// true once the raw cl_mem has been handed out (until the object is initialized again)
+		bool isCLMemShared() {
+			return clMemShared;
+		}
+		
+		// pinned objects are never evicted (pins are counted, so unpin as many times as pin)
+		void pin() {
+			pinCount++;
+		}
+		
+		void unpin() {
+			pinCount--;
+		}
+		
+		// higher numbers were used more recently
+		unsigned long getLastUsed() {
+			return lastUsed;
+		}
+		
+		
+		// memory accounting (see OpenCL::getMemoryReport)
+		OpenCLMemoryTag getMemoryTag() {
+			return memoryTag;
+		}
+		
+		// optional name to identify the object in memory reports
+		void setLabel(string label) {
+			this->label = label;
+		}
+		
+		string getLabel() {
+			return label;
+		}
+		
+		// where the object was (last) initialized from, one stack frame per line
+		// empty on platforms without execinfo (or if OpenCL::setRecordCallSites(false))
+		string getCallSite();
+		
 		
 	protected:
+		friend class OpenCL;
+		friend class OpenCLKernel;
+		friend class OpenCLBuffer;
+		friend class OpenCLImage;
+		friend class OpenCLWriteBatch;
+		friend class OpenCLReduction;
+		template<class T> friend class OpenCLPingPongSlot;
+		
 		OpenCLMemoryObject();
 		cl_mem		clMemObject;
 		OpenCL*		pOpenCL;
 		
+		set<OpenCLKernel*>	boundKernels;		// kernels which have this object set as an argument
+		
+		bool					isEvicted;
+		bool					clMemShared;	// getCLMem has handed out the cl_mem, so it can't change under its users
+		int						pinCount;		// pinned objects are never evicted (e.g. while a kernel using them is being enqueued)
+		size_t					residentSize;	// bytes this object currently adds to OpenCL's resident total
+		unsigned long			lastUsed;
+		vector<unsigned char>	evictedData;	// contents while evicted
+		
+		OpenCLMemoryTag			memoryTag;
+		string					label;
+		void					*callStack[16];
+		int						callStackDepth;
+		
 		void memoryObjectInit();
+		
+		// call before allocating numBytes of device memory, to make room within the budget
+		void willAllocate(size_t numBytes);
+		
+		// call after creating an object without willAllocate (e.g. shared with OpenGL), for accounting
+		void didAllocate();
+		
+		// restore if evicted (making room within the budget first, unless makeRoom is false)
+		void makeResident(bool makeRoom = true);
+		
+		// cl_mem for the library's own use (transfers, copies, binding to kernels): restores the object if evicted,
+		// and marks it as used, but doesn't stop it from being evicted later like getCLMem does
+		cl_mem &getResidentCLMem();
+		
+		// bring OpenCL's running total of resident bytes up to date with this object's state
+		void updateResidentSize();
+		
+		// not evicted, not pinned, cl_mem not handed out, and supported by the subclass
+		bool isEvictable() {
+			return !isEvicted && pinCount == 0 && !clMemShared && canEvict();
+		}
+		
+		// eviction, implemented by subclasses which support it
+		// evict copies the contents into evictedData and releases the cl_mem, restore does the opposite
+		virtual bool canEvict() {
+			return false;
+		}
+		virtual void evict() {}
+		virtual void restore() {}
+		
+		// called by OpenCLKernel::run (before enqueuing and after enqueuing) for every kernel which has this object set as an argument
+		// access is as declared in OpenCLKernel::setArg
+		virtual void kernelWillRun(OpenCLKernel *kernel, cl_mem_flags access) {}
+		virtual void kernelDidRun(OpenCLKernel *kernel, cl_mem_flags access) {}
 	};
 }
\ No newline at end of file
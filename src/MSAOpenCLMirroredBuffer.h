@@ -0,0 +1,310 @@
+/***********************************************************************
+
+ OpenCL Mirrored Buffer
+ An OpenCLBuffer which also owns a host copy of its contents (an array of T)
+ and keeps track of which ranges are out of date on either side.
+ Changed ranges are only transferred when the other side needs them:
+ - host side changes (via the accessors below) are uploaded before a kernel using the buffer runs
+ - device side changes (a kernel declared as writing to the buffer, copyFrom, or markDeviceDirty) are read back when the host reads
+
+ e.g.:
+ OpenCLMirroredBuffer<float4> particles;
+ particles.initMirroredBuffer(NUM_PARTICLES);
+ particles[10] = float4(1, 2, 3, 0);					// only element 10 is uploaded...
+ kernel->setArg(0, particles, CL_MEM_READ_WRITE);	// (declare how the kernel uses it)
+ kernel->run1D(NUM_PARTICLES);						// ...right before this
+ float4 p = particles.get(5);						// device contents are read back now
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCL.h"
+
+namespace msa {
+
+	// sorted, non-overlapping list of [start, end) ranges
+	// ranges closer than mergeGap are merged, and if there are more than maxRanges they're collapsed into one
+	class OpenCLDirtyRanges {
+	public:
+		struct Range {
+			int start;
+			int end;
+		};
+
+		OpenCLDirtyRanges() {
+			mergeGap	= 0;
+			maxRanges	= 64;
+		}
+
+		void add(int start, int end) {
+			if(start >= end) return;
+
+			// fast path for sequential writes
+			if(!ranges.empty() && start >= ranges.back().start && start <= ranges.back().end + mergeGap) {
+				ranges.back().end = max(ranges.back().end, end);
+				return;
+			}
+
+			vector<Range>::iterator it = ranges.begin();
+			while(it != ranges.end() && it->end + mergeGap < start) ++it;
+
+			Range r = { start, end };
+			while(it != ranges.end() && it->start <= end + mergeGap) {
+				r.start	= min(r.start, it->start);
+				r.end	= max(r.end, it->end);
+				it = ranges.erase(it);
+			}
+			ranges.insert(it, r);
+
+			if(ranges.size() > maxRanges) {
+				Range all = { ranges.front().start, ranges.back().end };
+				ranges.clear();
+				ranges.push_back(all);
+			}
+		}
+
+		void remove(int start, int end) {
+			if(start >= end) return;
+
+			vector<Range> result;
+			for(int i=0; i<ranges.size(); i++) {
+				const Range &r = ranges[i];
+				if(r.end <= start || r.start >= end) {
+					result.push_back(r);
+				} else {
+					if(r.start < start) { Range left = { r.start, start }; result.push_back(left); }
+					if(r.end > end) { Range right = { end, r.end }; result.push_back(right); }
+				}
+			}
+			ranges.swap(result);
+		}
+
+		// fills out with the parts of the dirty ranges which overlap [start, end)
+		void getOverlapping(int start, int end, vector<Range> &out) const {
+			out.clear();
+			for(int i=0; i<ranges.size(); i++) {
+				Range r = { max(ranges[i].start, start), min(ranges[i].end, end) };
+				if(r.start < r.end) out.push_back(r);
+			}
+		}
+
+		void clear() {
+			ranges.clear();
+		}
+
+		bool empty() const {
+			return ranges.empty();
+		}
+
+		int size() const {
+			return ranges.size();
+		}
+
+		const Range &operator[](int i) const {
+			return ranges[i];
+		}
+
+		int		mergeGap;
+		int		maxRanges;
+
+	protected:
+		vector<Range>	ranges;
+	};
+
+
+
+	template<class T>
+	class OpenCLMirroredBuffer : public OpenCLBuffer {
+	public:
+
+		OpenCLMirroredBuffer() {
+			uploadEvent = NULL;
+		}
+
+		~OpenCLMirroredBuffer() {
+			waitForUpload();		// hostData is about to be freed
+		}
+
+		// allocate host and device memory for numElements elements
+		// if dataPtr is passed in, it's copied to the host array (and uploaded when first needed)
+		void initMirroredBuffer(int numElements,
+								cl_mem_flags memFlags = CL_MEM_READ_WRITE,
+								const T *dataPtr = NULL)
+		{
+			ofLog(OF_LOG_VERBOSE, "OpenCLMirroredBuffer::initMirroredBuffer " + ofToString(numElements));
+
+			waitForUpload();
+			if(dataPtr) hostData.assign(dataPtr, dataPtr + numElements);
+			else hostData.assign(numElements, T());
+
+			initBuffer(numElements * sizeof(T), memFlags);
+
+			hostDirty.clear();
+			deviceDirty.clear();
+			hostDirty.add(0, numElements);
+		}
+
+		int getNumElements() const {
+			return hostData.size();
+		}
+
+		// change the number of elements, preserving existing contents (on both sides) up to the new size
+		// new elements are T() and uploaded when first needed
+		void resizeElements(int numElements) {
+			resize(numElements * sizeof(T));
+		}
+
+		// numberOfBytes must be a multiple of sizeof(T)
+		// (reserve and shrinkToFit don't change the size, so the host copy stays valid with those)
+		virtual void resize(size_t numberOfBytes) {
+			assert(numberOfBytes % sizeof(T) == 0);
+			int oldNumElements = getNumElements();
+			int newNumElements = numberOfBytes / sizeof(T);
+
+			waitForUpload();		// hostData may be reallocated
+			OpenCLBuffer::resize(numberOfBytes);
+			hostData.resize(newNumElements, T());
+
+			hostDirty.remove(newNumElements, oldNumElements);
+			deviceDirty.remove(newNumElements, oldNumElements);
+			hostDirty.add(oldNumElements, newNumElements);
+		}
+
+
+		// host side element access
+		// get reads only. set and operator[] mark the element as changed on the host
+		const T &get(int i) {
+			syncToHost(i, i+1);
+			return hostData[i];
+		}
+
+		void set(int i, const T &value) {
+			willWriteHost(i, i+1, false);
+			hostData[i] = value;
+		}
+
+		T &operator[](int i) {
+			willWriteHost(i, i+1, true);
+			return hostData[i];
+		}
+
+
+		// pointer to count elements of host data, starting at start (count < 0 means to the end)
+		// access is CL_MEM_READ_ONLY, CL_MEM_WRITE_ONLY or CL_MEM_READ_WRITE:
+		// - if access includes read, out of date elements in the range are read back first
+		// - if access includes write, the range is marked as changed on the host (WRITE_ONLY assumes the whole range is overwritten)
+		T *getHostData(int start = 0, int count = -1, cl_mem_flags access = CL_MEM_READ_WRITE) {
+			if(count < 0) count = getNumElements() - start;
+			bool reads		= !(access & CL_MEM_WRITE_ONLY);
+			bool writes		= !(access & CL_MEM_READ_ONLY);
+			if(writes) willWriteHost(start, start + count, reads);
+			else syncToHost(start, start + count);
+			return &hostData[start];
+		}
+
+
+		// declare that elements have been changed on the device outside of a bound kernel or copyFrom (e.g. by a raw cl_mem argument)
+		// count < 0 means to the end
+		void markDeviceDirty(int start = 0, int count = -1) {
+			if(count < 0) count = getNumElements() - start;
+			hostDirty.remove(start, start + count);
+			deviceDirty.add(start, start + count);
+		}
+
+
+		// upload all ranges changed on the host
+		void syncToDevice() {
+			if(hostDirty.empty()) return;
+
+			if(uploadEvent) clReleaseEvent(uploadEvent);
+			uploadEvent = NULL;
+
+			for(int i=0; i<hostDirty.size(); i++) {
+				const OpenCLDirtyRanges::Range &r = hostDirty[i];
+				bool isLast = (i == hostDirty.size() - 1);
+				cl_int err = clEnqueueWriteBuffer(pOpenCL->getQueue(), getResidentCLMem(), CL_FALSE, r.start * sizeof(T), (r.end - r.start) * sizeof(T), &hostData[r.start], 0, NULL, isLast ? &uploadEvent : NULL);
+				assert(err == CL_SUCCESS);
+			}
+			hostDirty.clear();
+		}
+
+
+		// read back ranges changed on the device (only those within [start, end) if given)
+		void syncToHost(int start = 0, int end = -1) {
+			if(deviceDirty.empty()) return;
+			if(end < 0) end = getNumElements();
+
+			deviceDirty.getOverlapping(start, end, tempRanges);
+			for(int i=0; i<tempRanges.size(); i++) {
+				const OpenCLDirtyRanges::Range &r = tempRanges[i];
+				bool isLast = (i == tempRanges.size() - 1);
+				read(&hostData[r.start], r.start * sizeof(T), (r.end - r.start) * sizeof(T), isLast);
+			}
+			deviceDirty.remove(start, end);
+		}
+
+
+		// ranges closer than this many elements are transferred as one
+		void setMergeGap(int numElements) {
+			hostDirty.mergeGap		= numElements;
+			deviceDirty.mergeGap	= numElements;
+		}
+
+		const OpenCLDirtyRanges &getHostDirtyRanges() const {
+			return hostDirty;
+		}
+
+		const OpenCLDirtyRanges &getDeviceDirtyRanges() const {
+			return deviceDirty;
+		}
+
+
+	protected:
+		vector<T>			hostData;
+		OpenCLDirtyRanges	hostDirty;			// changed on host, device is out of date
+		OpenCLDirtyRanges	deviceDirty;		// changed on device, host is out of date
+		vector<OpenCLDirtyRanges::Range>	tempRanges;
+		cl_event			uploadEvent;		// last pending (non-blocking) upload from hostData
+
+
+		// block until the last upload from hostData has finished
+		void waitForUpload() {
+			if(uploadEvent) {
+				clWaitForEvents(1, &uploadEvent);
+				clReleaseEvent(uploadEvent);
+				uploadEvent = NULL;
+			}
+		}
+
+
+		// host data in [start, end) is about to be changed
+		void willWriteHost(int start, int end, bool keepDeviceChanges) {
+			// don't modify host memory which is still being uploaded
+			waitForUpload();
+
+			if(keepDeviceChanges) syncToHost(start, end);
+			else deviceDirty.remove(start, end);
+
+			hostDirty.add(start, end);
+		}
+
+
+		virtual void kernelWillRun(OpenCLKernel *kernel, cl_mem_flags access) {
+			syncToDevice();
+		}
+
+		virtual void kernelDidRun(OpenCLKernel *kernel, cl_mem_flags access) {
+			if(access & (CL_MEM_WRITE_ONLY | CL_MEM_READ_WRITE)) markDeviceDirty();
+		}
+
+		// e.g. copyFrom, or OpenCLWriteBatch copying spans into this buffer
+		virtual void deviceWasWritten(size_t startOffsetBytes, size_t numberOfBytes) {
+			int start	= startOffsetBytes / sizeof(T);
+			int end		= (startOffsetBytes + numberOfBytes + sizeof(T) - 1) / sizeof(T);
+			markDeviceDirty(start, end - start);
+		}
+	};
+}
@@ -0,0 +1,206 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLNBody.h"
+
+namespace msa {
+
+	// compiled after OpenCLSpatialGrid::getKernelHeader()
+	// dead bodies (lifetime <= 0, when useLifetime is set) have no mass
+	static const string nbodySource = MSA_OPENCL_SOURCE(
+		float msa_nbody_mass(__global const float *mass, __global const float *lifetime, const int useLifetime, int j) {
+			return !useLifetime || lifetime[j] > 0 ? mass[j] : 0;
+		}
+
+		// acceleration of a body at p towards a body at q.xyz of mass q.w (without G)
+		float3 msa_nbody_accel(float4 p, float4 q, float softening2) {
+			float3 d	= q.xyz - p.xyz;
+			float r2	= dot(d, d) + softening2;
+			float inv	= r2 > 0 ? rsqrt(r2) : 0;
+			return d * (q.w * inv * inv * inv);
+		}
+
+		// every work-group loads a tile of bodies (position and mass) into local memory, which all its work-items then read
+		// all work-items take part in loading, even those past n, so the global size can be rounded up to the local size
+		__kernel void msa_nbody_tiled(__global const float4 *pos, __global const float *mass, __global const float *lifetime, const int useLifetime, __global float4 *accel, const int n, const float softening2, const float G, __local float4 *tile) {
+			int i			= get_global_id(0);
+			int lid			= get_local_id(0);
+			int localSize	= get_local_size(0);
+			float4 p		= i < n ? pos[i] : (float4)(0);
+			float3 a		= (float3)(0);
+
+			for(int base = 0; base < n; base += localSize) {
+				int j = base + lid;
+				tile[lid] = j < n ? (float4)(pos[j].xyz, msa_nbody_mass(mass, lifetime, useLifetime, j)) : (float4)(0);
+				barrier(CLK_LOCAL_MEM_FENCE);
+
+				int count = min(localSize, n - base);
+				for(int k = 0; k < count; k++) a += msa_nbody_accel(p, tile[k], softening2);
+				barrier(CLK_LOCAL_MEM_FENCE);
+			}
+
+			// dead bodies get none, so a particle emitted into their slot before the next compute doesn't get a stale one
+			if(i < n) accel[i] = !useLifetime || lifetime[i] > 0 ? (float4)(a * G, 0) : (float4)(0);
+		}
+
+		// centre of mass and total mass of each cell
+		__kernel void msa_nbody_cells(__global const float4 *pos, __global const float *mass, __global const float *lifetime, const int useLifetime, __global float4 *cellBodies, const int numCells, __global const uint *cellStart, __global const uint *cellEnd, __global const uint *indices) {
+			int c = get_global_id(0);
+			if(c >= numCells) return;
+			float3 sum	= (float3)(0);
+			float m		= 0;
+			for(uint k = cellStart[c]; k < cellEnd[c]; k++) {
+				int j		= indices[k];
+				float mj	= msa_nbody_mass(mass, lifetime, useLifetime, j);
+				sum			+= pos[j].xyz * mj;
+				m			+= mj;
+			}
+			cellBodies[c] = m > 0 ? (float4)(sum / m, m) : (float4)(0);
+		}
+
+		// far cells (tiled through local memory like msa_nbody_tiled) as single bodies, then the bodies in the 27 near cells exactly
+		__kernel void msa_nbody_grid(__global const float4 *pos, __global const float *mass, __global const float *lifetime, const int useLifetime, __global float4 *accel, const int n, const float softening2, const float G, __global const float4 *cellBodies, const int numCells, __local float4 *tile, MSA_GRID_ARGS) {
+			int i			= get_global_id(0);
+			int lid			= get_local_id(0);
+			int localSize	= get_local_size(0);
+			float4 p		= i < n ? pos[i] : (float4)(0);
+			int4 cell		= msa_grid_cell(p, msaGridOrigin, msaCellSize, msaGridSize);
+			float3 a		= (float3)(0);
+
+			for(int base = 0; base < numCells; base += localSize) {
+				tile[lid] = base + lid < numCells ? cellBodies[base + lid] : (float4)(0);
+				barrier(CLK_LOCAL_MEM_FENCE);
+
+				int count = min(localSize, numCells - base);
+				for(int k = 0; k < count; k++) {
+					int c	= base + k;
+					int3 d	= (int3)(c % msaGridSize.x, c / msaGridSize.x % msaGridSize.y, c / (msaGridSize.x * msaGridSize.y)) - cell.xyz;
+					if(all(d >= -1 && d <= 1)) continue;
+					a += msa_nbody_accel(p, tile[k], softening2);
+				}
+				barrier(CLK_LOCAL_MEM_FENCE);
+			}
+
+			if(i >= n) return;
+			MSA_GRID_FOR_EACH_NEIGHBOR(p, j) {
+				a += msa_nbody_accel(p, (float4)(pos[j].xyz, msa_nbody_mass(mass, lifetime, useLifetime, j)), softening2);
+			}
+			accel[i] = !useLifetime || lifetime[i] > 0 ? (float4)(a * G, 0) : (float4)(0);
+		}
+
+		// force kernel for OpenCLParticleSystem
+		// numAccel is the number of bodies in the last compute (particles emitted since, past it, have no acceleration yet)
+		__kernel void msa_nbody_apply(__global const float4 *pos, __global float4 *vel, __global const float *mass, __global const float *lifetime, const int numParticles, const float dt, __global const float4 *accel, const int numAccel) {
+			int i = get_global_id(0);
+			if(i >= numParticles || i >= numAccel || lifetime[i] <= 0) return;
+			vel[i] += accel[i] * dt;
+		}
+	);
+
+
+	OpenCLNBody::OpenCLNBody() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLNBody::OpenCLNBody");
+		softening2	= 1;
+		G			= 1;
+		useGrid		= false;
+		numAccel	= 0;
+	}
+
+
+	void OpenCLNBody::setGridApproximation(float cellSize, int numCellsX, int numCellsY, int numCellsZ, float originX, float originY, float originZ) {
+		grid.setup(cellSize, numCellsX, numCellsY, numCellsZ, originX, originY, originZ);
+		useGrid = true;
+	}
+
+
+	void OpenCLNBody::computeAccelerations(OpenCLBuffer &pos, OpenCLBuffer &mass, int numBodies, OpenCLBuffer *lifetime) {
+		if(numBodies <= 0) return;
+		if(accel.getCapacity() < numBodies * sizeof(cl_float4)) {
+			accel.initBuffer(numBodies * sizeof(cl_float4), CL_MEM_READ_WRITE);
+			accel.setLabel("nbody accel");
+		}
+
+		// without lifetimes, mass is bound in its place (and not read)
+		OpenCLBuffer &alive		= lifetime ? *lifetime : mass;
+		cl_int useLifetime		= lifetime != NULL;
+		cl_int n				= numBodies;
+		cl_float s2				= softening2;
+		cl_float g				= G;
+
+		OpenCLKernel *kernel;
+		if(useGrid) {
+			grid.build(pos, numBodies);
+
+			cl_int numCells = grid.getNumCells();
+			if(cellBodies.getCapacity() < numCells * sizeof(cl_float4)) cellBodies.initBuffer(numCells * sizeof(cl_float4), CL_MEM_READ_WRITE);
+
+			kernel = loadNBodyKernel("msa_nbody_cells");
+			kernel->setArg(0, pos, CL_MEM_READ_ONLY);
+			kernel->setArg(1, mass, CL_MEM_READ_ONLY);
+			kernel->setArg(2, alive, CL_MEM_READ_ONLY);
+			kernel->setArg(3, useLifetime);
+			kernel->setArg(4, cellBodies, CL_MEM_WRITE_ONLY);
+			kernel->setArg(5, numCells);
+			kernel->setArg(6, grid.getCellStartBuffer(), CL_MEM_READ_ONLY);
+			kernel->setArg(7, grid.getCellEndBuffer(), CL_MEM_READ_ONLY);
+			kernel->setArg(8, grid.getIndexBuffer(), CL_MEM_READ_ONLY);
+			kernel->run1D(numCells);
+
+			kernel = loadNBodyKernel("msa_nbody_grid");
+			kernel->setArg(8, cellBodies, CL_MEM_READ_ONLY);
+			kernel->setArg(9, numCells);
+			grid.setKernelArgs(kernel, 11);
+		} else {
+			kernel = loadNBodyKernel("msa_nbody_tiled");
+		}
+
+		size_t localSize = getLocalSize(kernel);
+		kernel->setArg(0, pos, CL_MEM_READ_ONLY);
+		kernel->setArg(1, mass, CL_MEM_READ_ONLY);
+		kernel->setArg(2, alive, CL_MEM_READ_ONLY);
+		kernel->setArg(3, useLifetime);
+		kernel->setArg(4, accel, CL_MEM_WRITE_ONLY);
+		kernel->setArg(5, n);
+		kernel->setArg(6, s2);
+		kernel->setArg(7, g);
+		kernel->setLocalArg(useGrid ? 10 : 8, localSize * sizeof(cl_float4));
+		kernel->run1D((numBodies + localSize - 1) / localSize * localSize, localSize);
+
+		numAccel = numBodies;
+
+		// accel may have been reallocated
+		bindApplyArgs();
+	}
+
+
+	void OpenCLNBody::computeAccelerations(OpenCLParticleSystem &particles) {
+		computeAccelerations(particles.getPosBuffer(), particles.getMassBuffer(), particles.getNumActive(), &particles.getLifetimeBuffer());
+	}
+
+
+	OpenCLKernel *OpenCLNBody::getForceKernel() {
+		// make sure there's something to bind before the first computeAccelerations
+		if(accel.getCapacity() == 0) accel.initBuffer(sizeof(cl_float4), CL_MEM_READ_WRITE);
+		return bindApplyArgs();
+	}
+
+
+	OpenCLKernel *OpenCLNBody::bindApplyArgs() {
+		cl_int n = numAccel;
+		OpenCLKernel *kernel = loadNBodyKernel("msa_nbody_apply");
+		kernel->setArg(6, accel, CL_MEM_READ_ONLY);
+		kernel->setArg(7, n);
+		return kernel;
+	}
+
+
+	OpenCLKernel *OpenCLNBody::loadNBodyKernel(string kernelName) {
+		return OpenCL::currentOpenCL->loadBuiltinKernel(kernelName, "MSAOpenCLNBody", OpenCLSpatialGrid::getKernelHeader() + nbodySource);
+	}
+
+
+	size_t OpenCLNBody::getLocalSize(OpenCLKernel *kernel) {
+		// largest power of two the kernel can run with, up to 256
+		size_t localSize = min((size_t)256, kernel->getWorkGroupSize());
+		while(localSize & (localSize - 1)) localSize &= localSize - 1;
+		return localSize;
+	}
+}
@@ -0,0 +1,98 @@
+/***********************************************************************
+
+ OpenCL N-Body
+ Gravitational accelerations between all pairs of bodies (float4 positions and float masses in OpenCLBuffers).
+ Each work-group loads the bodies a tile at a time into local memory, so every body is read from global memory
+ once per work-group rather than once per body. Softening keeps close encounters finite.
+
+ For large numbers of bodies there is a grid approximation: bodies in the 27 cells around a body are summed exactly,
+ and every other cell acts as a single body at its centre of mass (the cells are found with OpenCLSpatialGrid),
+ so the cost per body is the number of nearby bodies plus the number of cells, instead of the number of bodies.
+
+ The accelerations are left in getAccelBuffer(), and getForceKernel() is a force for OpenCLParticleSystem which adds them to the velocities.
+
+ e.g.:
+ OpenCLNBody nbody;
+ nbody.setSoftening(5);
+ nbody.setGridApproximation(32, 64, 64);		// optional: 64 x 64 cells of 32 x 32
+ particles.addForce(nbody.getForceKernel());
+ ...
+ nbody.computeAccelerations(particles);			// before every particles.update
+ particles.update(dt);
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCLBuffer.h"
+#include "MSAOpenCLSpatialGrid.h"
+
+namespace msa {
+
+	class OpenCLKernel;
+	class OpenCLParticleSystem;
+
+	class OpenCLNBody {
+	public:
+
+		OpenCLNBody();
+
+		// distance added (in quadrature) to every pair's distance
+		void setSoftening(float softening) {
+			softening2 = softening * softening;
+		}
+
+		void setGravitationalConstant(float G) {
+			this->G = G;
+		}
+
+		// approximate bodies more than a cell away by the centre of mass of their cell (see OpenCLSpatialGrid::setup for the parameters)
+		// parameters with default values can be omited
+		void setGridApproximation(float cellSize,
+								  int numCellsX,
+								  int numCellsY,
+								  int numCellsZ = 1,
+								  float originX = 0,
+								  float originY = 0,
+								  float originZ = 0);
+
+		// back to summing all pairs exactly
+		void disableGridApproximation() {
+			useGrid = false;
+		}
+
+		// accelerations (float4s, w = 0) of the first numBodies bodies into getAccelBuffer()
+		// if lifetime is passed in (floats), bodies with lifetime <= 0 are ignored
+		void computeAccelerations(OpenCLBuffer &pos,
+								  OpenCLBuffer &mass,
+								  int numBodies,
+								  OpenCLBuffer *lifetime = NULL);
+
+		// same as above, for the active particles of a particle system
+		void computeAccelerations(OpenCLParticleSystem &particles);
+
+		// force kernel for OpenCLParticleSystem::addForce, which adds the last accelerations to the velocities
+		// (particles emitted after the last computeAccelerations, past the bodies it computed, are left alone until the next one)
+		OpenCLKernel *getForceKernel();
+
+		OpenCLBuffer &getAccelBuffer() {
+			return accel;
+		}
+
+
+	protected:
+		float				softening2;
+		float				G;
+		bool				useGrid;
+		OpenCLBuffer		accel;
+		int					numAccel;		// number of bodies in the last computeAccelerations (0 before the first)
+		OpenCLBuffer		cellBodies;		// centre of mass (xyz) and mass (w) of each cell
+		OpenCLSpatialGrid	grid;
+
+		OpenCLKernel *loadNBodyKernel(string kernelName);
+		OpenCLKernel *bindApplyArgs();		// accel and numAccel, for msa_nbody_apply
+		size_t getLocalSize(OpenCLKernel *kernel);
+	};
+}
@@ -0,0 +1,283 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLParticleSystem.h"
+
+namespace msa {
+
+	// compiled after OpenCLRandom::getKernelHeader()
+	// dead particles have lifetime 0
+	// freeList is a stack of free slots, freeCount its size
+	static const string particlesSource = MSA_OPENCL_SOURCE(
+		// one work-item per particle to spawn, each pops a free slot (if there are any left)
+		__kernel void msa_particles_emit(__global float4 *pos, __global float4 *vel, __global float4 *color, __global float *mass, __global float *age, __global float *lifetime, __global const int *freeList, volatile __global int *freeCount,
+										 const int count, const uint seed, const float4 position, const float4 positionSpread, const float4 velocity, const float4 velocitySpread, const float4 emitColor, const float2 massRange, const float2 lifetimeRange) {
+			int k = get_global_id(0);
+			if(k >= count) return;
+
+			int top = atomic_dec(freeCount);
+			if(top <= 0) {
+				atomic_inc(freeCount);
+				return;
+			}
+			int i = freeList[top - 1];
+
+			// seed changes every emit, so the counter only needs the particle's number within this emit
+			uint2 key	= (uint2)(seed, 0);
+			float4 r	= msa_random_uniform4((uint4)(k, 2, 0, 0), key);
+			pos[i]		= position + positionSpread * (msa_random_uniform4((uint4)(k, 0, 0, 0), key) * 2.0f - 1.0f);
+			vel[i]		= velocity + velocitySpread * (msa_random_uniform4((uint4)(k, 1, 0, 0), key) * 2.0f - 1.0f);
+			color[i]	= emitColor;
+			mass[i]		= mix(massRange.x, massRange.y, r.x);
+			age[i]		= 0;
+			lifetime[i]	= mix(lifetimeRange.x, lifetimeRange.y, r.y);
+		}
+
+		__kernel void msa_particles_integrate(__global float4 *pos, __global float4 *vel, __global float4 *color, __global float *age, __global float *lifetime, __global int *freeList, volatile __global int *freeCount,
+											  const int numParticles, const float dt, const float4 gravity, const float damping) {
+			int i = get_global_id(0);
+			if(i >= numParticles) return;
+
+			float life = lifetime[i];
+			if(life <= 0) return;
+
+			float a = age[i] + dt;
+			if(a >= life) {
+				lifetime[i]	= 0;
+				color[i].w	= 0;
+				freeList[atomic_inc(freeCount)] = i;
+				return;
+			}
+			age[i] = a;
+
+			float4 v	= (vel[i] + gravity * dt) * damping;
+			vel[i]		= v;
+			pos[i]		+= v * dt;
+		}
+
+		__kernel void msa_particles_alive(__global const float *lifetime, __global int *flags, const int numParticles) {
+			int i = get_global_id(0);
+			if(i >= numParticles) return;
+			flags[i] = lifetime[i] > 0;
+		}
+
+		// mark slots [numAlive, maxParticles) dead, and make them the free list (lowest slot on top)
+		__kernel void msa_particles_reset(__global float4 *color, __global float *lifetime, __global int *freeList, __global int *freeCount, const int numAlive, const int maxParticles) {
+			int i = get_global_id(0);
+			if(i == 0) *freeCount = maxParticles - numAlive;
+
+			int slot = numAlive + i;
+			if(slot >= maxParticles) return;
+			lifetime[slot]	= 0;
+			color[slot].w	= 0;
+			freeList[maxParticles - 1 - slot] = slot;
+		}
+	);
+
+
+	OpenCLParticleSystem::OpenCLParticleSystem() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLParticleSystem::OpenCLParticleSystem");
+		maxParticles		= 0;
+		numActive			= 0;
+		compactInterval		= 60;
+		updatesSinceCompact	= 0;
+		damping				= 1;
+		seed				= 0;
+		setGravity(0, 0, 0);
+	}
+
+
+	void OpenCLParticleSystem::initParticleSystem(int maxParticles, GLuint posVbo, GLuint colorVbo) {
+		ofLog(OF_LOG_VERBOSE, "OpenCLParticleSystem::initParticleSystem " + ofToString(maxParticles));
+
+		this->maxParticles	= maxParticles;
+		numActive			= 0;
+		updatesSinceCompact	= 0;
+
+		if(posVbo) pos.initFromGLObject(posVbo);
+		else pos.initBuffer(maxParticles * sizeof(cl_float4));
+
+		if(colorVbo) color.initFromGLObject(colorVbo);
+		else color.initBuffer(maxParticles * sizeof(cl_float4));
+
+		vel.initBuffer(maxParticles * sizeof(cl_float4));
+		mass.initBuffer(maxParticles * sizeof(cl_float));
+		age.initBuffer(maxParticles * sizeof(cl_float));
+		lifetime.initBuffer(maxParticles * sizeof(cl_float));
+		freeList.initBuffer(maxParticles * sizeof(cl_int));
+		freeCount.initBuffer(sizeof(cl_int));
+
+		pos.setLabel("particle pos");
+		vel.setLabel("particle vel");
+		color.setLabel("particle color");
+		mass.setLabel("particle mass");
+		age.setLabel("particle age");
+		lifetime.setLabel("particle lifetime");
+
+		resetDead(0);
+	}
+
+
+	void OpenCLParticleSystem::addForce(OpenCLKernel *kernel) {
+		assert(kernel);
+		forces.push_back(kernel);
+	}
+
+
+	void OpenCLParticleSystem::removeForce(OpenCLKernel *kernel) {
+		forces.erase(std::remove(forces.begin(), forces.end(), kernel), forces.end());
+	}
+
+
+	void OpenCLParticleSystem::addEmitter(OpenCLParticleEmitter *emitter) {
+		assert(emitter);
+		emitters.push_back(emitter);
+	}
+
+
+	void OpenCLParticleSystem::removeEmitter(OpenCLParticleEmitter *emitter) {
+		emitters.erase(std::remove(emitters.begin(), emitters.end(), emitter), emitters.end());
+	}
+
+
+	void OpenCLParticleSystem::emit(OpenCLParticleEmitter &emitter, int count) {
+		if(count <= 0 || maxParticles == 0) return;
+
+		cl_int n = count;
+		cl_float2 massRange, lifetimeRange;
+		massRange.s[0]		= emitter.massMin;
+		massRange.s[1]		= emitter.massMax;
+		lifetimeRange.s[0]	= emitter.lifetimeMin;
+		lifetimeRange.s[1]	= emitter.lifetimeMax;
+		seed++;
+
+		OpenCLKernel *kernel = loadParticleKernel("msa_particles_emit");
+		kernel->setArg(0, pos, CL_MEM_WRITE_ONLY);
+		kernel->setArg(1, vel, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, color, CL_MEM_WRITE_ONLY);
+		kernel->setArg(3, mass, CL_MEM_WRITE_ONLY);
+		kernel->setArg(4, age, CL_MEM_WRITE_ONLY);
+		kernel->setArg(5, lifetime, CL_MEM_WRITE_ONLY);
+		kernel->setArg(6, freeList, CL_MEM_READ_ONLY);
+		kernel->setArg(7, freeCount, CL_MEM_READ_WRITE);
+		kernel->setArg(8, n);
+		kernel->setArg(9, seed);
+		kernel->setArg(10, emitter.position);
+		kernel->setArg(11, emitter.positionSpread);
+		kernel->setArg(12, emitter.velocity);
+		kernel->setArg(13, emitter.velocitySpread);
+		kernel->setArg(14, emitter.color);
+		kernel->setArg(15, massRange);
+		kernel->setArg(16, lifetimeRange);
+		kernel->run1D(count);
+
+		// slots are either reused from particles which died in the active range, or the lowest ones after it
+		numActive = min(maxParticles, numActive + count);
+	}
+
+
+	void OpenCLParticleSystem::update(float dt) {
+		if(maxParticles == 0) return;
+
+		for(int i=0; i<emitters.size(); i++) {
+			OpenCLParticleEmitter &e = *emitters[i];
+			float n		= e.rate * dt + e.remainder;
+			int count	= n;
+			e.remainder	= n - count;
+			emit(e, count);
+		}
+
+		if(numActive == 0) return;
+
+		cl_int n		= numActive;
+		cl_float fdt	= dt;
+		for(int i=0; i<forces.size(); i++) {
+			OpenCLKernel *kernel = forces[i];
+			kernel->setArg(0, pos, CL_MEM_READ_ONLY);
+			kernel->setArg(1, vel, CL_MEM_READ_WRITE);
+			kernel->setArg(2, mass, CL_MEM_READ_ONLY);
+			kernel->setArg(3, lifetime, CL_MEM_READ_ONLY);
+			kernel->setArg(4, n);
+			kernel->setArg(5, fdt);
+			kernel->run1D(numActive);
+		}
+
+		cl_float d = damping;
+		OpenCLKernel *kernel = loadParticleKernel("msa_particles_integrate");
+		kernel->setArg(0, pos, CL_MEM_READ_WRITE);
+		kernel->setArg(1, vel, CL_MEM_READ_WRITE);
+		kernel->setArg(2, color, CL_MEM_READ_WRITE);
+		kernel->setArg(3, age, CL_MEM_READ_WRITE);
+		kernel->setArg(4, lifetime, CL_MEM_READ_WRITE);
+		kernel->setArg(5, freeList, CL_MEM_READ_WRITE);
+		kernel->setArg(6, freeCount, CL_MEM_READ_WRITE);
+		kernel->setArg(7, n);
+		kernel->setArg(8, fdt);
+		kernel->setArg(9, gravity);
+		kernel->setArg(10, d);
+		kernel->run1D(numActive);
+
+		if(compactInterval > 0 && ++updatesSinceCompact >= compactInterval) compact();
+	}
+
+
+	int OpenCLParticleSystem::compact() {
+		updatesSinceCompact = 0;
+		if(numActive == 0) return 0;
+
+		if(aliveFlags.getCapacity() < maxParticles * sizeof(cl_int)) aliveFlags.initBuffer(maxParticles * sizeof(cl_int));
+		if(compactTemp.getCapacity() < maxParticles * sizeof(cl_float4)) compactTemp.initBuffer(maxParticles * sizeof(cl_float4));
+
+		cl_int n = numActive;
+		OpenCLKernel *kernel = loadParticleKernel("msa_particles_alive");
+		kernel->setArg(0, lifetime, CL_MEM_READ_ONLY);
+		kernel->setArg(1, aliveFlags, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, n);
+		kernel->run1D(numActive);
+
+		// the flags are scanned once, then every attribute is compacted with them
+		int numAlive = scan.compact(lifetime, compactTemp, aliveFlags, numActive, sizeof(cl_float), true);
+		if(numAlive > 0) lifetime.copyFrom(compactTemp, 0, 0, numAlive * sizeof(cl_float));
+		compactAttribute(pos, sizeof(cl_float4), numAlive);
+		compactAttribute(vel, sizeof(cl_float4), numAlive);
+		compactAttribute(color, sizeof(cl_float4), numAlive);
+		compactAttribute(mass, sizeof(cl_float), numAlive);
+		compactAttribute(age, sizeof(cl_float), numAlive);
+
+		resetDead(numAlive);
+		numActive = numAlive;
+		return numAlive;
+	}
+
+
+	int OpenCLParticleSystem::readNumAlive() {
+		if(maxParticles == 0) return 0;
+		cl_int count;
+		freeCount.read(&count, 0, sizeof(count), CL_TRUE);
+		return maxParticles - count;
+	}
+
+
+	OpenCLKernel *OpenCLParticleSystem::loadParticleKernel(string kernelName) {
+		return OpenCL::currentOpenCL->loadBuiltinKernel(kernelName, "MSAOpenCLParticleSystem", OpenCLRandom::getKernelHeader() + particlesSource);
+	}
+
+
+	void OpenCLParticleSystem::compactAttribute(OpenCLBuffer &attribute, int elementSize, int numAlive) {
+		if(numAlive == 0) return;
+		scan.compactAgain(attribute, compactTemp, elementSize);
+		attribute.copyFrom(compactTemp, 0, 0, numAlive * elementSize);
+	}
+
+
+	void OpenCLParticleSystem::resetDead(int numAlive) {
+		cl_int alive	= numAlive;
+		cl_int maxP		= maxParticles;
+		OpenCLKernel *kernel = loadParticleKernel("msa_particles_reset");
+		kernel->setArg(0, color, CL_MEM_READ_WRITE);
+		kernel->setArg(1, lifetime, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, freeList, CL_MEM_WRITE_ONLY);
+		kernel->setArg(3, freeCount, CL_MEM_WRITE_ONLY);
+		kernel->setArg(4, alive);
+		kernel->setArg(5, maxP);
+		kernel->run1D(max(1, maxParticles - numAlive));
+	}
+}
@@ -0,0 +1,165 @@
+/***********************************************************************
+
+ OpenCL Particle System
+ Particles stored as a structure of arrays: one OpenCLBuffer per attribute
+ (pos, vel and color are float4, mass, age and lifetime are float),
+ so kernels only load the attributes they use, with coalesced reads and no padding.
+
+ Each update:
+ - emitters spawn new particles into free slots, taken from a free list on the device with atomics
+ - force kernels (added with addForce) change the velocities
+ - velocities and positions are integrated, particles age, and those older than their lifetime die
+   (dead particles have lifetime 0 and color alpha 0, and their slot goes back on the free list)
+ - every so often live particles are compacted to the start of the buffers, so kernels only need to run over a dense range
+
+ Force kernels should look like:
+ __kernel void myForce(__global const float4 *pos, __global float4 *vel, __global const float *mass, __global const float *lifetime, const int numParticles, const float dt, ...) {
+	int i = get_global_id(0);
+	if(i >= numParticles || lifetime[i] <= 0) return;		// skip dead particles
+	vel[i] += ...;
+ }
+ (arguments after dt are set on the kernel as usual, before update)
+
+ e.g.:
+ OpenCLParticleSystem particles;
+ particles.initParticleSystem(1000000, posVbo, colorVbo);		// VBOs of float4s to draw from (optional)
+ particles.addForce(openCL.kernel("myForce"));
+ OpenCLParticleEmitter emitter;
+ emitter.rate = 10000;											// particles per second
+ particles.addEmitter(&emitter);
+ ...
+ particles.update(ofGetLastFrameTime());
+ glDrawArrays(GL_POINTS, 0, particles.getNumActive());
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCLBuffer.h"
+#include "MSAOpenCLScan.h"
+
+namespace msa {
+
+	class OpenCLKernel;
+
+	// new particles get random values within these ranges
+	struct OpenCLParticleEmitter {
+		cl_float4	position;
+		cl_float4	positionSpread;		// half size of the box around position
+		cl_float4	velocity;
+		cl_float4	velocitySpread;		// half size of the box around velocity
+		cl_float4	color;
+		cl_float	massMin, massMax;
+		cl_float	lifetimeMin, lifetimeMax;	// in seconds, FLT_MAX for particles which never die
+		float		rate;				// particles per second
+		float		remainder;			// fraction of a particle left over from the last update
+
+		OpenCLParticleEmitter() {
+			memset(this, 0, sizeof(*this));
+			color.s[0] = color.s[1] = color.s[2] = color.s[3] = 1;
+			massMin		= massMax = 1;
+			lifetimeMin	= lifetimeMax = 1;
+		}
+	};
+
+
+	class OpenCLParticleSystem {
+	public:
+
+		OpenCLParticleSystem();
+
+		// allocate attributes for up to maxParticles particles (all dead to start with)
+		// if posVbo and / or colorVbo are passed in, those attributes are stored in them (they need room for maxParticles float4s)
+		// parameters with default values can be omited
+		void initParticleSystem(int maxParticles,
+								GLuint posVbo = 0,
+								GLuint colorVbo = 0);
+
+		// force kernels are run every update, in the order they were added (see above for their arguments)
+		void addForce(OpenCLKernel *kernel);
+		void removeForce(OpenCLKernel *kernel);
+
+		// emitters spawn rate particles per second every update. They're not owned by the particle system
+		void addEmitter(OpenCLParticleEmitter *emitter);
+		void removeEmitter(OpenCLParticleEmitter *emitter);
+
+		// spawn count particles straight away (as many as there are free slots for)
+		void emit(OpenCLParticleEmitter &emitter, int count);
+
+		// emit, run forces, integrate (dt in seconds), and compact if it's time
+		void update(float dt);
+
+		// move live particles to the start of the buffers, so that getNumActive is the number of live particles
+		// returns the number of live particles (this reads back from the device, so blocks)
+		int compact();
+
+		// compact every this many updates (0 for never)
+		void setCompactInterval(int numUpdates) {
+			compactInterval = numUpdates;
+		}
+
+		// velocities are multiplied by this every update
+		void setDamping(float damping) {
+			this->damping = damping;
+		}
+
+		void setGravity(float x, float y, float z = 0) {
+			gravity.s[0] = x;
+			gravity.s[1] = y;
+			gravity.s[2] = z;
+			gravity.s[3] = 0;
+		}
+
+		// all live particles are in [0, getNumActive()) (some particles in that range may be dead)
+		// kernels (and drawing) only need to cover this range
+		int getNumActive() {
+			return numActive;
+		}
+
+		int getMaxParticles() {
+			return maxParticles;
+		}
+
+		// number of live particles (reads back from the device, so blocks)
+		int readNumAlive();
+
+		OpenCLBuffer &getPosBuffer()		{ return pos; }
+		OpenCLBuffer &getVelBuffer()		{ return vel; }
+		OpenCLBuffer &getColorBuffer()		{ return color; }
+		OpenCLBuffer &getMassBuffer()		{ return mass; }
+		OpenCLBuffer &getAgeBuffer()		{ return age; }
+		OpenCLBuffer &getLifetimeBuffer()	{ return lifetime; }
+
+
+	protected:
+		int				maxParticles;
+		int				numActive;
+		int				compactInterval;
+		int				updatesSinceCompact;
+		float			damping;
+		cl_float4		gravity;
+		cl_uint			seed;
+
+		OpenCLBuffer	pos;
+		OpenCLBuffer	vel;
+		OpenCLBuffer	color;
+		OpenCLBuffer	mass;
+		OpenCLBuffer	age;
+		OpenCLBuffer	lifetime;
+
+		OpenCLBuffer	freeList;		// indices of dead particles, used as a stack
+		OpenCLBuffer	freeCount;		// single int, size of the stack
+		OpenCLBuffer	aliveFlags;		// for compact
+		OpenCLBuffer	compactTemp;
+		OpenCLScan		scan;
+
+		vector<OpenCLKernel*>			forces;
+		vector<OpenCLParticleEmitter*>	emitters;
+
+		OpenCLKernel *loadParticleKernel(string kernelName);
+		void compactAttribute(OpenCLBuffer &attribute, int elementSize, int numAlive);
+		void resetDead(int numAlive);
+	};
+}
@@ -0,0 +1,185 @@
+/***********************************************************************
+
+ OpenCL Ping Pong
+ A ring of N (2 or more) buffers or images, for kernels which read the previous state and write the next one.
+ Unlike OpenCLImagePingPong it works with OpenCLBuffer and with images made with initWithoutTexture (so needs no GL context),
+ and with more than two slots: with three, a frame can read slot 1 and write slot 0 while slot 2 (the one before) is displayed or read back.
+
+ Slots are addressed by age: 0 is the target being written, 1 the last one written, 2 the one before that, and so on.
+ getSlot(age) is a stand in for the slot of that age to use as a kernel argument: it follows the ring as it moves,
+ and when a kernel which has getSlot(0) set as writable (CL_MEM_WRITE_ONLY or CL_MEM_READ_WRITE) runs, the ring moves on by itself
+ (turn that off with setAutoSwap(false) for kernels which write the target in several passes, and call swap yourself).
+
+ e.g.:
+ OpenCLPingPong<OpenCLImage> state;
+ state.setup(3);
+ state.initWithoutTexture(512, 512);
+ kernel->setArg(0, state.getSlot(1), CL_MEM_READ_ONLY);		// previous state
+ kernel->setArg(1, state.getSlot(0), CL_MEM_WRITE_ONLY);		// next state
+ ...
+ kernel->run2D(512, 512);										// writes the target, then the ring moves on
+ state.getObject(2).read(pixels, CL_FALSE);						// the state before last, which nothing is using
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCL.h"
+
+namespace msa {
+
+	template<class T> class OpenCLPingPong;
+
+
+	// one slot of an OpenCLPingPong, by age, as a kernel argument
+	// its cl_mem is the current slot's, looked up every time a kernel using it runs
+	template<class T>
+	class OpenCLPingPongSlot : public OpenCLMemoryObject {
+	public:
+		~OpenCLPingPongSlot() {
+			clMemObject = NULL;		// belongs to the ring's object
+		}
+
+	protected:
+		friend class OpenCLPingPong<T>;
+
+		OpenCLPingPong<T>	*ring;
+		int					age;
+		vector<T*>			pinned;		// objects pinned while a kernel using this is enqueued
+
+		void update() {
+			clMemObject = ring->getObject(age).getResidentCLMem();
+		}
+
+		virtual void kernelWillRun(OpenCLKernel *kernel, cl_mem_flags access) {
+			T &object = ring->getObject(age);
+			object.pin();
+			pinned.push_back(&object);
+			update();
+		}
+
+		virtual void kernelDidRun(OpenCLKernel *kernel, cl_mem_flags access) {
+			if(!pinned.empty()) {
+				pinned.back()->unpin();
+				pinned.pop_back();
+			}
+			if(age == 0 && (access & (CL_MEM_WRITE_ONLY | CL_MEM_READ_WRITE))) ring->targetWasWritten();
+		}
+	};
+
+
+
+	template<class T>
+	class OpenCLPingPong {
+	public:
+
+		OpenCLPingPong() {
+			current		= 0;
+			autoSwap	= true;
+		}
+
+		~OpenCLPingPong() {
+			clear();
+		}
+
+		// numSlots (at least 2) objects, not initialized yet: use the init functions below, or initialize each with getObject
+		void setup(int numSlots = 2) {
+			ofLog(OF_LOG_VERBOSE, "OpenCLPingPong::setup " + ofToString(numSlots));
+			assert(numSlots >= 2);
+			clear();
+			for(int i=0; i<numSlots; i++) {
+				objects.push_back(new T());
+				OpenCLPingPongSlot<T> *slot = new OpenCLPingPongSlot<T>();
+				slot->ring	= this;
+				slot->age	= i;
+				slots.push_back(slot);
+			}
+			current = 0;
+		}
+
+
+		// for OpenCLPingPong<OpenCLBuffer>, see OpenCLBuffer::initBuffer
+		void initBuffer(size_t numberOfBytes,
+						cl_mem_flags memFlags = CL_MEM_READ_WRITE) {
+			for(int i=0; i<objects.size(); i++) objects[i]->initBuffer(numberOfBytes, memFlags);
+		}
+
+		// for OpenCLPingPong<OpenCLImage>, see OpenCLImage::initWithoutTexture
+		void initWithoutTexture(int width,
+								int height,
+								int depth = 1,
+								cl_channel_order imageChannelOrder = CL_RGBA,
+								cl_channel_type imageChannelDataType = CL_FLOAT,
+								cl_mem_flags memFlags = CL_MEM_READ_WRITE) {
+			for(int i=0; i<objects.size(); i++) objects[i]->initWithoutTexture(width, height, depth, imageChannelOrder, imageChannelDataType, memFlags);
+		}
+
+
+		// the ring moves on: the target becomes age 1, and the oldest slot becomes the new target
+		void swap() {
+			current = (current + 1) % objects.size();
+		}
+
+		// move on automatically when a kernel writing getSlot(0) runs (true by default)
+		void setAutoSwap(bool autoSwap) {
+			this->autoSwap = autoSwap;
+		}
+
+
+		// kernel argument for the slot of this age
+		// (set this with OpenCLKernel::setArg, rather than its cl_mem, so that it follows the ring)
+		OpenCLMemoryObject &getSlot(int age) {
+			assert(age >= 0 && age < slots.size());
+			OpenCLPingPongSlot<T> &slot = *slots[age];
+			slot.update();
+			return slot;
+		}
+
+		// the object currently at age, e.g. to read it back or draw it
+		T &getObject(int age) {
+			int n = objects.size();
+			assert(age >= 0 && age < n);
+			return *objects[(current - age + n) % n];
+		}
+
+		// same names as PingPong
+		T &getTarget() {
+			return getObject(0);
+		}
+
+		T &getSource() {
+			return getObject(1);
+		}
+
+		int getNumSlots() {
+			return objects.size();
+		}
+
+
+	protected:
+		friend class OpenCLPingPongSlot<T>;
+
+		vector<T*>						objects;
+		vector<OpenCLPingPongSlot<T>*>	slots;
+		int								current;		// index of the target in objects
+		bool							autoSwap;
+
+		void targetWasWritten() {
+			if(autoSwap) swap();
+		}
+
+		void clear() {
+			for(int i=0; i<slots.size(); i++) delete slots[i];
+			for(int i=0; i<objects.size(); i++) delete objects[i];
+			slots.clear();
+			objects.clear();
+		}
+
+	private:
+		// not copyable (it owns the objects and slots, and the slots point back to it)
+		OpenCLPingPong(const OpenCLPingPong &);
+		OpenCLPingPong &operator=(const OpenCLPingPong &);
+	};
+}
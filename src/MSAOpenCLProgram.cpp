@@ -21,7 +21,7 @@ namespace msa {
 	}
 	
 	
-	void OpenCLProgram::loadFromFile(std::string filename, bool isBinary) { 
+	void OpenCLProgram::loadFromFile(std::string filename, bool isBinary, std::string header) { 
 		ofLog(OF_LOG_VERBOSE, "OpenCLProgram::loadFromFile " + filename + ", isBinary: " + ofToString(isBinary));
 		
 		string fullPath = ofToDataPath(filename.c_str());
@@ -39,7 +39,7 @@ namespace msa {
 				assert(false); 
 			}
 			
-			loadFromSource(source);
+			loadFromSource(header + source);
 			
 			free(source);
 		}
@@ -3,6 +3,10 @@
 #include "ofMain.h"
 #include <OpenCL/Opencl.h>
 
+// wraps OpenCL C source in a string literal, used for the kernels built into the library
+// (preprocessor directives can't go inside, prepend them as separate string literals)
+#define MSA_OPENCL_SOURCE(...)	#__VA_ARGS__
+
 namespace msa { 
 	
 	class OpenCL;
@@ -13,7 +17,8 @@ namespace msa {
 		OpenCLProgram();
 		~OpenCLProgram();
 		
-		void loadFromFile(string filename, bool isBinary = false);
+		// header is prepended to the file's source
+		void loadFromFile(string filename, bool isBinary = false, string header = "");
 		void loadFromSource(string source);
 		
 		OpenCLKernel* loadKernel(string kernelName);
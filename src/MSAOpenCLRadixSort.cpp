@@ -0,0 +1,183 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLRadixSort.h"
+
+namespace msa {
+
+	// a tile is one element per work-item, so every work-group handles one tile
+	static const string sortSource = MSA_OPENCL_SOURCE(
+		// flip float bits so that they sort as uints in the same order as the floats (and back)
+		__kernel void msa_sort_float_to_key(__global uint *keys, const int n) {
+			int i = get_global_id(0);
+			if(i >= n) return;
+			uint f = keys[i];
+			keys[i] = f ^ ((f >> 31) ? 0xffffffff : 0x80000000);
+		}
+
+		__kernel void msa_sort_key_to_float(__global uint *keys, const int n) {
+			int i = get_global_id(0);
+			if(i >= n) return;
+			uint k = keys[i];
+			keys[i] = k ^ ((k >> 31) ? 0x80000000 : 0xffffffff);
+		}
+
+		// counts is digit major: counts[digit * numTiles + tile]
+		__kernel void msa_sort_count(__global const uint *keys, __global uint *counts, const int n, const int shift, __local uint *lCounts) {
+			int lid	= get_local_id(0);
+			int i	= get_global_id(0);
+			if(lid < 16) lCounts[lid] = 0;
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			if(i < n) atomic_inc(&lCounts[(keys[i] >> shift) & 15]);
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			if(lid < 16) counts[lid * get_num_groups(0) + get_group_id(0)] = lCounts[lid];
+		}
+
+		// offsets is the exclusive scan of counts
+		__kernel void msa_sort_scatter(__global const uint *keysIn, __global const uint *valuesIn, __global uint *keysOut, __global uint *valuesOut, __global const uint *offsets, const int n, const int shift, const int hasValues, __local uint *lKeys, __local uint *lValues, __local uint *lScan) {
+			int lid			= get_local_id(0);
+			int localSize	= get_local_size(0);
+			int i			= get_global_id(0);
+			int tileCount	= min(localSize, n - (int)get_group_id(0) * localSize);
+
+			// padding has all bits set, so it's always sorted to the end of the tile
+			uint key	= i < n ? keysIn[i] : 0xffffffff;
+			uint value	= hasValues && i < n ? valuesIn[i] : 0;
+
+			// stable sort of the tile by the digit, one bit at a time
+			for(int b = 0; b < 4; b++) {
+				uint bit = (key >> (shift + b)) & 1;
+				lScan[lid] = 1 - bit;
+				barrier(CLK_LOCAL_MEM_FENCE);
+				for(int offset = 1; offset < localSize; offset <<= 1) {
+					uint t = lid >= offset ? lScan[lid - offset] : 0;
+					barrier(CLK_LOCAL_MEM_FENCE);
+					lScan[lid] += t;
+					barrier(CLK_LOCAL_MEM_FENCE);
+				}
+
+				uint zerosBefore	= lScan[lid] - (1 - bit);
+				uint numZeros		= lScan[localSize - 1];
+				uint pos			= bit ? numZeros + lid - zerosBefore : zerosBefore;
+				lKeys[pos]		= key;
+				lValues[pos]	= value;
+				barrier(CLK_LOCAL_MEM_FENCE);
+				key		= lKeys[lid];
+				value	= lValues[lid];
+			}
+
+			// where each digit's run starts in the sorted tile
+			__local uint *lStart = lScan;
+			uint digit = (key >> shift) & 15;
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if(lid == 0 || digit != ((lKeys[lid - 1] >> shift) & 15)) lStart[digit] = lid;
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			if(lid < tileCount) {
+				uint pos = offsets[digit * get_num_groups(0) + get_group_id(0)] + lid - lStart[digit];
+				keysOut[pos] = key;
+				if(hasValues) valuesOut[pos] = value;
+			}
+		}
+	);
+
+
+	OpenCLRadixSort::OpenCLRadixSort() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLRadixSort::OpenCLRadixSort");
+	}
+
+
+	void OpenCLRadixSort::sort(OpenCLBuffer &keys, OpenCLBuffer *values, int numElements, OpenCLSortKeyType keyType, int numBits) {
+		if(numElements <= 1) return;
+		if(numElements * 4 > keys.getSize() || (values && numElements * 4 > values->getSize())) {
+			ofLog(OF_LOG_ERROR, "OpenCLRadixSort::sort - numElements is larger than the buffers");
+			assert(false);
+			return;
+		}
+
+		// all bits of floats are needed for them to sort correctly
+		if(keyType == OPENCL_SORT_FLOAT) numBits = 32;
+
+		size_t localSize	= getLocalSize();
+		cl_int numTiles		= (numElements + localSize - 1) / localSize;
+		cl_int n			= numElements;
+		cl_int hasValues	= values != NULL;
+
+		if(tempKeys.getCapacity() < numElements * 4) tempKeys.initBuffer(numElements * 4, CL_MEM_READ_WRITE);
+		if(values && tempValues.getCapacity() < numElements * 4) tempValues.initBuffer(numElements * 4, CL_MEM_READ_WRITE);
+		if(counts.getCapacity() < numTiles * 16 * 4) counts.initBuffer(numTiles * 16 * 4, CL_MEM_READ_WRITE);
+
+		if(keyType == OPENCL_SORT_FLOAT) {
+			OpenCLKernel *kernel = loadSortKernel("msa_sort_float_to_key");
+			kernel->setArg(0, keys, CL_MEM_READ_WRITE);
+			kernel->setArg(1, n);
+			kernel->run1D(numTiles * localSize, localSize);
+		}
+
+		// ping pong between the caller's buffers and the temporary ones
+		// (without values, the keys are passed in their place, but never touched)
+		OpenCLBuffer *keysIn		= &keys;
+		OpenCLBuffer *keysOut		= &tempKeys;
+		OpenCLBuffer *valuesIn		= values ? values : &keys;
+		OpenCLBuffer *valuesOut		= values ? &tempValues : &tempKeys;
+
+		OpenCLKernel *kernelCount	= loadSortKernel("msa_sort_count");
+		OpenCLKernel *kernelScatter	= loadSortKernel("msa_sort_scatter");
+		int numPasses = (numBits + 3) / 4;
+		for(int pass = 0; pass < numPasses; pass++) {
+			cl_int shift = pass * 4;
+
+			kernelCount->setArg(0, *keysIn, CL_MEM_READ_ONLY);
+			kernelCount->setArg(1, counts, CL_MEM_WRITE_ONLY);
+			kernelCount->setArg(2, n);
+			kernelCount->setArg(3, shift);
+			kernelCount->setLocalArg(4, 16 * 4);
+			kernelCount->run1D(numTiles * localSize, localSize);
+
+			scan.scan(counts, counts, numTiles * 16, OPENCL_SCAN_UINT, false);
+
+			kernelScatter->setArg(0, *keysIn, CL_MEM_READ_ONLY);
+			kernelScatter->setArg(1, *valuesIn, CL_MEM_READ_ONLY);
+			kernelScatter->setArg(2, *keysOut, CL_MEM_WRITE_ONLY);
+			kernelScatter->setArg(3, *valuesOut, CL_MEM_WRITE_ONLY);
+			kernelScatter->setArg(4, counts, CL_MEM_READ_ONLY);
+			kernelScatter->setArg(5, n);
+			kernelScatter->setArg(6, shift);
+			kernelScatter->setArg(7, hasValues);
+			kernelScatter->setLocalArg(8, localSize * 4);
+			kernelScatter->setLocalArg(9, localSize * 4);
+			kernelScatter->setLocalArg(10, localSize * 4);
+			kernelScatter->run1D(numTiles * localSize, localSize);
+
+			swap(keysIn, keysOut);
+			swap(valuesIn, valuesOut);
+		}
+
+		// after an odd number of passes the result is in the temporary buffers
+		if(keysIn != &keys) {
+			keys.copyFrom(tempKeys, 0, 0, numElements * 4);
+			if(values) values->copyFrom(tempValues, 0, 0, numElements * 4);
+		}
+
+		if(keyType == OPENCL_SORT_FLOAT) {
+			OpenCLKernel *kernel = loadSortKernel("msa_sort_key_to_float");
+			kernel->setArg(0, keys, CL_MEM_READ_WRITE);
+			kernel->setArg(1, n);
+			kernel->run1D(numTiles * localSize, localSize);
+		}
+	}
+
+
+	OpenCLKernel *OpenCLRadixSort::loadSortKernel(string kernelName) {
+		return OpenCL::currentOpenCL->loadBuiltinKernel(kernelName, "MSAOpenCLRadixSort", sortSource);
+	}
+
+
+	size_t OpenCLRadixSort::getLocalSize() {
+		// largest power of two both tile kernels can run with, up to 256 (and at least one work-item per digit)
+		size_t localSize = min((size_t)256, min(loadSortKernel("msa_sort_count")->getWorkGroupSize(), loadSortKernel("msa_sort_scatter")->getWorkGroupSize()));
+		while(localSize & (localSize - 1)) localSize &= localSize - 1;
+		assert(localSize >= 16);
+		return localSize;
+	}
+}
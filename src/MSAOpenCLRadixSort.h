@@ -0,0 +1,57 @@
+/***********************************************************************
+
+ OpenCL Radix Sort
+ Stable key / value sort of OpenCLBuffers on the device, 4 bits per pass.
+ Each pass: every work-group counts the digits of its tile of keys (with local atomics),
+ the counts are scanned (with OpenCLScan) into each tile's output offsets,
+ then every work-group sorts its tile by the digit in local memory and scatters it.
+ Keys are uints, or floats (sorted by value, negative numbers included). Values are any 4 byte type (e.g. indices).
+
+ e.g. back to front order of particles:
+ OpenCLRadixSort sorter;
+ (fill depths with each particle's distance from the camera, and indices with 0...n-1)
+ sorter.sort(depths, &indices, numParticles, OPENCL_SORT_FLOAT);	// ascending, so draw in reverse
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCLBuffer.h"
+#include "MSAOpenCLScan.h"
+
+namespace msa {
+
+	class OpenCLKernel;
+
+	enum OpenCLSortKeyType {
+		OPENCL_SORT_UINT,
+		OPENCL_SORT_FLOAT
+	};
+
+	class OpenCLRadixSort {
+	public:
+
+		OpenCLRadixSort();
+
+		// sort the first numElements keys ascending, in place, and reorder values (if not NULL) the same way
+		// only the lowest numBits bits of uint keys are sorted on (fewer bits means fewer passes)
+		// parameters with default values can be omited
+		void sort(OpenCLBuffer &keys,
+				  OpenCLBuffer *values,
+				  int numElements,
+				  OpenCLSortKeyType keyType = OPENCL_SORT_UINT,
+				  int numBits = 32);
+
+
+	protected:
+		OpenCLScan		scan;
+		OpenCLBuffer	tempKeys;
+		OpenCLBuffer	tempValues;
+		OpenCLBuffer	counts;			// digit counts of each tile, digit major (then scanned into offsets)
+
+		OpenCLKernel *loadSortKernel(string kernelName);
+		size_t getLocalSize();
+	};
+}
@@ -0,0 +1,86 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLRandom.h"
+
+namespace msa {
+
+	// Philox4x32 with 10 rounds (Salmon et al, "Parallel random numbers: as easy as 1, 2, 3")
+	static const string randomSource = MSA_OPENCL_SOURCE(
+		uint4 msa_philox4x32(uint4 counter, uint2 key) {
+			for(int r = 0; r < 10; r++) {
+				uint hi0	= mul_hi(0xD2511F53u, counter.x);
+				uint lo0	= 0xD2511F53u * counter.x;
+				uint hi1	= mul_hi(0xCD9E8D57u, counter.z);
+				uint lo1	= 0xCD9E8D57u * counter.z;
+				counter		= (uint4)(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);
+				key			+= (uint2)(0x9E3779B9u, 0xBB67AE85u);
+			}
+			return counter;
+		}
+
+		// top 24 bits, so every value is exactly representable
+		float4 msa_random_uniform4(uint4 counter, uint2 key) {
+			return convert_float4(msa_philox4x32(counter, key) >> 8) * (1.0f / 16777216.0f);
+		}
+
+		// Box-Muller on two pairs of uniforms (the first of each pair in (0, 1], so the log is finite)
+		float4 msa_random_normal4(uint4 counter, uint2 key) {
+			uint4 x		= msa_philox4x32(counter, key);
+			float2 u1	= convert_float2(x.xz >> 8) * (1.0f / 16777216.0f) + (1.0f / 16777216.0f);
+			float2 u2	= convert_float2(x.yw >> 8) * (1.0f / 16777216.0f);
+			float2 r	= sqrt(-2.0f * log(u1));
+			float2 t	= 2.0f * M_PI_F * u2;
+			return (float4)(r.x * cos(t.x), r.x * sin(t.x), r.y * cos(t.y), r.y * sin(t.y));
+		}
+	);
+
+	// each work-item fills 4 floats, from the counter (its id, 0, 0, 0)
+	static const string fillRandomSource = MSA_OPENCL_SOURCE(
+		__kernel void msa_fill_random(__global float *dst, const int offset, const int n, const uint seed, const int normal, const float a, const float b) {
+			dst += offset;
+			int i = get_global_id(0) * 4;
+			if(i >= n) return;
+			uint4 counter	= (uint4)(get_global_id(0), 0, 0, 0);
+			uint2 key		= (uint2)(seed, 0);
+			float4 r		= normal ? a + b * msa_random_normal4(counter, key) : a + (b - a) * msa_random_uniform4(counter, key);
+			if(i + 3 < n) {
+				vstore4(r, 0, dst + i);
+			} else {
+				dst[i] = r.x;
+				if(i + 1 < n) dst[i + 1] = r.y;
+				if(i + 2 < n) dst[i + 2] = r.z;
+			}
+		}
+	);
+
+
+	const string &OpenCLRandom::getKernelHeader() {
+		static const string header = randomSource + "\n";
+		return header;
+	}
+
+
+	// declared in MSAOpenCLBuffer.h
+	void OpenCLBuffer::fillRandom(OpenCLRandomDistribution distribution, cl_uint seed, float a, float b, size_t startOffsetBytes, size_t numberOfBytes) {
+		if(numberOfBytes == (size_t)-1) numberOfBytes = startOffsetBytes < getSize() ? getSize() - startOffsetBytes : 0;
+		if(numberOfBytes == 0) return;
+		if(startOffsetBytes % 4 || numberOfBytes % 4 || startOffsetBytes > getSize() || numberOfBytes > getSize() - startOffsetBytes) {
+			ofLog(OF_LOG_ERROR, "OpenCLBuffer::fillRandom - range must be floats within the buffer");
+			assert(false);
+			return;
+		}
+
+		OpenCLKernel *kernel = pOpenCL->loadBuiltinKernel("msa_fill_random", "MSAOpenCLRandom", OpenCLRandom::getKernelHeader() + fillRandomSource);
+
+		cl_int offset	= startOffsetBytes / 4;
+		cl_int n		= numberOfBytes / 4;
+		cl_int normal	= distribution == OPENCL_RANDOM_NORMAL;
+		kernel->setArg(0, *this, CL_MEM_WRITE_ONLY);
+		kernel->setArg(1, offset);
+		kernel->setArg(2, n);
+		kernel->setArg(3, seed);
+		kernel->setArg(4, normal);
+		kernel->setArg(5, a);
+		kernel->setArg(6, b);
+		kernel->run1D((n + 3) / 4);
+	}
+}
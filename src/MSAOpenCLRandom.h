@@ -0,0 +1,36 @@
+/***********************************************************************
+
+ OpenCL Random
+ Counter based random numbers for kernels (Philox4x32-10): every call turns a counter and a key into 4 random uints,
+ with no state to store or update between calls. Use e.g. the work-item id and frame number as the counter,
+ and a seed as the key, and each work-item gets its own independent stream.
+
+ Prepend getKernelHeader() to your program's source for:
+ uint4 msa_philox4x32(uint4 counter, uint2 key)				// 4 random uints
+ float4 msa_random_uniform4(uint4 counter, uint2 key)		// 4 floats in [0, 1)
+ float4 msa_random_normal4(uint4 counter, uint2 key)			// 4 floats from a normal distribution (mean 0, standard deviation 1)
+
+ e.g.:
+ __kernel void jitter(__global float4 *pos, const uint frame, const uint seed) {
+	int i = get_global_id(0);
+	pos[i] += msa_random_normal4((uint4)(i, frame, 0, 0), (uint2)(seed, 0));
+ }
+
+ openCL.loadProgramFromSource(OpenCLRandom::getKernelHeader() + mySource);
+
+ To fill a whole buffer see OpenCLBuffer::fillRandom.
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+
+namespace msa {
+
+	class OpenCLRandom {
+	public:
+		// OpenCL source of the functions above
+		static const string &getKernelHeader();
+	};
+}
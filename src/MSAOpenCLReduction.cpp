@@ -0,0 +1,302 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLReduction.h"
+
+namespace msa {
+
+	// compiled once per type and op, with a header defining:
+	// T (element type), IT (matching int type for indices), RT (result type), T_MAX / T_LOWEST,
+	// MSA_IDENTITY, MSA_COMBINE(v, i, v2, i2), MSA_RESULT(v) and MSA_HAS_INDEX
+	// partials holds one value per first pass work-group, followed by as many indices
+	static const string reduceSource = MSA_OPENCL_SOURCE(
+		void msa_reduce_group(T *pValue, IT *pIndex, __local T *lValues, __local IT *lIndices) {
+			int lid	= get_local_id(0);
+			T v		= *pValue;
+			IT i	= *pIndex;
+			lValues[lid]	= v;
+			lIndices[lid]	= i;
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			for(int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+				if(lid < s) {
+					T v2	= lValues[lid + s];
+					IT i2	= lIndices[lid + s];
+					MSA_COMBINE(v, i, v2, i2);
+					lValues[lid]	= v;
+					lIndices[lid]	= i;
+				}
+				barrier(CLK_LOCAL_MEM_FENCE);
+			}
+
+			*pValue = v;
+			*pIndex = i;
+		}
+
+		void msa_reduce_write_partial(__global T *partials, T v, IT i) {
+			if(get_local_id(0) == 0) {
+				partials[get_group_id(0)] = v;
+				((__global IT*)(partials + get_num_groups(0)))[get_group_id(0)] = i;
+			}
+		}
+
+		__kernel void msa_reduce(__global T *partials, __local T *lValues, __local IT *lIndices, __global const T *src, const int srcOffset, const int n) {
+			T v		= MSA_IDENTITY;
+			IT i	= (IT)(INT_MAX);
+			for(int k = get_global_id(0); k < n; k += get_global_size(0)) {
+				T v2	= src[srcOffset + k];
+				IT i2	= (IT)(k);
+				MSA_COMBINE(v, i, v2, i2);
+			}
+			msa_reduce_group(&v, &i, lValues, lIndices);
+			msa_reduce_write_partial(partials, v, i);
+		}
+
+		// single work-group
+		__kernel void msa_reduce_final(__global const T *partials, __local T *lValues, __local IT *lIndices, const int numPartials, const float meanScale, __global uchar *result, const int resultOffset) {
+			__global const IT *partialIndices = (__global const IT*)(partials + numPartials);
+			T v		= MSA_IDENTITY;
+			IT i	= (IT)(INT_MAX);
+			for(int k = get_local_id(0); k < numPartials; k += get_local_size(0)) {
+				T v2	= partials[k];
+				IT i2	= partialIndices[k];
+				MSA_COMBINE(v, i, v2, i2);
+			}
+			msa_reduce_group(&v, &i, lValues, lIndices);
+
+			if(get_local_id(0) == 0) {
+				*(__global RT*)(result + resultOffset) = MSA_RESULT(v);
+				if(MSA_HAS_INDEX) *(__global IT*)(result + resultOffset + sizeof(RT)) = i;
+			}
+		}
+	);
+
+	// only in the float4 programs
+	static const string reduceImageSource = MSA_OPENCL_SOURCE(
+		__constant sampler_t msaReduceSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+		__kernel void msa_reduce_image(__global T *partials, __local T *lValues, __local IT *lIndices, __read_only image2d_t src) {
+			int width	= get_image_width(src);
+			int n		= width * get_image_height(src);
+			T v		= MSA_IDENTITY;
+			IT i	= (IT)(INT_MAX);
+			for(int k = get_global_id(0); k < n; k += get_global_size(0)) {
+				T v2	= read_imagef(src, msaReduceSampler, (int2)(k % width, k / width));
+				IT i2	= (IT)(k);
+				MSA_COMBINE(v, i, v2, i2);
+			}
+			msa_reduce_group(&v, &i, lValues, lIndices);
+			msa_reduce_write_partial(partials, v, i);
+		}
+	);
+
+
+	static const char *reduceTypeNames[]	= { "int", "float", "float2", "float4" };
+	static const char *reduceIntTypeNames[]	= { "int", "int", "int2", "int4" };
+	static const char *reduceFloatTypeNames[] = { "float", "float", "float2", "float4" };
+	static const char *reduceOpNames[]		= { "sum", "min", "max", "argmin", "argmax", "mean" };
+	static const int reduceTypeSizes[]		= { 4, 4, 8, 16 };
+
+
+	OpenCLReduction::OpenCLReduction() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLReduction::OpenCLReduction");
+		maxGroups		= 256;
+		resultValueSize	= 0;
+		resultEvent		= NULL;
+		memset(result, 0, sizeof(result));
+	}
+
+
+	OpenCLReduction::~OpenCLReduction() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLReduction::~OpenCLReduction");
+		releaseResultEvent();
+	}
+
+
+	void OpenCLReduction::reduce(OpenCLBuffer &buffer, OpenCLReduceOp op, OpenCLReduceType type, OpenCLBuffer &resultBuffer, int resultOffsetBytes, int startElement, int numElements) {
+		int elementSize = reduceTypeSizes[type];
+		if(numElements < 0) numElements = buffer.getSize() / elementSize - startElement;
+		if(numElements <= 0 || (startElement + numElements) * elementSize > buffer.getSize()) {
+			ofLog(OF_LOG_ERROR, "OpenCLReduction::reduce - range is outside of the buffer");
+			assert(false);
+			return;
+		}
+
+		cl_int srcOffset	= startElement;
+		cl_int n			= numElements;
+		OpenCLKernel *kernel = loadReduceKernel("msa_reduce", op, type);
+		kernel->setArg(3, buffer, CL_MEM_READ_ONLY);
+		kernel->setArg(4, srcOffset);
+		kernel->setArg(5, n);
+		run(kernel, op, type, numElements, resultBuffer, resultOffsetBytes);
+	}
+
+
+	void OpenCLReduction::reduce(OpenCLImage &image, OpenCLReduceOp op, OpenCLBuffer &resultBuffer, int resultOffsetBytes) {
+		switch(image.getChannelDataType()) {
+			case CL_SIGNED_INT8:
+			case CL_SIGNED_INT16:
+			case CL_SIGNED_INT32:
+			case CL_UNSIGNED_INT8:
+			case CL_UNSIGNED_INT16:
+			case CL_UNSIGNED_INT32:
+				ofLog(OF_LOG_ERROR, "OpenCLReduction::reduce - only for float and normalized images");
+				assert(false);
+				return;
+		}
+		if(image.getDepth() != 1) {
+			ofLog(OF_LOG_ERROR, "OpenCLReduction::reduce - only for 2D images");
+			assert(false);
+			return;
+		}
+
+		OpenCLKernel *kernel = loadReduceKernel("msa_reduce_image", op, OPENCL_REDUCE_FLOAT4);
+		kernel->setArg(3, image, CL_MEM_READ_ONLY);
+		run(kernel, op, OPENCL_REDUCE_FLOAT4, image.getWidth() * image.getHeight(), resultBuffer, resultOffsetBytes);
+	}
+
+
+	cl_event OpenCLReduction::reduceAsync(OpenCLBuffer &buffer, OpenCLReduceOp op, OpenCLReduceType type, int startElement, int numElements) {
+		reduce(buffer, op, type, resultBuffer, 0, startElement, numElements);
+		return readResult(op, type);
+	}
+
+
+	cl_event OpenCLReduction::reduceAsync(OpenCLImage &image, OpenCLReduceOp op) {
+		reduce(image, op, resultBuffer, 0);
+		return readResult(op, OPENCL_REDUCE_FLOAT4);
+	}
+
+
+	bool OpenCLReduction::isResultReady() {
+		if(resultEvent == NULL) return true;
+		cl_int status;
+		cl_int err = clGetEventInfo(resultEvent, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+		assert(err == CL_SUCCESS);
+		return status == CL_COMPLETE;
+	}
+
+
+	const void *OpenCLReduction::getResult() {
+		if(resultEvent) {
+			clWaitForEvents(1, &resultEvent);
+			releaseResultEvent();
+		}
+		return result;
+	}
+
+
+	int OpenCLReduction::getResultSize(OpenCLReduceOp op, OpenCLReduceType type) {
+		// ints and floats are the same size, so the index is the same size as the value
+		bool hasIndex = op == OPENCL_REDUCE_ARGMIN || op == OPENCL_REDUCE_ARGMAX;
+		return reduceTypeSizes[type] * (hasIndex ? 2 : 1);
+	}
+
+
+	OpenCLKernel *OpenCLReduction::loadReduceKernel(string kernelName, OpenCLReduceOp op, OpenCLReduceType type) {
+		string programName = string("MSAOpenCLReduction_") + reduceTypeNames[type] + "_" + reduceOpNames[op];
+
+		string header =
+		string("#define T ") + reduceTypeNames[type] + "\n"
+		"#define IT " + reduceIntTypeNames[type] + "\n"
+		"#define T_MAX ((T)(" + (type == OPENCL_REDUCE_INT ? "INT_MAX" : "MAXFLOAT") + "))\n"
+		"#define T_LOWEST ((T)(" + (type == OPENCL_REDUCE_INT ? "INT_MIN" : "-MAXFLOAT") + "))\n";
+
+		switch(op) {
+			case OPENCL_REDUCE_SUM:
+			case OPENCL_REDUCE_MEAN:
+				header += "#define MSA_IDENTITY ((T)(0))\n"
+				"#define MSA_COMBINE(v, i, v2, i2) v += v2\n";
+				break;
+			case OPENCL_REDUCE_MIN:
+				header += "#define MSA_IDENTITY T_MAX\n"
+				"#define MSA_COMBINE(v, i, v2, i2) v = min(v, v2)\n";
+				break;
+			case OPENCL_REDUCE_MAX:
+				header += "#define MSA_IDENTITY T_LOWEST\n"
+				"#define MSA_COMBINE(v, i, v2, i2) v = max(v, v2)\n";
+				break;
+			case OPENCL_REDUCE_ARGMIN:
+			case OPENCL_REDUCE_ARGMAX:
+				// comparisons give -1 / 0 per component for vectors (1 / 0 for scalars), which is what select expects
+				header += op == OPENCL_REDUCE_ARGMIN ? "#define MSA_IDENTITY T_MAX\n#define MSA_BETTER(a, b) ((a) < (b))\n" : "#define MSA_IDENTITY T_LOWEST\n#define MSA_BETTER(a, b) ((a) > (b))\n";
+				header += "#define MSA_COMBINE(v, i, v2, i2) { IT take = MSA_BETTER(v2, v) | (((v2) == (v)) & ((i2) < (i))); v = select(v, v2, take); i = select(i, i2, take); }\n";
+				break;
+		}
+
+		if(op == OPENCL_REDUCE_MEAN) {
+			header += string("#define RT ") + reduceFloatTypeNames[type] + "\n"
+			"#define MSA_RESULT(v) (convert_" + reduceFloatTypeNames[type] + "(v) * meanScale)\n";
+		} else {
+			header += "#define RT T\n"
+			"#define MSA_RESULT(v) (v)\n";
+		}
+		header += string("#define MSA_HAS_INDEX ") + (op == OPENCL_REDUCE_ARGMIN || op == OPENCL_REDUCE_ARGMAX ? "1" : "0") + "\n";
+
+		string source = header + reduceSource;
+		if(type == OPENCL_REDUCE_FLOAT4) source += reduceImageSource;
+
+		return OpenCL::currentOpenCL->loadBuiltinKernel(kernelName, programName, source);
+	}
+
+
+	void OpenCLReduction::run(OpenCLKernel *kernelFirst, OpenCLReduceOp op, OpenCLReduceType type, int numElements, OpenCLBuffer &dstBuffer, int resultOffsetBytes) {
+		int elementSize	= reduceTypeSizes[type];
+		int resultSize	= getResultSize(op, type);
+		if(resultOffsetBytes % elementSize || resultOffsetBytes + resultSize > dstBuffer.getSize()) {
+			if(&dstBuffer == &resultBuffer) {
+				dstBuffer.initBuffer(resultSize, CL_MEM_READ_WRITE);
+			} else {
+				ofLog(OF_LOG_ERROR, "OpenCLReduction::reduce - result doesn't fit in the result buffer, or its offset isn't a multiple of the element size");
+				assert(false);
+				return;
+			}
+		}
+
+		OpenCLKernel *kernelFinal = loadReduceKernel("msa_reduce_final", op, type);
+
+		// same power of two work-group size for both passes, so the second pass takes all partials in one go
+		size_t localSize = min((size_t)256, min(kernelFirst->getWorkGroupSize(), kernelFinal->getWorkGroupSize()));
+		while(localSize & (localSize - 1)) localSize &= localSize - 1;
+
+		cl_int numGroups = min((int)localSize, maxGroups);
+		numGroups = max(1, min(numGroups, (int)((numElements + localSize - 1) / localSize)));
+
+		if(partials.getCapacity() < numGroups * elementSize * 2) partials.initBuffer(numGroups * elementSize * 2, CL_MEM_READ_WRITE);
+
+		kernelFirst->setArg(0, partials, CL_MEM_READ_WRITE);
+		kernelFirst->setLocalArg(1, localSize * elementSize);
+		kernelFirst->setLocalArg(2, localSize * elementSize);
+		kernelFirst->run1D(numGroups * localSize, localSize);
+
+		cl_float meanScale		= 1.0f / numElements;
+		cl_int offset			= resultOffsetBytes;
+		kernelFinal->setArg(0, partials, CL_MEM_READ_ONLY);
+		kernelFinal->setLocalArg(1, localSize * elementSize);
+		kernelFinal->setLocalArg(2, localSize * elementSize);
+		kernelFinal->setArg(3, numGroups);
+		kernelFinal->setArg(4, meanScale);
+		kernelFinal->setArg(5, dstBuffer, CL_MEM_WRITE_ONLY);
+		kernelFinal->setArg(6, offset);
+		kernelFinal->run1D(localSize, localSize);
+	}
+
+
+	cl_event OpenCLReduction::readResult(OpenCLReduceOp op, OpenCLReduceType type) {
+		releaseResultEvent();
+		resultValueSize = reduceTypeSizes[type];
+
+		OpenCL *pOpenCL = OpenCL::currentOpenCL;
+		cl_int err = clEnqueueReadBuffer(pOpenCL->getQueue(), resultBuffer.getResidentCLMem(), CL_FALSE, 0, getResultSize(op, type), result, 0, NULL, &resultEvent);
+		assert(err == CL_SUCCESS);
+
+		// submit it, so that polling isResultReady sees it complete without anything else flushing the queue
+		clFlush(pOpenCL->getQueue());
+		return resultEvent;
+	}
+
+
+	void OpenCLReduction::releaseResultEvent() {
+		if(resultEvent == NULL) return;
+		clReleaseEvent(resultEvent);
+		resultEvent = NULL;
+	}
+}
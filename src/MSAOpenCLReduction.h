@@ -0,0 +1,126 @@
+/***********************************************************************
+
+ OpenCL Reduction
+ Sum, min, max, argmin, argmax and mean of a buffer (of ints, floats, float2s or float4s)
+ or of each channel of an image, computed on the device in two passes:
+ every work-group reduces a strided part of the input into local memory, then a single work-group reduces those partial results.
+ The result stays in device memory (e.g. to be used by another kernel), or is read back asynchronously.
+ Vector types are reduced per component (e.g. argmax of a float4 buffer gives the index of the maximum of each component).
+
+ Results are laid out as:
+ - the value, of the same type as the elements (SUM of ints is an int), except MEAN which is always float (float, float2 or float4)
+ - for ARGMIN and ARGMAX, followed by the element index (int, int, int2 or int4). Ties go to the lowest index.
+ For images values are float4, and indices are pixel indices (x + y * width)
+
+ e.g.:
+ OpenCLReduction reduction;
+ reduction.reduce(image, OPENCL_REDUCE_MEAN, exposureBuffer);	// for another kernel to read, nothing is read back
+
+ reduction.reduceAsync(buffer, OPENCL_REDUCE_MAX, OPENCL_REDUCE_FLOAT);
+ ...															// carry on with other work
+ float maxValue = reduction.getValue<cl_float>();				// waits for the result if it isn't there yet
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCLBuffer.h"
+
+namespace msa {
+
+	class OpenCLImage;
+	class OpenCLKernel;
+
+	enum OpenCLReduceOp {
+		OPENCL_REDUCE_SUM,
+		OPENCL_REDUCE_MIN,
+		OPENCL_REDUCE_MAX,
+		OPENCL_REDUCE_ARGMIN,
+		OPENCL_REDUCE_ARGMAX,
+		OPENCL_REDUCE_MEAN
+	};
+
+	enum OpenCLReduceType {
+		OPENCL_REDUCE_INT,
+		OPENCL_REDUCE_FLOAT,
+		OPENCL_REDUCE_FLOAT2,
+		OPENCL_REDUCE_FLOAT4
+	};
+
+	class OpenCLReduction {
+	public:
+
+		OpenCLReduction();
+		~OpenCLReduction();
+
+		// reduce numElements elements of buffer (of type), starting at element startElement (numElements < 0 means to the end)
+		// the result is written into resultBuffer at resultOffsetBytes on the device (which must be a multiple of the element size)
+		// parameters with default values can be omited
+		void reduce(OpenCLBuffer &buffer,
+					OpenCLReduceOp op,
+					OpenCLReduceType type,
+					OpenCLBuffer &resultBuffer,
+					int resultOffsetBytes = 0,
+					int startElement = 0,
+					int numElements = -1);
+
+		// reduce each channel of a 2D image (float or normalized)
+		void reduce(OpenCLImage &image,
+					OpenCLReduceOp op,
+					OpenCLBuffer &resultBuffer,
+					int resultOffsetBytes = 0);
+
+
+		// same as above, but into an internal buffer which is then read back without blocking
+		// the returned event completes when the result is on the host (it's released by the next reduceAsync)
+		cl_event reduceAsync(OpenCLBuffer &buffer,
+							 OpenCLReduceOp op,
+							 OpenCLReduceType type,
+							 int startElement = 0,
+							 int numElements = -1);
+
+		cl_event reduceAsync(OpenCLImage &image,
+							 OpenCLReduceOp op);
+
+		// whether the last reduceAsync result has arrived (doesn't block)
+		bool isResultReady();
+
+		// result of the last reduceAsync, waits for it if needed
+		// T must match the layout described above, e.g. getValue<cl_float4>() and getIndex<cl_int4>() for a float4 ARGMAX
+		template<class T> T getValue() {
+			T value;
+			memcpy(&value, getResult(), sizeof(T));
+			return value;
+		}
+
+		template<class T> T getIndex() {
+			T index;
+			memcpy(&index, (const unsigned char*)getResult() + resultValueSize, sizeof(T));
+			return index;
+		}
+
+		// raw bytes of the result of the last reduceAsync, waits for it if needed
+		const void *getResult();
+
+		// size in bytes of the result of op on elements of type (value plus index for ARGMIN / ARGMAX)
+		static int getResultSize(OpenCLReduceOp op, OpenCLReduceType type);
+
+		// number of work-groups in the first pass (at most the second pass's work-group size)
+		int		maxGroups;
+
+
+	protected:
+		OpenCLBuffer	partials;			// values of the first pass, followed by their indices
+		OpenCLBuffer	resultBuffer;		// for reduceAsync
+		unsigned char	result[32];			// read back by reduceAsync
+		int				resultValueSize;
+		cl_event		resultEvent;
+
+		OpenCLKernel *loadReduceKernel(string kernelName, OpenCLReduceOp op, OpenCLReduceType type);
+		void run(OpenCLKernel *kernelFirst, OpenCLReduceOp op, OpenCLReduceType type, int numElements, OpenCLBuffer &resultBuffer, int resultOffsetBytes);
+		void releaseResultEvent();
+		cl_event readResult(OpenCLReduceOp op, OpenCLReduceType type);
+	};
+}
@@ -0,0 +1,197 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLScan.h"
+
+namespace msa {
+
+	// compiled once per type, with T defined as the element type
+	static const string scanSource = MSA_OPENCL_SOURCE(
+		// each work-item scans 4 consecutive elements privately, then the work-item totals are scanned in local memory
+		// blockSums gets the total of each block (of 4 * local size elements)
+		__kernel void msa_scan_blocks(__global const T *src, __global T *dst, __global T *blockSums, const int n, const int inclusive, __local T *lSums) {
+			int lid			= get_local_id(0);
+			int localSize	= get_local_size(0);
+			int base		= (get_group_id(0) * localSize + lid) * 4;
+
+			T v[4];
+			T total = 0;
+			for(int k = 0; k < 4; k++) {
+				T x		= base + k < n ? src[base + k] : 0;
+				v[k]	= inclusive ? total + x : total;
+				total	+= x;
+			}
+
+			lSums[lid] = total;
+			barrier(CLK_LOCAL_MEM_FENCE);
+			for(int offset = 1; offset < localSize; offset <<= 1) {
+				T t = lid >= offset ? lSums[lid - offset] : 0;
+				barrier(CLK_LOCAL_MEM_FENCE);
+				lSums[lid] += t;
+				barrier(CLK_LOCAL_MEM_FENCE);
+			}
+
+			T threadOffset = lid > 0 ? lSums[lid - 1] : 0;
+			for(int k = 0; k < 4; k++) {
+				if(base + k < n) dst[base + k] = v[k] + threadOffset;
+			}
+			if(lid == localSize - 1) blockSums[get_group_id(0)] = lSums[lid];
+		}
+
+		// add the (scanned) block totals onto the blocks
+		__kernel void msa_scan_add(__global T *dst, __global const T *blockSums, const int n) {
+			int blockSize	= get_local_size(0) * 4;
+			int base		= get_group_id(0) * blockSize;
+			T add			= blockSums[get_group_id(0)];
+			for(int k = get_local_id(0); k < blockSize; k += get_local_size(0)) {
+				if(base + k < n) dst[base + k] += add;
+			}
+		}
+
+		// offsets are the exclusive scan of flags
+		__kernel void msa_compact(__global const uint *src, __global uint *dst, __global const int *flags, __global const int *offsets, const int n, const int elementWords, __global int *count) {
+			int i = get_global_id(0);
+			if(i >= n) return;
+			if(flags[i]) {
+				__global const uint *s	= src + i * elementWords;
+				__global uint *d		= dst + offsets[i] * elementWords;
+				for(int w = 0; w < elementWords; w++) d[w] = s[w];
+			}
+			if(i == n - 1) *count = offsets[i] + flags[i];
+		}
+	);
+
+
+	static const char *scanTypeNames[] = { "int", "uint", "float" };
+
+
+	OpenCLScan::OpenCLScan() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLScan::OpenCLScan");
+		lastFlags		= NULL;
+		lastNumElements	= 0;
+	}
+
+
+	OpenCLScan::~OpenCLScan() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLScan::~OpenCLScan");
+		for(int i=0; i<blockSums.size(); i++) delete blockSums[i];
+	}
+
+
+	void OpenCLScan::scan(OpenCLBuffer &src, OpenCLBuffer &dst, int numElements, OpenCLScanType type, bool inclusive) {
+		if(numElements <= 0) return;
+		if(numElements * 4 > src.getSize() || numElements * 4 > dst.getSize()) {
+			ofLog(OF_LOG_ERROR, "OpenCLScan::scan - numElements is larger than the buffers");
+			assert(false);
+			return;
+		}
+		scanLevel(src, dst, numElements, type, inclusive, 0);
+	}
+
+
+	int OpenCLScan::compact(OpenCLBuffer &src, OpenCLBuffer &dst, OpenCLBuffer &flags, int numElements, int elementSize, bool readCount) {
+		lastFlags		= NULL;
+		lastNumElements	= 0;
+		if(numElements <= 0) return 0;
+
+		if(offsets.getCapacity() < numElements * 4) offsets.initBuffer(numElements * 4, CL_MEM_READ_WRITE);
+		if(countBuffer.getCapacity() < 4) countBuffer.initBuffer(4, CL_MEM_READ_WRITE);
+
+		scan(flags, offsets, numElements, OPENCL_SCAN_INT, false);
+
+		lastFlags		= &flags;
+		lastNumElements	= numElements;
+		scatter(src, dst, elementSize);
+
+		if(!readCount) return -1;
+
+		cl_int count;
+		countBuffer.read(&count, 0, sizeof(count), CL_TRUE);
+		return count;
+	}
+
+
+	int OpenCLScan::compact(OpenCLBuffer &src, OpenCLBuffer &dst, int numElements, int elementSize, OpenCLKernel *predicateKernel, bool readCount) {
+		assert(predicateKernel);
+		if(numElements <= 0) return 0;
+
+		if(flags.getCapacity() < numElements * 4) flags.initBuffer(numElements * 4, CL_MEM_READ_WRITE);
+
+		predicateKernel->setArg(0, src, CL_MEM_READ_ONLY);
+		predicateKernel->setArg(1, flags, CL_MEM_WRITE_ONLY);
+		predicateKernel->run1D(numElements);
+
+		return compact(src, dst, flags, numElements, elementSize, readCount);
+	}
+
+
+	void OpenCLScan::compactAgain(OpenCLBuffer &src, OpenCLBuffer &dst, int elementSize) {
+		if(lastFlags == NULL) return;
+		scatter(src, dst, elementSize);
+	}
+
+
+	void OpenCLScan::scatter(OpenCLBuffer &src, OpenCLBuffer &dst, int elementSize) {
+		if(elementSize % 4) {
+			ofLog(OF_LOG_ERROR, "OpenCLScan::compact - elementSize must be a multiple of 4");
+			assert(false);
+			return;
+		}
+
+		cl_int n			= lastNumElements;
+		cl_int elementWords	= elementSize / 4;
+		OpenCLKernel *kernel = loadScanKernel("msa_compact", OPENCL_SCAN_INT);
+		kernel->setArg(0, src, CL_MEM_READ_ONLY);
+		kernel->setArg(1, dst, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, *lastFlags, CL_MEM_READ_ONLY);
+		kernel->setArg(3, offsets, CL_MEM_READ_ONLY);
+		kernel->setArg(4, n);
+		kernel->setArg(5, elementWords);
+		kernel->setArg(6, countBuffer, CL_MEM_WRITE_ONLY);
+		kernel->run1D(lastNumElements);
+	}
+
+
+	OpenCLKernel *OpenCLScan::loadScanKernel(string kernelName, OpenCLScanType type) {
+		return OpenCL::currentOpenCL->loadBuiltinKernel(kernelName, string("MSAOpenCLScan_") + scanTypeNames[type], string("#define T ") + scanTypeNames[type] + "\n" + scanSource);
+	}
+
+
+	size_t OpenCLScan::getLocalSize(OpenCLScanType type) {
+		// largest power of two both kernels can run with, up to 256
+		size_t localSize = min((size_t)256, min(loadScanKernel("msa_scan_blocks", type)->getWorkGroupSize(), loadScanKernel("msa_scan_add", type)->getWorkGroupSize()));
+		while(localSize & (localSize - 1)) localSize &= localSize - 1;
+		return localSize;
+	}
+
+
+	void OpenCLScan::scanLevel(OpenCLBuffer &src, OpenCLBuffer &dst, int numElements, OpenCLScanType type, bool inclusive, int level) {
+		size_t localSize	= getLocalSize(type);
+		int blockSize		= localSize * 4;
+		int numBlocks		= (numElements + blockSize - 1) / blockSize;
+
+		if(blockSums.size() <= level) blockSums.push_back(new OpenCLBuffer());
+		OpenCLBuffer &sums = *blockSums[level];
+		if(sums.getCapacity() < numBlocks * 4) sums.initBuffer(numBlocks * 4, CL_MEM_READ_WRITE);
+
+		cl_int n = numElements;
+		cl_int isInclusive = inclusive;
+		OpenCLKernel *kernel = loadScanKernel("msa_scan_blocks", type);
+		kernel->setArg(0, src, CL_MEM_READ_ONLY);
+		kernel->setArg(1, dst, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, sums, CL_MEM_WRITE_ONLY);
+		kernel->setArg(3, n);
+		kernel->setArg(4, isInclusive);
+		kernel->setLocalArg(5, localSize * 4);
+		kernel->run1D(numBlocks * localSize, localSize);
+
+		if(numBlocks == 1) return;
+
+		// block totals are scanned in place, and each becomes the offset of its block
+		scanLevel(sums, sums, numBlocks, type, false, level + 1);
+
+		kernel = loadScanKernel("msa_scan_add", type);
+		kernel->setArg(0, dst, CL_MEM_READ_WRITE);
+		kernel->setArg(1, sums, CL_MEM_READ_ONLY);
+		kernel->setArg(2, n);
+		kernel->run1D(numBlocks * localSize, localSize);
+	}
+}
@@ -0,0 +1,97 @@
+/***********************************************************************
+
+ OpenCL Scan
+ Prefix sums (scan) and stream compaction of OpenCLBuffers, on the device.
+ Each work-group scans a block of 4 elements per work-item in local memory, the block totals are scanned
+ the same way (recursively), then added back onto the blocks.
+ The work-group size is chosen per device from the kernels' work-group size limits.
+
+ e.g.:
+ OpenCLScan scan;
+ scan.scan(counts, offsets, numCounts, OPENCL_SCAN_UINT);		// exclusive: offsets[i] = counts[0] + ... + counts[i-1]
+
+ // keep only live particles, 'isAlive' being a kernel like:
+ // __kernel void isAlive(__global const Particle *src, __global int *flags) { int i = get_global_id(0); flags[i] = src[i].life > 0; }
+ int numAlive = scan.compact(particles, particlesCompacted, numParticles, sizeof(Particle), openCL.kernel("isAlive"));
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCLBuffer.h"
+
+namespace msa {
+
+	class OpenCLKernel;
+
+	enum OpenCLScanType {
+		OPENCL_SCAN_INT,
+		OPENCL_SCAN_UINT,
+		OPENCL_SCAN_FLOAT
+	};
+
+	class OpenCLScan {
+	public:
+
+		OpenCLScan();
+		~OpenCLScan();
+
+		// prefix sum of the first numElements elements of src (of type) into dst
+		// exclusive: dst[i] = src[0] + ... + src[i-1] (dst[0] = 0)
+		// inclusive: dst[i] = src[0] + ... + src[i]
+		// src and dst can be the same buffer
+		void scan(OpenCLBuffer &src,
+				  OpenCLBuffer &dst,
+				  int numElements,
+				  OpenCLScanType type = OPENCL_SCAN_INT,
+				  bool inclusive = false);
+
+
+		// copy the elements of src whose flag is 1 (flags is an int buffer of 0s and 1s) to the start of dst, in order
+		// elementSize is in bytes, and must be a multiple of 4
+		// the number of elements kept is left on the device in getCountBuffer(), and is read back and returned if readCount is true
+		// (otherwise -1 is returned)
+		int compact(OpenCLBuffer &src,
+					OpenCLBuffer &dst,
+					OpenCLBuffer &flags,
+					int numElements,
+					int elementSize,
+					bool readCount = true);
+
+		// same as above, with the flags written by predicateKernel, which is run over numElements work-items
+		// with argument 0 set to src and argument 1 to an int buffer for the flags (set any others before calling this)
+		int compact(OpenCLBuffer &src,
+					OpenCLBuffer &dst,
+					int numElements,
+					int elementSize,
+					OpenCLKernel *predicateKernel,
+					bool readCount = true);
+
+		// compact another buffer of the same elements with the flags of the last compact (e.g. other attributes of the same particles)
+		// without scanning the flags again. elementSize can be different
+		void compactAgain(OpenCLBuffer &src,
+						  OpenCLBuffer &dst,
+						  int elementSize);
+
+		// a single int, the number of elements kept by the last compact
+		OpenCLBuffer &getCountBuffer() {
+			return countBuffer;
+		}
+
+
+	protected:
+		vector<OpenCLBuffer*>	blockSums;		// one per level of recursion
+		OpenCLBuffer			flags;			// for compact with a predicate kernel
+		OpenCLBuffer			offsets;		// scanned flags
+		OpenCLBuffer			countBuffer;
+		OpenCLBuffer			*lastFlags;		// of the last compact
+		int						lastNumElements;
+
+		OpenCLKernel *loadScanKernel(string kernelName, OpenCLScanType type);
+		size_t getLocalSize(OpenCLScanType type);
+		void scatter(OpenCLBuffer &src, OpenCLBuffer &dst, int elementSize);
+		void scanLevel(OpenCLBuffer &src, OpenCLBuffer &dst, int numElements, OpenCLScanType type, bool inclusive, int level);
+	};
+}
@@ -0,0 +1,213 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLSpatialGrid.h"
+
+namespace msa {
+
+	// shared by the grid's own kernels and user kernels (via getKernelHeader)
+	static const string gridFunctionsSource = MSA_OPENCL_SOURCE(
+		// cell coordinates of p, clamped to the grid
+		int4 msa_grid_cell(float4 p, float4 origin, float cellSize, int4 gridSize) {
+			int4 c = convert_int4_rtn((p - origin) / cellSize);
+			return clamp(c, (int4)(0), gridSize - 1);
+		}
+
+		int msa_grid_cell_index(int4 c, int4 gridSize) {
+			return (c.z * gridSize.y + c.y) * gridSize.x + c.x;
+		}
+
+		// index of the cell at offset (dx, dy, dz) from c, or -1 if it's outside the grid
+		int msa_grid_neighbor_index(int4 c, int dx, int dy, int dz, int4 gridSize) {
+			int4 n = c + (int4)(dx, dy, dz, 0);
+			if(any(n.xyz < 0) || any(n.xyz >= gridSize.xyz)) return -1;
+			return msa_grid_cell_index(n, gridSize);
+		}
+	);
+
+	// empty cells have start = end = 0, and cells outside the grid are skipped
+	// the innermost loop only runs once, to declare j for the body
+	static const string gridMacrosSource =
+	"#define MSA_GRID_ARGS __global const uint *msaCellStart, __global const uint *msaCellEnd, __global const uint *msaGridIndices, const float4 msaGridOrigin, const float msaCellSize, const int4 msaGridSize\n"
+	"#define MSA_GRID_FOR_EACH_NEIGHBOR(p, j) \\\n"
+	"	for(int msaN = 0; msaN < 27; msaN++) \\\n"
+	"		for(int msaCell = msa_grid_neighbor_index(msa_grid_cell(p, msaGridOrigin, msaCellSize, msaGridSize), msaN % 3 - 1, msaN / 3 % 3 - 1, msaN / 9 - 1, msaGridSize), \\\n"
+	"				msaK = msaCell < 0 ? 0 : msaCellStart[msaCell], msaEnd = msaCell < 0 ? 0 : msaCellEnd[msaCell]; msaK < msaEnd; msaK++) \\\n"
+	"			for(int j = msaGridIndices[msaK], msaOnce = 1; msaOnce; msaOnce = 0)\n";
+
+	static const string gridKernelsSource = MSA_OPENCL_SOURCE(
+		__kernel void msa_grid_hash(__global const float4 *pos, __global uint *cells, __global uint *indices, const int n, const float4 origin, const float cellSize, const int4 gridSize) {
+			int i = get_global_id(0);
+			if(i >= n) return;
+			cells[i]	= msa_grid_cell_index(msa_grid_cell(pos[i], origin, cellSize, gridSize), gridSize);
+			indices[i]	= i;
+		}
+
+		__kernel void msa_grid_clear(__global uint *cellStart, __global uint *cellEnd, const int numCells) {
+			int c = get_global_id(0);
+			if(c >= numCells) return;
+			cellStart[c]	= 0;
+			cellEnd[c]		= 0;
+		}
+
+		// cells is sorted, so each cell starts where the previous particle is in a different cell
+		__kernel void msa_grid_bounds(__global const uint *cells, __global uint *cellStart, __global uint *cellEnd, const int n) {
+			int i = get_global_id(0);
+			if(i >= n) return;
+			uint c = cells[i];
+			if(i == 0 || cells[i - 1] != c) cellStart[c] = i;
+			if(i == n - 1 || cells[i + 1] != c) cellEnd[c] = i + 1;
+		}
+
+		__kernel void msa_grid_gather(__global const uint *src, __global uint *dst, __global const uint *indices, const int n, const int elementWords) {
+			int i = get_global_id(0);
+			if(i >= n) return;
+			__global const uint *s	= src + indices[i] * elementWords;
+			__global uint *d		= dst + i * elementWords;
+			for(int w = 0; w < elementWords; w++) d[w] = s[w];
+		}
+
+		__kernel void msa_grid_identity(__global uint *indices, const int n) {
+			int i = get_global_id(0);
+			if(i < n) indices[i] = i;
+		}
+	);
+
+
+	OpenCLSpatialGrid::OpenCLSpatialGrid() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLSpatialGrid::OpenCLSpatialGrid");
+		reorderInterval		= 0;
+		buildsSinceReorder	= 0;
+		setup(1, 1, 1);
+	}
+
+
+	void OpenCLSpatialGrid::setup(float cellSize, int numCellsX, int numCellsY, int numCellsZ, float originX, float originY, float originZ) {
+		ofLog(OF_LOG_VERBOSE, "OpenCLSpatialGrid::setup " + ofToString(numCellsX) + " x " + ofToString(numCellsY) + " x " + ofToString(numCellsZ));
+		assert(cellSize > 0);
+		assert(numCellsX > 0 && numCellsY > 0 && numCellsZ > 0);
+
+		this->cellSize	= cellSize;
+		numCells.s[0]	= numCellsX;
+		numCells.s[1]	= numCellsY;
+		numCells.s[2]	= numCellsZ;
+		numCells.s[3]	= 1;
+		origin.s[0]		= originX;
+		origin.s[1]		= originY;
+		origin.s[2]		= originZ;
+		origin.s[3]		= 0;
+	}
+
+
+	void OpenCLSpatialGrid::build(OpenCLBuffer &pos, int numParticles) {
+		int totalCells = getNumCells();
+		if(cellStart.getCapacity() < totalCells * 4) {
+			cellStart.initBuffer(totalCells * 4, CL_MEM_READ_WRITE);
+			cellEnd.initBuffer(totalCells * 4, CL_MEM_READ_WRITE);
+			cellStart.setLabel("grid cell start");
+			cellEnd.setLabel("grid cell end");
+		}
+
+		cl_int numCellsArg = totalCells;
+		OpenCLKernel *kernel = loadGridKernel("msa_grid_clear");
+		kernel->setArg(0, cellStart, CL_MEM_WRITE_ONLY);
+		kernel->setArg(1, cellEnd, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, numCellsArg);
+		kernel->run1D(totalCells);
+
+		if(numParticles <= 0) return;
+
+		if(cells.getCapacity() < numParticles * 4) {
+			cells.initBuffer(numParticles * 4, CL_MEM_READ_WRITE);
+			indices.initBuffer(numParticles * 4, CL_MEM_READ_WRITE);
+			cells.setLabel("grid cells");
+			indices.setLabel("grid indices");
+		}
+
+		cl_int n = numParticles;
+		kernel = loadGridKernel("msa_grid_hash");
+		kernel->setArg(0, pos, CL_MEM_READ_ONLY);
+		kernel->setArg(1, cells, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, indices, CL_MEM_WRITE_ONLY);
+		kernel->setArg(3, n);
+		kernel->setArg(4, origin);
+		kernel->setArg(5, cellSize);
+		kernel->setArg(6, numCells);
+		kernel->run1D(numParticles);
+
+		// only sort on as many bits as there are cells
+		int numBits = 1;
+		while(numBits < 32 && (1u << numBits) < (unsigned)totalCells) numBits++;
+		sorter.sort(cells, &indices, numParticles, OPENCL_SORT_UINT, numBits);
+
+		kernel = loadGridKernel("msa_grid_bounds");
+		kernel->setArg(0, cells, CL_MEM_READ_ONLY);
+		kernel->setArg(1, cellStart, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, cellEnd, CL_MEM_WRITE_ONLY);
+		kernel->setArg(3, n);
+		kernel->run1D(numParticles);
+
+		if(reorderInterval > 0 && ++buildsSinceReorder >= reorderInterval) {
+			buildsSinceReorder = 0;
+			reorder(pos, sizeof(cl_float4), numParticles);
+			for(int i=0; i<attributes.size(); i++) reorder(*attributes[i].buffer, attributes[i].elementSize, numParticles);
+
+			// particles are now in cell order, so the sorted indices are just 0...n-1
+			kernel = loadGridKernel("msa_grid_identity");
+			kernel->setArg(0, indices, CL_MEM_WRITE_ONLY);
+			kernel->setArg(1, n);
+			kernel->run1D(numParticles);
+		}
+	}
+
+
+	void OpenCLSpatialGrid::setKernelArgs(OpenCLKernel *kernel, int firstArg) {
+		assert(kernel);
+		kernel->setArg(firstArg, cellStart, CL_MEM_READ_ONLY);
+		kernel->setArg(firstArg + 1, cellEnd, CL_MEM_READ_ONLY);
+		kernel->setArg(firstArg + 2, indices, CL_MEM_READ_ONLY);
+		kernel->setArg(firstArg + 3, origin);
+		kernel->setArg(firstArg + 4, cellSize);
+		kernel->setArg(firstArg + 5, numCells);
+	}
+
+
+	void OpenCLSpatialGrid::addAttribute(OpenCLBuffer *attribute, int elementSize) {
+		assert(attribute);
+		if(elementSize <= 0 || elementSize % 4) {
+			ofLog(OF_LOG_ERROR, "OpenCLSpatialGrid::addAttribute - elementSize must be a multiple of 4");
+			assert(false);
+			return;
+		}
+		Attribute a;
+		a.buffer		= attribute;
+		a.elementSize	= elementSize;
+		attributes.push_back(a);
+	}
+
+
+	const string &OpenCLSpatialGrid::getKernelHeader() {
+		static const string header = gridMacrosSource + gridFunctionsSource + "\n";
+		return header;
+	}
+
+
+	OpenCLKernel *OpenCLSpatialGrid::loadGridKernel(string kernelName) {
+		return OpenCL::currentOpenCL->loadBuiltinKernel(kernelName, "MSAOpenCLSpatialGrid", gridFunctionsSource + gridKernelsSource);
+	}
+
+
+	void OpenCLSpatialGrid::reorder(OpenCLBuffer &attribute, int elementSize, int numParticles) {
+		if(reorderTemp.getCapacity() < numParticles * elementSize) reorderTemp.initBuffer(numParticles * elementSize, CL_MEM_READ_WRITE);
+
+		cl_int n			= numParticles;
+		cl_int elementWords	= elementSize / 4;
+		OpenCLKernel *kernel = loadGridKernel("msa_grid_gather");
+		kernel->setArg(0, attribute, CL_MEM_READ_ONLY);
+		kernel->setArg(1, reorderTemp, CL_MEM_WRITE_ONLY);
+		kernel->setArg(2, indices, CL_MEM_READ_ONLY);
+		kernel->setArg(3, n);
+		kernel->setArg(4, elementWords);
+		kernel->run1D(numParticles);
+
+		attribute.copyFrom(reorderTemp, 0, 0, numParticles * elementSize);
+	}
+}
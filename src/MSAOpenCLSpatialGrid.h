@@ -0,0 +1,119 @@
+/***********************************************************************
+
+ OpenCL Spatial Grid
+ Uniform grid for finding neighbouring particles, rebuilt on the device every frame:
+ particles are hashed to cells, sorted by cell (OpenCLRadixSort), then each cell's start and end in the sorted order are found.
+ Kernels iterate over the particles in the 27 cells around a position with MSA_GRID_FOR_EACH_NEIGHBOR,
+ from the source returned by getKernelHeader (prepend it to your program's source).
+
+ Particle storage can also be reordered by cell every so often (see setReorderInterval),
+ so that particles which are close in space are close in memory, and neighbour loops read memory coherently.
+
+ e.g. a separation force for OpenCLParticleSystem:
+ __kernel void separate(__global const float4 *pos, __global float4 *vel, __global const float *mass, __global const float *lifetime, const int numParticles, const float dt, MSA_GRID_ARGS) {
+	int i = get_global_id(0);
+	if(i >= numParticles || lifetime[i] <= 0) return;
+	float4 p = pos[i];
+	MSA_GRID_FOR_EACH_NEIGHBOR(p, j) {		// j includes i itself
+		float4 d = p - pos[j];
+		...
+	}
+ }
+
+ openCL.loadProgramFromSource(OpenCLSpatialGrid::getKernelHeader() + mySource);
+ grid.setup(cellSize, numCellsX, numCellsY);
+ ...
+ grid.build(particles.getPosBuffer(), particles.getNumActive());
+ grid.setKernelArgs(openCL.kernel("separate"), 6);
+ particles.update(dt);
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCLBuffer.h"
+#include "MSAOpenCLRadixSort.h"
+
+namespace msa {
+
+	class OpenCLKernel;
+
+	class OpenCLSpatialGrid {
+	public:
+
+		OpenCLSpatialGrid();
+
+		// numCellsX x numCellsY x numCellsZ cells of cellSize, starting at origin
+		// particles outside of the grid are counted in the nearest edge cell
+		// parameters with default values can be omited
+		void setup(float cellSize,
+				   int numCellsX,
+				   int numCellsY,
+				   int numCellsZ = 1,
+				   float originX = 0,
+				   float originY = 0,
+				   float originZ = 0);
+
+		// hash, sort and find the cell ranges of the first numParticles positions in pos (float4s, w is ignored)
+		// if it's time to reorder (see setReorderInterval), pos and all attributes added with addAttribute are reordered too
+		void build(OpenCLBuffer &pos, int numParticles);
+
+		// set the arguments declared by MSA_GRID_ARGS on kernel, starting at argument firstArg
+		void setKernelArgs(OpenCLKernel *kernel, int firstArg);
+
+
+		// attributes to reorder with the positions (elementSize in bytes, a multiple of 4)
+		// this moves particles around, so only use it if nothing else refers to particles by index
+		// (with OpenCLParticleSystem: compact it right before build, so that all particles in the active range are alive)
+		void addAttribute(OpenCLBuffer *attribute, int elementSize);
+
+		// reorder every this many builds (0 for never)
+		void setReorderInterval(int numBuilds) {
+			reorderInterval = numBuilds;
+		}
+
+
+		// OpenCL source to prepend to programs which use the grid:
+		// MSA_GRID_ARGS for the kernel's argument list, and MSA_GRID_FOR_EACH_NEIGHBOR(float4 pos, j) { ... }
+		// to loop over the indices j of particles in the cells around pos
+		static const string &getKernelHeader();
+
+
+		int getNumCells() {
+			return numCells.s[0] * numCells.s[1] * numCells.s[2];
+		}
+
+		// start and end (exclusive) of each cell in the sorted order, as uints
+		OpenCLBuffer &getCellStartBuffer()	{ return cellStart; }
+		OpenCLBuffer &getCellEndBuffer()	{ return cellEnd; }
+
+		// particle indices sorted by cell
+		OpenCLBuffer &getIndexBuffer()		{ return indices; }
+
+
+	protected:
+		cl_float		cellSize;
+		cl_int4			numCells;
+		cl_float4		origin;
+		int				reorderInterval;
+		int				buildsSinceReorder;
+
+		OpenCLBuffer	cells;			// cell of each particle, sorted
+		OpenCLBuffer	indices;
+		OpenCLBuffer	cellStart;
+		OpenCLBuffer	cellEnd;
+		OpenCLBuffer	reorderTemp;
+		OpenCLRadixSort	sorter;
+
+		struct Attribute {
+			OpenCLBuffer	*buffer;
+			int				elementSize;
+		};
+		vector<Attribute>	attributes;
+
+		OpenCLKernel *loadGridKernel(string kernelName);
+		void reorder(OpenCLBuffer &attribute, int elementSize, int numParticles);
+	};
+}
@@ -0,0 +1,51 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLStruct.h"
+
+namespace msa {
+
+	OpenCLStructLayout::OpenCLStructLayout(string structName, string clSource, size_t hostSize) {
+		this->structName	= structName;
+		this->clSource		= clSource;
+		this->hostSize		= hostSize;
+	}
+
+
+	void OpenCLStructLayout::addField(string fieldName, size_t hostOffset) {
+		fieldNames.push_back(fieldName);
+		hostOffsets.push_back(hostOffset);
+	}
+
+
+	bool OpenCLStructLayout::verify() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLStructLayout::verify " + structName);
+
+		// out[0] is the size, then the offset of each field
+		string source = clSource + "__kernel void msa_struct_probe(__global uint *out) {\n\t" + structName + " s;\n\tout[0] = sizeof(" + structName + ");\n";
+		for(int i=0; i<fieldNames.size(); i++) {
+			source += "\tout[" + ofToString(i + 1) + "] = (uint)((char *)&s." + fieldNames[i] + " - (char *)&s);\n";
+		}
+		source += "}\n";
+
+		OpenCLKernel *kernel = OpenCL::currentOpenCL->loadBuiltinKernel("msa_struct_probe", "MSAOpenCLStruct_" + structName, source);
+
+		vector<cl_uint> device(fieldNames.size() + 1);
+		OpenCLBuffer out;
+		out.initBuffer(device.size() * sizeof(cl_uint), CL_MEM_WRITE_ONLY);
+		kernel->setArg(0, out, CL_MEM_WRITE_ONLY);
+		kernel->run1D(1);
+		out.read(&device[0], 0, device.size() * sizeof(cl_uint), CL_TRUE);
+
+		bool ok = true;
+		if(device[0] != hostSize) {
+			ofLog(OF_LOG_ERROR, "OpenCLStructLayout::verify - sizeof(" + structName + ") is " + ofToString(hostSize) + " on the host and " + ofToString(device[0]) + " on the device");
+			ok = false;
+		}
+		for(int i=0; i<fieldNames.size(); i++) {
+			if(device[i + 1] != hostOffsets[i]) {
+				ofLog(OF_LOG_ERROR, "OpenCLStructLayout::verify - " + structName + "." + fieldNames[i] + " is at offset " + ofToString(hostOffsets[i]) + " on the host and " + ofToString(device[i + 1]) + " on the device");
+				ok = false;
+			}
+		}
+		return ok;
+	}
+}
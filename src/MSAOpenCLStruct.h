@@ -0,0 +1,88 @@
+/***********************************************************************
+
+ OpenCL Struct
+ Declare a struct once for both the host and OpenCL C, so the two layouts can't drift apart.
+ The fields are listed in a macro taking FIELD(type, name) for each field, using OpenCL C type names
+ (char, uchar, short, ushort, int, uint, ulong, float, and the host vector types in MSAOpenCLTypes.h: float2, float3, float4, int2, ...)
+ MSA_OPENCL_STRUCT declares the C++ struct with:
+ - getCLSource(): the OpenCL C typedef, to prepend to programs (e.g. with OpenCL::addProgramHeader)
+ - verifyLayout(): compiles and runs a probe kernel which reports the struct's size and field offsets on the device,
+   and compares them with the host's, logging any differences
+ so fields can be packed tightly instead of padding everything to 16 bytes just in case.
+
+ e.g.:
+ #define PARTICLE_FIELDS(FIELD) \
+	FIELD(float2, pos) \
+	FIELD(float2, vel) \
+	FIELD(float, mass) \
+	FIELD(uint, flags)
+
+ MSA_OPENCL_STRUCT(Particle, PARTICLE_FIELDS)
+
+ openCL.addProgramHeader(Particle::getCLSource());		// before loading the programs which use Particle
+ openCL.loadProgramFromFile("MSAOpenCL/Particle.cl");
+ Particle::verifyLayout();
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include <stddef.h>
+#include "MSAOpenCLTypes.h"
+
+
+#define MSA_OPENCL_STRUCT(structName, FIELDS)														\
+	struct structName {																				\
+		typedef cl_uchar	uchar;																	\
+		typedef cl_ushort	ushort;																	\
+		typedef cl_uint		uint;																	\
+		typedef cl_ulong	ulong;																	\
+		typedef msa::float3	float3;																	\
+		typedef msa::int2	int2;																	\
+		typedef msa::int4	int4;																	\
+		typedef msa::uint2	uint2;																	\
+		typedef msa::uint4	uint4;																	\
+		typedef msa::half	half;																	\
+		typedef structName	MsaOpenCLStructType;													\
+																									\
+		FIELDS(MSA_OPENCL_STRUCT_DECLARE)															\
+																									\
+		static string getCLSource() {																\
+			return string("typedef struct {\n") FIELDS(MSA_OPENCL_STRUCT_SOURCE) + "} " #structName ";\n";	\
+		}																							\
+																									\
+		static bool verifyLayout() {																\
+			msa::OpenCLStructLayout layout(#structName, getCLSource(), sizeof(structName));		\
+			FIELDS(MSA_OPENCL_STRUCT_OFFSET)														\
+			return layout.verify();																	\
+		}																							\
+	};
+
+// used by MSA_OPENCL_STRUCT for each field
+#define MSA_OPENCL_STRUCT_DECLARE(type, name)	type name;
+#define MSA_OPENCL_STRUCT_SOURCE(type, name)	+ "\t" #type " " #name ";\n"
+#define MSA_OPENCL_STRUCT_OFFSET(type, name)	layout.addField(#name, offsetof(MsaOpenCLStructType, name));
+
+
+namespace msa {
+
+	// host layout of a struct, checked against the device's by verify
+	class OpenCLStructLayout {
+	public:
+		OpenCLStructLayout(string structName, string clSource, size_t hostSize);
+
+		void addField(string fieldName, size_t hostOffset);
+
+		// runs the probe kernel (blocks), returns true if the size and all offsets match
+		bool verify();
+
+	protected:
+		string			structName;
+		string			clSource;
+		size_t			hostSize;
+		vector<string>	fieldNames;
+		vector<size_t>	hostOffsets;
+	};
+}
@@ -0,0 +1,155 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLTiledImage.h"
+
+namespace msa {
+
+	OpenCLTiledImage::OpenCLTiledImage() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLTiledImage::OpenCLTiledImage");
+		width		= 0;
+		height		= 0;
+		halo		= 0;
+		tileWidth	= 0;
+		tileHeight	= 0;
+	}
+
+
+	OpenCLTiledImage::~OpenCLTiledImage() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLTiledImage::~OpenCLTiledImage");
+		clear();
+	}
+
+
+	void OpenCLTiledImage::initTiledImage(int width, int height, int halo, cl_channel_order imageChannelOrder, cl_channel_type imageChannelDataType, cl_mem_flags memFlags, int maxTileWidth, int maxTileHeight) {
+		ofLog(OF_LOG_VERBOSE, "OpenCLTiledImage::initTiledImage " + ofToString(width) + ", " + ofToString(height) + ", " + ofToString(halo));
+
+		clear();
+
+		OpenCL *pOpenCL = OpenCL::currentOpenCL;
+		if(maxTileWidth <= 0) maxTileWidth = pOpenCL->info.image2dMaxWidth ? pOpenCL->info.image2dMaxWidth : 8192;
+		if(maxTileHeight <= 0) maxTileHeight = pOpenCL->info.image2dMaxHeight ? pOpenCL->info.image2dMaxHeight : 8192;
+
+		this->width		= width;
+		this->height	= height;
+		this->halo		= halo;
+		tileWidth		= maxTileWidth - 2 * halo;
+		tileHeight		= maxTileHeight - 2 * halo;
+
+		if(tileWidth <= 0 || tileHeight <= 0) {
+			ofLog(OF_LOG_ERROR, "OpenCLTiledImage::initTiledImage - halo is too large for the tile size");
+			assert(false);
+			return;
+		}
+
+		for(int coreY = 0; coreY < height; coreY += tileHeight) {
+			for(int coreX = 0; coreX < width; coreX += tileWidth) {
+				Tile t;
+				t.coreX			= coreX;
+				t.coreY			= coreY;
+				t.coreWidth		= min(tileWidth, width - coreX);
+				t.coreHeight	= min(tileHeight, height - coreY);
+
+				// halos are clipped to the whole image, edge tiles rely on the sampler's clamping instead
+				t.x				= max(0, coreX - halo);
+				t.y				= max(0, coreY - halo);
+				t.width			= min(width, coreX + t.coreWidth + halo) - t.x;
+				t.height		= min(height, coreY + t.coreHeight + halo) - t.y;
+
+				t.image = new OpenCLImage();
+				t.image->initWithoutTexture(t.width, t.height, 1, imageChannelOrder, imageChannelDataType, memFlags);
+				tiles.push_back(t);
+			}
+		}
+
+		ofLog(OF_LOG_VERBOSE, "... " + ofToString(tiles.size()) + " tiles");
+	}
+
+
+	void OpenCLTiledImage::write(const void *dataPtr, bool blockingWrite, size_t rowPitch) {
+		if(tiles.empty()) return;
+
+		int bpp = tiles[0].image->getBytesPerPixel();
+		if(rowPitch == 0) rowPitch = width * bpp;
+
+		// the queue is in order, so blocking on the last write waits for all of them
+		for(int i=0; i<tiles.size(); i++) {
+			Tile &t = tiles[i];
+			const unsigned char *tileData = (const unsigned char*)dataPtr + t.y * rowPitch + t.x * bpp;
+			bool isLast = i == tiles.size() - 1;
+			t.image->write((void*)tileData, blockingWrite && isLast, NULL, NULL, rowPitch);
+		}
+	}
+
+
+	void OpenCLTiledImage::read(void *dataPtr, size_t rowPitch) {
+		if(tiles.empty()) return;
+
+		int bpp = tiles[0].image->getBytesPerPixel();
+		if(rowPitch == 0) rowPitch = width * bpp;
+
+		for(int i=0; i<tiles.size(); i++) {
+			Tile &t = tiles[i];
+			size_t origin[3] = { (size_t)(t.coreX - t.x), (size_t)(t.coreY - t.y), 0 };
+			size_t region[3] = { (size_t)t.coreWidth, (size_t)t.coreHeight, 1 };
+			unsigned char *tileData = (unsigned char*)dataPtr + t.coreY * rowPitch + t.coreX * bpp;
+			bool isLast = i == tiles.size() - 1;
+			t.image->read(tileData, isLast, origin, region, rowPitch);
+		}
+	}
+
+
+	void OpenCLTiledImage::run(OpenCLKernel *kernel, OpenCLTiledImage &dst, bool updateHalos) {
+		assert(kernel);
+		if(dst.tiles.size() != tiles.size() || dst.tileWidth != tileWidth || dst.tileHeight != tileHeight || dst.halo != halo) {
+			ofLog(OF_LOG_ERROR, "OpenCLTiledImage::run - dst has a different tile layout");
+			assert(false);
+			return;
+		}
+
+		for(int i=0; i<tiles.size(); i++) {
+			Tile &t = tiles[i];
+			cl_int4 offset;
+			offset.s[0] = t.coreX - t.x;
+			offset.s[1] = t.coreY - t.y;
+			offset.s[2] = t.coreX;
+			offset.s[3] = t.coreY;
+
+			kernel->setArg(0, *t.image, CL_MEM_READ_ONLY);
+			kernel->setArg(1, *dst.tiles[i].image, CL_MEM_WRITE_ONLY);
+			kernel->setArg(2, offset);
+			kernel->run2D(t.coreWidth, t.coreHeight);
+		}
+
+		if(updateHalos) dst.updateHalos();
+	}
+
+
+	void OpenCLTiledImage::updateHalos() {
+		if(halo == 0) return;
+
+		// a tile's halo is made of the parts of its neighbours' cores which overlap it
+		for(int i=0; i<tiles.size(); i++) {
+			Tile &t = tiles[i];
+			for(int j=0; j<tiles.size(); j++) {
+				if(i == j) continue;
+				Tile &n = tiles[j];
+
+				int x0 = max(t.x, n.coreX);
+				int y0 = max(t.y, n.coreY);
+				int x1 = min(t.x + t.width, n.coreX + n.coreWidth);
+				int y1 = min(t.y + t.height, n.coreY + n.coreHeight);
+				if(x0 >= x1 || y0 >= y1) continue;
+
+				size_t srcOrigin[3] = { (size_t)(x0 - n.x), (size_t)(y0 - n.y), 0 };
+				size_t dstOrigin[3] = { (size_t)(x0 - t.x), (size_t)(y0 - t.y), 0 };
+				size_t region[3] = { (size_t)(x1 - x0), (size_t)(y1 - y0), 1 };
+				t.image->copyFrom(*n.image, srcOrigin, dstOrigin, region);
+			}
+		}
+	}
+
+
+	void OpenCLTiledImage::clear() {
+		for(int i=0; i<tiles.size(); i++) delete tiles[i].image;
+		tiles.clear();
+	}
+}
@@ -0,0 +1,117 @@
+/***********************************************************************
+
+ OpenCL Tiled Image
+ A 2D image which can be larger than the device's image size limits (info.image2dMaxWidth / Height)
+ It's split into tiles, each an OpenCLImage holding its part of the image (its core)
+ plus a halo of neighbouring pixels, so that filters reading around each pixel stay seamless across tiles.
+
+ Kernels run across all tiles with run(), and should look like:
+ __kernel void myFilter(read_only image2d_t src, write_only image2d_t dst, int4 offset, ...) {
+	int2 pos = (int2)(get_global_id(0), get_global_id(1)) + offset.xy;	// position in the tile
+	int2 imagePos = (int2)(get_global_id(0), get_global_id(1)) + offset.zw;	// position in the whole image (if needed)
+	...
+ }
+ (arguments after the offset are set on the kernel as usual before calling run)
+
+ e.g.:
+ OpenCLTiledImage src, dst;
+ src.initTiledImage(32000, 8000, 4);			// 4 pixel halo for a 9x9 filter
+ dst.initTiledImage(32000, 8000, 4);
+ src.write(pixels);
+ src.run(openCL.kernel("myFilter"), dst);
+ dst.read(pixels);
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCLImage.h"
+
+namespace msa {
+
+	class OpenCLKernel;
+
+	class OpenCLTiledImage {
+	public:
+
+		struct Tile {
+			OpenCLImage		*image;
+			int				x, y;					// origin of the tile image in the whole image
+			int				width, height;			// size of the tile image (core plus halo)
+			int				coreX, coreY;			// origin of the core in the whole image
+			int				coreWidth, coreHeight;	// size of the core
+		};
+
+		OpenCLTiledImage();
+		~OpenCLTiledImage();
+
+		// create tiles for a width x height image
+		// halo is the number of pixels of overlap on each side of a tile (e.g. the radius of a filter)
+		// tiles are at most maxTileWidth x maxTileHeight including their halo (0 for the device limits)
+		// parameters with default values can be omited
+		void initTiledImage(int width,
+							int height,
+							int halo = 0,
+							cl_channel_order imageChannelOrder = CL_RGBA,
+							cl_channel_type imageChannelDataType = CL_FLOAT,
+							cl_mem_flags memFlags = CL_MEM_READ_WRITE,
+							int maxTileWidth = 0,
+							int maxTileHeight = 0);
+
+		// write the whole image from main memory (dataPtr), including all halos
+		// rowPitch is in bytes, 0 for tightly packed rows
+		void write(const void *dataPtr,
+				   bool blockingWrite = CL_FALSE,
+				   size_t rowPitch = 0);
+
+		// read the whole image (the cores of all tiles) into main memory (into dataPtr)
+		// rowPitch is in bytes, 0 for tightly packed rows
+		void read(void *dataPtr,
+				  size_t rowPitch = 0);
+
+		// run kernel over the cores of all tiles, reading from this image and writing to dst
+		// dst must have been initialized with the same size, halo and tile size
+		// kernel arguments 0, 1 and 2 are set here (see above), set any others before calling this
+		// if updateHalos is true, dst's halos are updated afterwards (see updateHalos)
+		void run(OpenCLKernel *kernel,
+				 OpenCLTiledImage &dst,
+				 bool updateHalos = true);
+
+		// copy the edges of each tile's core into its neighbours' halos (on the device)
+		// needed after anything which only writes the cores of the tiles
+		void updateHalos();
+
+		int getWidth() {
+			return width;
+		}
+
+		int getHeight() {
+			return height;
+		}
+
+		int getHalo() {
+			return halo;
+		}
+
+		int getNumTiles() {
+			return tiles.size();
+		}
+
+		Tile &getTile(int i) {
+			return tiles[i];
+		}
+
+
+	protected:
+		int				width;
+		int				height;
+		int				halo;
+		int				tileWidth;		// core size of all but the last column and row of tiles
+		int				tileHeight;
+		vector<Tile>	tiles;
+
+		void clear();
+	};
+}
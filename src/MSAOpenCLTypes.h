@@ -1,8 +1,110 @@
+/***********************************************************************
+
+ Host side vector types with the same size and alignment as OpenCL's, so arrays of them can be copied straight to and from buffers
+ (float3 is padded to 16 bytes, as in OpenCL)
+ float4 and float3 arithmetic uses SSE or NEON when compiled for them, plain C otherwise
+ There are also bulk operations on arrays of float4s (at the end of this file), for preparing and checking data on the host
+
+ ************************************************************************/
+
 #pragma once
 
 #include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCLHalf.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MSA_OPENCL_TYPES_SSE
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MSA_OPENCL_TYPES_NEON
+#endif
+
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+#define MSA_OPENCL_ALIGN(n)						alignas(n)
+#define MSA_OPENCL_ALIGNOF(type)				alignof(type)
+#define MSA_OPENCL_STATIC_ASSERT(cond, msg)		static_assert(cond, msg)
+#else
+#if defined(_MSC_VER)
+#define MSA_OPENCL_ALIGN(n)						__declspec(align(n))
+#define MSA_OPENCL_ALIGNOF(type)				__alignof(type)
+#else
+#define MSA_OPENCL_ALIGN(n)						__attribute__((aligned(n)))
+#define MSA_OPENCL_ALIGNOF(type)				__alignof__(type)
+#endif
+#define MSA_OPENCL_STATIC_ASSERT_NAME(line)		MSA_OPENCL_STATIC_ASSERT_NAME2(line)
+#define MSA_OPENCL_STATIC_ASSERT_NAME2(line)	msaOpenCLStaticAssert##line
+#define MSA_OPENCL_STATIC_ASSERT(cond, msg)		typedef char MSA_OPENCL_STATIC_ASSERT_NAME(__LINE__)[(cond) ? 1 : -1]
+#endif
+
+
+// 4 floats at a time, for float4 and float3
+// loads and stores are unaligned, so they also work on memory the compiler didn't align (e.g. new[] on some platforms)
+namespace msa {
+	namespace simd {
+
+#if defined(MSA_OPENCL_TYPES_SSE)
+		typedef __m128 vec;
+		inline vec load(const float *p)				{ return _mm_loadu_ps(p); }
+		inline void store(float *p, vec v)			{ _mm_storeu_ps(p, v); }
+		inline vec set(float f)						{ return _mm_set1_ps(f); }
+		inline vec add(vec a, vec b)				{ return _mm_add_ps(a, b); }
+		inline vec sub(vec a, vec b)				{ return _mm_sub_ps(a, b); }
+		inline vec mul(vec a, vec b)				{ return _mm_mul_ps(a, b); }
+		inline vec min(vec a, vec b)				{ return _mm_min_ps(a, b); }
+		inline vec max(vec a, vec b)				{ return _mm_max_ps(a, b); }
+
+		// a / b, leaving a where b is 0
+		inline vec safeDiv(vec a, vec b) {
+			vec nonZero = _mm_cmpneq_ps(b, _mm_setzero_ps());
+			return _mm_or_ps(_mm_and_ps(nonZero, _mm_div_ps(a, b)), _mm_andnot_ps(nonZero, a));
+		}
+
+#elif defined(MSA_OPENCL_TYPES_NEON)
+		typedef float32x4_t vec;
+		inline vec load(const float *p)				{ return vld1q_f32(p); }
+		inline void store(float *p, vec v)			{ vst1q_f32(p, v); }
+		inline vec set(float f)						{ return vdupq_n_f32(f); }
+		inline vec add(vec a, vec b)				{ return vaddq_f32(a, b); }
+		inline vec sub(vec a, vec b)				{ return vsubq_f32(a, b); }
+		inline vec mul(vec a, vec b)				{ return vmulq_f32(a, b); }
+		inline vec min(vec a, vec b)				{ return vminq_f32(a, b); }
+		inline vec max(vec a, vec b)				{ return vmaxq_f32(a, b); }
+
+		inline vec safeDiv(vec a, vec b) {
+#if defined(__aarch64__)
+			return vbslq_f32(vceqq_f32(b, vdupq_n_f32(0)), a, vdivq_f32(a, b));
+#else
+			// no vector divide on 32 bit ARM (and the reciprocal estimate isn't exact), so divide per component
+			float fa[4], fb[4];
+			vst1q_f32(fa, a);
+			vst1q_f32(fb, b);
+			for(int i=0; i<4; i++) if(fb[i] != 0) fa[i] /= fb[i];
+			return vld1q_f32(fa);
+#endif
+		}
+
+#else
+		struct vec {
+			float v[4];
+		};
+		inline vec load(const float *p)				{ vec r; for(int i=0; i<4; i++) r.v[i] = p[i]; return r; }
+		inline void store(float *p, vec v)			{ for(int i=0; i<4; i++) p[i] = v.v[i]; }
+		inline vec set(float f)						{ vec r; for(int i=0; i<4; i++) r.v[i] = f; return r; }
+		inline vec add(vec a, vec b)				{ for(int i=0; i<4; i++) a.v[i] += b.v[i]; return a; }
+		inline vec sub(vec a, vec b)				{ for(int i=0; i<4; i++) a.v[i] -= b.v[i]; return a; }
+		inline vec mul(vec a, vec b)				{ for(int i=0; i<4; i++) a.v[i] *= b.v[i]; return a; }
+		inline vec min(vec a, vec b)				{ for(int i=0; i<4; i++) a.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i]; return a; }
+		inline vec max(vec a, vec b)				{ for(int i=0; i<4; i++) a.v[i] = b.v[i] > a.v[i] ? b.v[i] : a.v[i]; return a; }
+		inline vec safeDiv(vec a, vec b)			{ for(int i=0; i<4; i++) if(b.v[i] != 0) a.v[i] /= b.v[i]; return a; }
+#endif
+	}
+}
+
+
 
-class float2 {
+class MSA_OPENCL_ALIGN(8) float2 {
 public:
 	
 	float x, y;
@@ -744,7 +846,7 @@ inline float2 operator/( float f, const float2& vec ) {
 
 
 //---------------------------------------------------------
-class float4 {
+class MSA_OPENCL_ALIGN(16) float4 {
 public:
 	cl_float x, y, z, w;
 
@@ -773,20 +875,38 @@ public:
     }
 	
 	
+	//------ SIMD access:
+	
+	msa::simd::vec simd() const {
+		return msa::simd::load(&x);
+	}
+	
+	static float4 fromSimd( msa::simd::vec v ) {
+		float4 r;
+		msa::simd::store(&r.x, v);
+		return r;
+	}
+	
+	float4 & setSimd( msa::simd::vec v ) {
+		msa::simd::store(&x, v);
+		return *this;
+	}
+	
+	
 	//------ Operators:
 	
   	//Negative
     float4 operator-() const {
-        return float4( -x, -y, -z, -w );
+        return fromSimd(msa::simd::sub(msa::simd::set(0), simd()));
     }
 	
     //equality
-    bool operator==( const float4& pnt ) {
-        return (x == pnt.x) && (y == pnt.y) && (z == pnt.z) && (z == pnt.w);
+    bool operator==( const float4& pnt ) const {
+        return (x == pnt.x) && (y == pnt.y) && (z == pnt.z) && (w == pnt.w);
     }
 	
 	//inequality
-    bool operator!=( const float4& pnt ) {
+    bool operator!=( const float4& pnt ) const {
         return (x != pnt.x) || (y != pnt.y) || (z != pnt.z) || (w != pnt.w);
     }
 	
@@ -800,92 +920,64 @@ public:
 	}
 	
 	float4 & operator=( const float& val ){
-		x = val;
-		y = val;
-		z = val;
-		w = val;
-		return *this;
+		return setSimd(msa::simd::set(val));
 	}
 	
 	// Add
     float4 operator+( const float4& pnt ) const {
-        return float4( x+pnt.x, y+pnt.y, z+pnt.z, w+pnt.w );
+        return fromSimd(msa::simd::add(simd(), pnt.simd()));
     }
 	
     float4 operator+( const float& val ) const {
-        return float4( x+val, y+val, z+val, w+val );
+        return fromSimd(msa::simd::add(simd(), msa::simd::set(val)));
     }
 	
 	float4 & operator+=( const float4& pnt ) {
-        x+=pnt.x;
-        y+=pnt.y;
-        z+=pnt.z;
-		w+=pnt.w;
-        return *this;
+        return setSimd(msa::simd::add(simd(), pnt.simd()));
     }
 	
 	float4 & operator+=( const float & val ) {
-        x+=val;
-        y+=val;
-        z+=val;
-		z+=val;
-        return *this;
+        return setSimd(msa::simd::add(simd(), msa::simd::set(val)));
     }
 	
 	// Subtract
     float4 operator-(const float4& pnt) const {
-        return float4( x-pnt.x, y-pnt.y, z-pnt.z, w-pnt.w );
+        return fromSimd(msa::simd::sub(simd(), pnt.simd()));
     }
 	
     float4 operator-(const float& val) const {
-        return float4( x-val, y-val, z-val, w-val);
+        return fromSimd(msa::simd::sub(simd(), msa::simd::set(val)));
     }
 	
     float4 & operator-=( const float4& pnt ) {
-        x -= pnt.x;
-        y -= pnt.y;
-        z -= pnt.z;
-		w -= pnt.w;
-        return *this;
+        return setSimd(msa::simd::sub(simd(), pnt.simd()));
     }
 	
     float4 & operator-=( const float & val ) {
-        x -= val;
-        y -= val;
-        z -= val;
-		w -= val;
-        return *this;
+        return setSimd(msa::simd::sub(simd(), msa::simd::set(val)));
     }
 	
 	// Multiply
     float4 operator*( const float4& pnt ) const {
-        return float4( x*pnt.x, y*pnt.y, z*pnt.z, w*pnt.w );
+        return fromSimd(msa::simd::mul(simd(), pnt.simd()));
     }
 	
     float4 operator*(const float& val) const {
-        return float4( x*val, y*val, z*val, w*val);
+        return fromSimd(msa::simd::mul(simd(), msa::simd::set(val)));
     }
 	
     float4 & operator*=( const float4& pnt ) {
-        x*=pnt.x;
-        y*=pnt.y;
-        z*=pnt.z;
-		w*=pnt.w;
-        return *this;
+        return setSimd(msa::simd::mul(simd(), pnt.simd()));
     }
 	
     float4 & operator*=( const float & val ) {
-        x*=val;
-        y*=val;
-        z*=val;
-		w*=val;
-        return *this;
+        return setSimd(msa::simd::mul(simd(), msa::simd::set(val)));
     }
 	
 	
-	// Divide
+	// Divide (components divided by 0 are left unchanged)
     float4 operator/( const float4& pnt ) const {
-        return float4( pnt.x!=0 ? x/pnt.x : x , pnt.y!=0 ? y/pnt.y : y, pnt.z!=0 ? z/pnt.z : z, pnt.w!=0 ? w/pnt.w : w );
+        return fromSimd(msa::simd::safeDiv(simd(), pnt.simd()));
     }
 	
     float4 operator/( const float &val ) const {
@@ -896,12 +988,7 @@ public:
     }
 	
     float4& operator/=( const float4& pnt ) {
-        pnt.x!=0 ? x/=pnt.x : x;
-        pnt.y!=0 ? y/=pnt.y : y;
-        pnt.z!=0 ? z/=pnt.z : z;
-        pnt.w!=0 ? w/=pnt.w : w;
-		
-        return *this;
+        return setSimd(msa::simd::safeDiv(simd(), pnt.simd()));
     }
 	
     float4& operator/=( const float &val ) {
@@ -914,23 +1001,278 @@ public:
 		
 		return *this;
     }
+	
+	
+	// Component-wise min and max
+	float4 getMin( const float4& pnt ) const {
+		return fromSimd(msa::simd::min(simd(), pnt.simd()));
+	}
+	
+	float4 getMax( const float4& pnt ) const {
+		return fromSimd(msa::simd::max(simd(), pnt.simd()));
+	}
+	
+	// of all 4 components
+	float dot( const float4& pnt ) const {
+		float4 p = *this * pnt;
+		return (p.x + p.y) + (p.z + p.w);
+	}
 };
 
 
 
 inline float4 operator+( float f, const float4& vec ) {
-    return float4( f+vec.x, f+vec.y, f+vec.z, f+vec.w );
+    return float4::fromSimd(msa::simd::add(msa::simd::set(f), vec.simd()));
 }
 
 inline float4 operator-( float f, const float4& vec ) {
-    return float4( f-vec.x, f-vec.y, f-vec.z, f-vec.w );
+    return float4::fromSimd(msa::simd::sub(msa::simd::set(f), vec.simd()));
 }
 
 inline float4 operator*( float f, const float4& vec ) {
-    return float4( f*vec.x, f*vec.y, f*vec.z, f*vec.w );
+    return float4::fromSimd(msa::simd::mul(msa::simd::set(f), vec.simd()));
 }
 
 inline float4 operator/( float f, const float4& vec ) {
     return float4( f/vec.x, f/vec.y, f/vec.z, f/vec.w);
 }
 
+
+
+// float2 and float4 have always been global, the rest are in msa:: so they can't clash with other libraries' types
+namespace msa {
+	
+	//---------------------------------------------------------
+	// the same size as a float4 (as cl_float3 is), the 4th float is kept at 0
+	class MSA_OPENCL_ALIGN(16) float3 {
+	public:
+		cl_float x, y, z;
+		cl_float padding;		// public like the rest, so structs containing a float3 are standard layout (for offsetof, see MSAOpenCLStruct.h)
+	
+		float3( float _x = 0.0f, float _y = 0.0f, float _z = 0.0f ) {
+			set(_x, _y, _z);
+		}
+	
+		void set( float _x, float _y, float _z ) {
+			x = _x;
+			y = _y;
+			z = _z;
+			padding = 0;
+		}
+	
+		msa::simd::vec simd() const {
+			return msa::simd::load(&x);
+		}
+	
+		static float3 fromSimd( msa::simd::vec v ) {
+			float3 r;
+			msa::simd::store(&r.x, v);
+			return r;
+		}
+	
+		bool operator==( const float3& pnt ) const {
+			return (x == pnt.x) && (y == pnt.y) && (z == pnt.z);
+		}
+	
+		bool operator!=( const float3& pnt ) const {
+			return !(*this == pnt);
+		}
+	
+		float3 operator-() const							{ return fromSimd(msa::simd::sub(msa::simd::set(0), simd())); }
+		float3 operator+( const float3& pnt ) const		{ return fromSimd(msa::simd::add(simd(), pnt.simd())); }
+		float3 operator-( const float3& pnt ) const		{ return fromSimd(msa::simd::sub(simd(), pnt.simd())); }
+		float3 operator*( const float3& pnt ) const		{ return fromSimd(msa::simd::mul(simd(), pnt.simd())); }
+		float3 operator/( const float3& pnt ) const		{ return fromSimd(msa::simd::safeDiv(simd(), pnt.simd())); }
+		float3 operator*( const float val ) const			{ return *this * float3(val, val, val); }
+		float3 operator/( const float val ) const			{ return val != 0 ? float3(x / val, y / val, z / val) : *this; }
+	
+		float3 & operator+=( const float3& pnt )			{ return *this = *this + pnt; }
+		float3 & operator-=( const float3& pnt )			{ return *this = *this - pnt; }
+		float3 & operator*=( const float3& pnt )			{ return *this = *this * pnt; }
+		float3 & operator/=( const float3& pnt )			{ return *this = *this / pnt; }
+		float3 & operator*=( const float val )				{ return *this = *this * val; }
+		float3 & operator/=( const float val )				{ return *this = *this / val; }
+	
+		float dot( const float3& pnt ) const {
+			return x*pnt.x + y*pnt.y + z*pnt.z;
+		}
+	
+		float3 cross( const float3& pnt ) const {
+			return float3( y*pnt.z - z*pnt.y, z*pnt.x - x*pnt.z, x*pnt.y - y*pnt.x );
+		}
+	
+		float length() const {
+			return sqrtf(dot(*this));
+		}
+	};
+
+	inline float3 operator*( float f, const float3& vec ) {
+		return vec * f;
+	}
+
+
+
+	//---------------------------------------------------------
+	// integer vectors, for kernel arguments and index buffers
+	class MSA_OPENCL_ALIGN(8) int2 {
+	public:
+		cl_int x, y;
+	
+		int2( int _x = 0, int _y = 0 ) : x(_x), y(_y) {}
+	
+		bool operator==( const int2& v ) const		{ return x == v.x && y == v.y; }
+		bool operator!=( const int2& v ) const		{ return !(*this == v); }
+		int2 operator+( const int2& v ) const		{ return int2(x + v.x, y + v.y); }
+		int2 operator-( const int2& v ) const		{ return int2(x - v.x, y - v.y); }
+		int2 operator*( const int2& v ) const		{ return int2(x * v.x, y * v.y); }
+		int2 operator*( int i ) const				{ return int2(x * i, y * i); }
+		int2 & operator+=( const int2& v )			{ return *this = *this + v; }
+		int2 & operator-=( const int2& v )			{ return *this = *this - v; }
+	};
+
+	class MSA_OPENCL_ALIGN(16) int4 {
+	public:
+		cl_int x, y, z, w;
+	
+		int4( int _x = 0, int _y = 0, int _z = 0, int _w = 0 ) : x(_x), y(_y), z(_z), w(_w) {}
+	
+		bool operator==( const int4& v ) const		{ return x == v.x && y == v.y && z == v.z && w == v.w; }
+		bool operator!=( const int4& v ) const		{ return !(*this == v); }
+		int4 operator+( const int4& v ) const		{ return int4(x + v.x, y + v.y, z + v.z, w + v.w); }
+		int4 operator-( const int4& v ) const		{ return int4(x - v.x, y - v.y, z - v.z, w - v.w); }
+		int4 operator*( const int4& v ) const		{ return int4(x * v.x, y * v.y, z * v.z, w * v.w); }
+		int4 operator*( int i ) const				{ return int4(x * i, y * i, z * i, w * i); }
+		int4 & operator+=( const int4& v )			{ return *this = *this + v; }
+		int4 & operator-=( const int4& v )			{ return *this = *this - v; }
+	};
+
+	class MSA_OPENCL_ALIGN(8) uint2 {
+	public:
+		cl_uint x, y;
+	
+		uint2( unsigned int _x = 0, unsigned int _y = 0 ) : x(_x), y(_y) {}
+	
+		bool operator==( const uint2& v ) const		{ return x == v.x && y == v.y; }
+		bool operator!=( const uint2& v ) const		{ return !(*this == v); }
+		uint2 operator+( const uint2& v ) const		{ return uint2(x + v.x, y + v.y); }
+		uint2 operator-( const uint2& v ) const		{ return uint2(x - v.x, y - v.y); }
+		uint2 operator*( const uint2& v ) const		{ return uint2(x * v.x, y * v.y); }
+		uint2 & operator+=( const uint2& v )		{ return *this = *this + v; }
+		uint2 & operator-=( const uint2& v )		{ return *this = *this - v; }
+	};
+
+	class MSA_OPENCL_ALIGN(16) uint4 {
+	public:
+		cl_uint x, y, z, w;
+	
+		uint4( unsigned int _x = 0, unsigned int _y = 0, unsigned int _z = 0, unsigned int _w = 0 ) : x(_x), y(_y), z(_z), w(_w) {}
+	
+		bool operator==( const uint4& v ) const		{ return x == v.x && y == v.y && z == v.z && w == v.w; }
+		bool operator!=( const uint4& v ) const		{ return !(*this == v); }
+		uint4 operator+( const uint4& v ) const		{ return uint4(x + v.x, y + v.y, z + v.z, w + v.w); }
+		uint4 operator-( const uint4& v ) const		{ return uint4(x - v.x, y - v.y, z - v.z, w - v.w); }
+		uint4 operator*( const uint4& v ) const		{ return uint4(x * v.x, y * v.y, z * v.z, w * v.w); }
+		uint4 & operator+=( const uint4& v )		{ return *this = *this + v; }
+		uint4 & operator-=( const uint4& v )		{ return *this = *this - v; }
+	};
+
+
+
+	//---------------------------------------------------------
+	// a single half, converted to and from float (see MSAOpenCLHalf.h for converting whole arrays)
+	class half {
+	public:
+		cl_half bits;
+	
+		half() {}
+		half( float f ) : bits(msa::floatToHalf(f)) {}
+	
+		operator float() const {
+			return msa::halfToFloat(bits);
+		}
+	};
+}
+
+
+
+
+// host types must match the device's (in size and alignment), so arrays of them can be copied to and from buffers
+MSA_OPENCL_STATIC_ASSERT(sizeof(float2) == sizeof(cl_float2), "float2 size doesn't match cl_float2");
+MSA_OPENCL_STATIC_ASSERT(sizeof(msa::float3) == sizeof(cl_float3), "float3 size doesn't match cl_float3");
+MSA_OPENCL_STATIC_ASSERT(sizeof(float4) == sizeof(cl_float4), "float4 size doesn't match cl_float4");
+MSA_OPENCL_STATIC_ASSERT(sizeof(msa::int2) == sizeof(cl_int2), "int2 size doesn't match cl_int2");
+MSA_OPENCL_STATIC_ASSERT(sizeof(msa::int4) == sizeof(cl_int4), "int4 size doesn't match cl_int4");
+MSA_OPENCL_STATIC_ASSERT(sizeof(msa::uint2) == sizeof(cl_uint2), "uint2 size doesn't match cl_uint2");
+MSA_OPENCL_STATIC_ASSERT(sizeof(msa::uint4) == sizeof(cl_uint4), "uint4 size doesn't match cl_uint4");
+MSA_OPENCL_STATIC_ASSERT(sizeof(msa::half) == sizeof(cl_half), "half size doesn't match cl_half");
+MSA_OPENCL_STATIC_ASSERT(MSA_OPENCL_ALIGNOF(float2) == MSA_OPENCL_ALIGNOF(cl_float2), "float2 alignment doesn't match cl_float2");
+MSA_OPENCL_STATIC_ASSERT(MSA_OPENCL_ALIGNOF(msa::float3) == MSA_OPENCL_ALIGNOF(cl_float3), "float3 alignment doesn't match cl_float3");
+MSA_OPENCL_STATIC_ASSERT(MSA_OPENCL_ALIGNOF(float4) == MSA_OPENCL_ALIGNOF(cl_float4), "float4 alignment doesn't match cl_float4");
+MSA_OPENCL_STATIC_ASSERT(MSA_OPENCL_ALIGNOF(msa::int2) == MSA_OPENCL_ALIGNOF(cl_int2), "int2 alignment doesn't match cl_int2");
+MSA_OPENCL_STATIC_ASSERT(MSA_OPENCL_ALIGNOF(msa::int4) == MSA_OPENCL_ALIGNOF(cl_int4), "int4 alignment doesn't match cl_int4");
+MSA_OPENCL_STATIC_ASSERT(MSA_OPENCL_ALIGNOF(msa::uint2) == MSA_OPENCL_ALIGNOF(cl_uint2), "uint2 alignment doesn't match cl_uint2");
+MSA_OPENCL_STATIC_ASSERT(MSA_OPENCL_ALIGNOF(msa::uint4) == MSA_OPENCL_ALIGNOF(cl_uint4), "uint4 alignment doesn't match cl_uint4");
+MSA_OPENCL_STATIC_ASSERT(MSA_OPENCL_ALIGNOF(msa::half) == MSA_OPENCL_ALIGNOF(cl_half), "half alignment doesn't match cl_half");
+
+
+
+//---------------------------------------------------------
+// bulk operations on arrays of numElements float4s, e.g. preparing data for upload, or checking results read back
+// dst can be the same array as a source
+namespace msa {
+	
+	inline void addArrays(const float4 *a, const float4 *b, float4 *dst, int numElements) {
+		for(int i=0; i<numElements; i++) dst[i] = a[i] + b[i];
+	}
+	
+	inline void subtractArrays(const float4 *a, const float4 *b, float4 *dst, int numElements) {
+		for(int i=0; i<numElements; i++) dst[i] = a[i] - b[i];
+	}
+	
+	inline void multiplyArrays(const float4 *a, const float4 *b, float4 *dst, int numElements) {
+		for(int i=0; i<numElements; i++) dst[i] = a[i] * b[i];
+	}
+	
+	inline void scaleArray(const float4 *a, float scale, float4 *dst, int numElements) {
+		simd::vec s = simd::set(scale);
+		for(int i=0; i<numElements; i++) dst[i].setSimd(simd::mul(a[i].simd(), s));
+	}
+	
+	// dst = a * scale + b (e.g. pos = vel * dt + pos)
+	inline void madArrays(const float4 *a, float scale, const float4 *b, float4 *dst, int numElements) {
+		simd::vec s = simd::set(scale);
+		for(int i=0; i<numElements; i++) dst[i].setSimd(simd::add(simd::mul(a[i].simd(), s), b[i].simd()));
+	}
+	
+	inline float4 sumArray(const float4 *a, int numElements) {
+		simd::vec sum = simd::set(0);
+		for(int i=0; i<numElements; i++) sum = simd::add(sum, a[i].simd());
+		return float4::fromSimd(sum);
+	}
+	
+	// component-wise bounds
+	inline void minMaxArray(const float4 *a, int numElements, float4 &minValue, float4 &maxValue) {
+		if(numElements <= 0) return;
+		simd::vec lo = a[0].simd();
+		simd::vec hi = lo;
+		for(int i=1; i<numElements; i++) {
+			simd::vec v = a[i].simd();
+			lo = simd::min(lo, v);
+			hi = simd::max(hi, v);
+		}
+		minValue.setSimd(lo);
+		maxValue.setSimd(hi);
+	}
+	
+	// largest absolute difference between any two corresponding components
+	inline float maxDifference(const float4 *a, const float4 *b, int numElements) {
+		simd::vec zero = simd::set(0);
+		simd::vec m = zero;
+		for(int i=0; i<numElements; i++) {
+			simd::vec d = simd::sub(a[i].simd(), b[i].simd());
+			m = simd::max(m, simd::max(d, simd::sub(zero, d)));
+		}
+		float4 r = float4::fromSimd(m);
+		return max(max(r.x, r.y), max(r.z, r.w));
+	}
+}
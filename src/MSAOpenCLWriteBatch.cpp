@@ -0,0 +1,186 @@
+#include "MSAOpenCL.h"
+#include "MSAOpenCLWriteBatch.h"
+
+namespace msa {
+
+	// one work-group per span, all offsets and sizes in uints
+	// spans[i] = (src offset, dst offset, number of uints, unused)
+	static const string scatterSource = MSA_OPENCL_SOURCE(
+		__kernel void msa_scatter(__global const uint *src, __global uint *dst, __global const int4 *spans, const int firstSpan) {
+			int4 span = spans[firstSpan + get_group_id(0)];
+			for(int i = get_local_id(0); i < span.z; i += get_local_size(0)) dst[span.y + i] = src[span.x + i];
+		}
+	);
+
+
+	OpenCLWriteBatch::OpenCLWriteBatch() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLWriteBatch::OpenCLWriteBatch");
+		uploadEvent			= NULL;
+		scatterThreshold	= 8;
+		kernelScatter		= NULL;
+	}
+
+
+	OpenCLWriteBatch::~OpenCLWriteBatch() {
+		ofLog(OF_LOG_VERBOSE, "OpenCLWriteBatch::~OpenCLWriteBatch");
+		waitForUpload();
+	}
+
+
+	void OpenCLWriteBatch::write(OpenCLBuffer &buffer, const void *dataPtr, int startOffsetBytes, int numberOfBytes) {
+		if(numberOfBytes <= 0) return;
+
+		Write w;
+		w.buffer	= &buffer;
+		w.dstOffset	= startOffsetBytes;
+		w.srcOffset	= hostData.size();
+		w.numBytes	= numberOfBytes;
+		w.order		= writes.size();
+		w.span		= -1;
+		writes.push_back(w);
+
+		const unsigned char *bytes = (const unsigned char*)dataPtr;
+		hostData.insert(hostData.end(), bytes, bytes + numberOfBytes);
+	}
+
+
+	void OpenCLWriteBatch::flush() {
+		if(writes.empty()) return;
+
+		waitForUpload();
+		buildSpans();
+
+		OpenCL *pOpenCL = OpenCL::currentOpenCL;
+
+		// decide per destination buffer whether to scatter with the kernel or with copies
+		// the scatter tables are appended to the staging data so everything goes up in one transfer
+		struct Group {
+			int firstSpan;
+			int numSpans;
+			int tableOffset;		// in int4s, -1 for copies
+		};
+		vector<Group> groups;
+
+		int dataSize = stagingData.size();
+		vector<cl_int> table;
+		for(int i=0; i<spans.size(); ) {
+			Group g;
+			g.firstSpan		= i;
+			g.tableOffset	= -1;
+
+			bool isAligned = true;
+			while(i < spans.size() && spans[i].buffer == spans[g.firstSpan].buffer) {
+				if(spans[i].dstOffset % 4 || spans[i].numBytes % 4) isAligned = false;
+				i++;
+			}
+			g.numSpans = i - g.firstSpan;
+
+			if(isAligned && g.numSpans >= scatterThreshold) {
+				g.tableOffset = table.size() / 4;
+				for(int j=g.firstSpan; j<i; j++) {
+					table.push_back(spans[j].stagingOffset / 4);
+					table.push_back(spans[j].dstOffset / 4);
+					table.push_back(spans[j].numBytes / 4);
+					table.push_back(0);
+				}
+			}
+			groups.push_back(g);
+		}
+
+		int tableStart = (dataSize + 15) & ~15;		// int4 aligned
+		if(!table.empty()) {
+			stagingData.resize(tableStart + table.size() * sizeof(cl_int));
+			memcpy(&stagingData[tableStart], &table[0], table.size() * sizeof(cl_int));
+		}
+
+		if(stagingBuffer.getCapacity() < stagingData.size()) {
+			stagingBuffer.initBuffer(max(stagingData.size(), stagingBuffer.getCapacity() * 2), CL_MEM_READ_ONLY);
+		}
+
+		cl_int err = clEnqueueWriteBuffer(pOpenCL->getQueue(), stagingBuffer.getResidentCLMem(), CL_FALSE, 0, stagingData.size(), &stagingData[0], 0, NULL, &uploadEvent);
+		assert(err == CL_SUCCESS);
+
+		for(int i=0; i<groups.size(); i++) {
+			Group &g = groups[i];
+			OpenCLBuffer &dst = *spans[g.firstSpan].buffer;
+
+			if(g.tableOffset >= 0) {
+				if(kernelScatter == NULL) kernelScatter = pOpenCL->loadBuiltinKernel("msa_scatter", "MSAOpenCLWriteBatch", scatterSource);
+
+				cl_int firstSpan = tableStart / 16 + g.tableOffset;
+				size_t localSize = min((size_t)64, kernelScatter->getWorkGroupSize());
+				kernelScatter->setArg(0, stagingBuffer, CL_MEM_READ_ONLY);
+				kernelScatter->setArg(1, dst, CL_MEM_WRITE_ONLY);
+				kernelScatter->setArg(2, stagingBuffer, CL_MEM_READ_ONLY);
+				kernelScatter->setArg(3, firstSpan);
+				kernelScatter->run1D(g.numSpans * localSize, localSize);
+			} else {
+				for(int j=g.firstSpan; j<g.firstSpan + g.numSpans; j++) {
+					dst.copyFrom(stagingBuffer, spans[j].stagingOffset, spans[j].dstOffset, spans[j].numBytes);
+				}
+			}
+		}
+
+		clear();
+	}
+
+
+	void OpenCLWriteBatch::clear() {
+		writes.clear();
+		hostData.clear();
+	}
+
+
+	void OpenCLWriteBatch::buildSpans() {
+		// sort by destination, and merge overlapping and adjacent writes into spans
+		sort(writes.begin(), writes.end(), compareWrites);
+
+		spans.clear();
+		int stagingSize = 0;
+		for(int i=0; i<writes.size(); i++) {
+			Write &w = writes[i];
+			if(!spans.empty() && spans.back().buffer == w.buffer && w.dstOffset <= spans.back().dstOffset + spans.back().numBytes) {
+				Span &s = spans.back();
+				int spanEnd = s.dstOffset + s.numBytes;
+				int newEnd = max(spanEnd, w.dstOffset + w.numBytes);
+				stagingSize	+= newEnd - spanEnd;		// the last span is always at the end of the staging data
+				s.numBytes	= newEnd - s.dstOffset;
+			} else {
+				stagingSize = (stagingSize + 3) & ~3;	// keep spans uint aligned for the scatter kernel
+				Span s;
+				s.buffer		= w.buffer;
+				s.dstOffset		= w.dstOffset;
+				s.stagingOffset	= stagingSize;
+				s.numBytes		= w.numBytes;
+				spans.push_back(s);
+				stagingSize += w.numBytes;
+			}
+			w.span = spans.size() - 1;
+		}
+
+		// copy data into the spans in order of submission, so later writes win where they overlap
+		stagingData.resize(stagingSize);
+		vector<Write*> byOrder(writes.size());
+		for(int i=0; i<writes.size(); i++) byOrder[writes[i].order] = &writes[i];
+		for(int i=0; i<byOrder.size(); i++) {
+			Write &w = *byOrder[i];
+			Span &s = spans[w.span];
+			memcpy(&stagingData[s.stagingOffset + w.dstOffset - s.dstOffset], &hostData[w.srcOffset], w.numBytes);
+		}
+	}
+
+
+	void OpenCLWriteBatch::waitForUpload() {
+		if(uploadEvent == NULL) return;
+		clWaitForEvents(1, &uploadEvent);
+		clReleaseEvent(uploadEvent);
+		uploadEvent = NULL;
+	}
+
+
+	bool OpenCLWriteBatch::compareWrites(const Write &a, const Write &b) {
+		if(a.buffer != b.buffer) return std::less<OpenCLBuffer*>()(a.buffer, b.buffer);
+		if(a.dstOffset != b.dstOffset) return a.dstOffset < b.dstOffset;
+		return a.order < b.order;
+	}
+}
@@ -0,0 +1,94 @@
+/***********************************************************************
+
+ OpenCL Write Batch
+ Combines many small writes (to one or more OpenCLBuffers) into a single upload.
+ Every clEnqueueWriteBuffer has a fixed cost, so thousands of tiny writes per frame add up.
+ Instead, writes are gathered on the host, uploaded in one transfer when flushed,
+ and scattered on the device (by a built in kernel, or with buffer copies if there are only a few).
+ Overlapping and adjacent writes are merged, the latest write wins.
+
+ e.g.:
+ OpenCLWriteBatch batch;
+ for(int i=0; i<numObjects; i++) batch.write(uniformsBuffer, &uniforms[i], i * sizeof(Uniforms), sizeof(Uniforms));
+ batch.flush();		// one transfer
+
+ ************************************************************************/
+
+#pragma once
+
+#include "ofMain.h"
+#include <OpenCL/Opencl.h>
+#include "MSAOpenCLBuffer.h"
+
+namespace msa {
+
+	class OpenCLKernel;
+
+	class OpenCLWriteBatch {
+	public:
+
+		OpenCLWriteBatch();
+		~OpenCLWriteBatch();
+
+		// queue a write from main memory (dataPtr) into buffer
+		// data is copied immediately, so dataPtr can be reused straight away
+		void write(OpenCLBuffer &buffer,
+				   const void *dataPtr,
+				   int startOffsetBytes,
+				   int numberOfBytes);
+
+		// upload all queued writes and scatter them into their buffers
+		// this doesn't block
+		void flush();
+
+		// forget all queued writes
+		void clear();
+
+		int getNumPendingWrites() {
+			return writes.size();
+		}
+
+		int getNumPendingBytes() {
+			return hostData.size();
+		}
+
+		// a buffer receiving at least this many (merged) spans is scattered with a kernel instead of buffer copies
+		// (default 8)
+		void setScatterThreshold(int numSpans) {
+			scatterThreshold = numSpans;
+		}
+
+	protected:
+		struct Write {
+			OpenCLBuffer	*buffer;
+			int				dstOffset;			// bytes, in buffer
+			int				srcOffset;			// bytes, in hostData
+			int				numBytes;
+			int				order;				// order of submission
+			int				span;				// index of the merged span which contains this write
+		};
+
+		struct Span {
+			OpenCLBuffer	*buffer;
+			int				dstOffset;
+			int				stagingOffset;		// bytes, in stagingData
+			int				numBytes;
+		};
+
+		vector<Write>			writes;
+		vector<unsigned char>	hostData;		// data as written
+		vector<Span>			spans;
+		vector<unsigned char>	stagingData;	// data merged into spans, followed by the scatter tables
+
+		OpenCLBuffer			stagingBuffer;
+		cl_event				uploadEvent;	// pending upload from stagingData
+
+		int						scatterThreshold;
+		OpenCLKernel			*kernelScatter;
+
+		void buildSpans();
+		void waitForUpload();
+
+		static bool compareWrites(const Write &a, const Write &b);
+	};
+}